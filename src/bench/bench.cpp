@@ -0,0 +1,113 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "utiltime.h"
+
+#include <iostream>
+#include <sys/time.h>
+
+#include <univalue.h>
+
+using namespace benchmark;
+
+std::map<std::string, BenchFunction>& BenchRunner::benchmarks()
+{
+    static std::map<std::string, BenchFunction> benchmarks_map;
+    return benchmarks_map;
+}
+
+static double gettimedouble(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_usec * 0.000001 + tv.tv_sec;
+}
+
+BenchRunner::BenchRunner(std::string name, BenchFunction func)
+{
+    benchmarks().insert(std::make_pair(name, func));
+}
+
+void BenchRunner::RunAll(const std::string& strFilter, OutputFormat format, double elapsedTimeForOne)
+{
+    std::vector<Result> vResults;
+    if (format == FORMAT_CONSOLE)
+        std::cout << "#Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << "\n";
+    for (std::map<std::string, BenchFunction>::iterator it = benchmarks().begin(); it != benchmarks().end(); ++it) {
+        if (!strFilter.empty() && it->first.find(strFilter) == std::string::npos)
+            continue;
+        State state(it->first, elapsedTimeForOne);
+        BenchFunction& func = it->second;
+        func(state);
+        vResults.push_back(state.GetResult());
+        if (format == FORMAT_CONSOLE) {
+            const Result& r = vResults.back();
+            std::cout << r.name << "," << r.nIterations << "," << r.nMin << "," << r.nMax << "," << r.Average() << "\n";
+        }
+    }
+
+    if (format == FORMAT_CSV) {
+        std::cout << "name,iterations,total_s,min_ns,max_ns,avg_ns\n";
+        for (const Result& r : vResults) {
+            std::cout << r.name << "," << r.nIterations << "," << r.nElapsed << "," << r.nMin * 1e9 << "," << r.nMax * 1e9 << "," << r.Average() * 1e9 << "\n";
+        }
+    } else if (format == FORMAT_JSON) {
+        UniValue results(UniValue::VARR);
+        for (const Result& r : vResults) {
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("name", r.name));
+            obj.push_back(Pair("iterations", r.nIterations));
+            obj.push_back(Pair("total_s", r.nElapsed));
+            obj.push_back(Pair("min_ns", r.nMin * 1e9));
+            obj.push_back(Pair("max_ns", r.nMax * 1e9));
+            obj.push_back(Pair("avg_ns", r.Average() * 1e9));
+            results.push_back(obj);
+        }
+        UniValue ret(UniValue::VOBJ);
+        ret.push_back(Pair("time", GetTime()));
+        ret.push_back(Pair("benchmarks", results));
+        std::cout << ret.write(2) << "\n";
+    }
+}
+
+bool State::KeepRunning()
+{
+    double now;
+    if (count == 0) {
+        beginTime = now = gettimedouble();
+    } else {
+        // timeCheckCount is used to avoid calling gettime most of the time,
+        // so benchmarks that run very quickly get consistent results.
+        if ((count + 1) & countMask) {
+            ++count;
+            return true; // keep going
+        }
+        now = gettimedouble();
+        double elapsedOne = (now - lastTime) / (countMask + 1);
+        if (elapsedOne < minTime) minTime = elapsedOne;
+        if (elapsedOne > maxTime) maxTime = elapsedOne;
+        if (elapsedOne * (countMask + 1) < 0.00001) countMask = ((countMask << 1) | 1) & ((1LL << 60) - 1);
+    }
+    lastTime = now;
+    ++count;
+
+    if (now - beginTime < maxElapsed) return true; // Keep going
+
+    --count;
+    return false;
+}
+
+Result State::GetResult() const
+{
+    Result r;
+    r.name = name;
+    r.nIterations = count;
+    r.nElapsed = lastTime - beginTime;
+    r.nMin = count > 1 ? minTime : r.nElapsed;
+    r.nMax = count > 1 ? maxTime : r.nElapsed;
+    return r;
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "crypto/sha256.h"
+#include "key.h"
+#include "ui_interface.h"
+#include "util.h"
+
+#include <iostream>
+
+CClientUIInterface uiInterface;
+class CWallet;
+CWallet* pwalletMain;
+
+// Defined here instead of taken from init.cpp, which would bring its own copies of the above
+void Shutdown(void* parg)
+{
+    exit(0);
+}
+
+void StartShutdown()
+{
+    exit(0);
+}
+
+bool ShutdownRequested()
+{
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    ParseParameters(argc, argv);
+    if (mapArgs.count("-?") || mapArgs.count("-help") || mapArgs.count("-h")) {
+        std::cout << "Usage: bench_esbcoin [options]\n\n"
+                  << "Options:\n"
+                  << "  -filter=<str>   Only run benchmarks whose name contains <str>\n"
+                  << "  -format=<fmt>   Output format: console, csv or json (default: console)\n"
+                  << "  -time=<n>       Seconds to spend on each benchmark (default: 1)\n";
+        return 0;
+    }
+
+    SetupEnvironment();
+    fPrintToDebugLog = false; // don't want to write to debug.log file
+    SHA256AutoDetect();
+    ECC_InitSanityCheck();
+    SelectParams(CBaseChainParams::MAIN);
+
+    benchmark::OutputFormat format = benchmark::FORMAT_CONSOLE;
+    std::string strFormat = GetArg("-format", "console");
+    if (strFormat == "csv") {
+        format = benchmark::FORMAT_CSV;
+    } else if (strFormat == "json") {
+        format = benchmark::FORMAT_JSON;
+    } else if (strFormat != "console") {
+        std::cerr << "Unknown output format: " << strFormat << "\n";
+        return 1;
+    }
+
+    double nTime = atof(GetArg("-time", "1").c_str());
+    benchmark::BenchRunner::RunAll(GetArg("-filter", ""), format, nTime > 0 ? nTime : 1.0);
+
+    return 0;
+}
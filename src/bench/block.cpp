@@ -0,0 +1,89 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "amount.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "streams.h"
+#include "version.h"
+
+//! A block of nTx two-in two-out transactions with random prevouts
+static CBlock MakeBlock(unsigned int nTx)
+{
+    CBlock block;
+    block.nVersion = CBlockHeader::CURRENT_VERSION;
+    block.nTime = 1546300800;
+    block.nBits = 0x1e0fffff;
+    for (unsigned int i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(2);
+        tx.vout.resize(2);
+        for (unsigned int j = 0; j < 2; j++) {
+            tx.vin[j].prevout = COutPoint(GetRandHash(), j);
+            tx.vin[j].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+            tx.vout[j].nValue = (i + 1) * COIN;
+            tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, (unsigned char)j) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static void BuildMerkleTree(benchmark::State& state)
+{
+    CBlock block = MakeBlock(1000);
+    while (state.KeepRunning()) {
+        bool mutated;
+        block.BuildMerkleTree(&mutated);
+    }
+}
+
+static void DeserializeBlock(benchmark::State& state)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << MakeBlock(1000);
+    while (state.KeepRunning()) {
+        CDataStream ss(stream.begin(), stream.end(), SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        ss >> block;
+    }
+}
+
+static void SerializeBlock(benchmark::State& state)
+{
+    CBlock block = MakeBlock(1000);
+    while (state.KeepRunning()) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+    }
+}
+
+static void DeserializeTransaction(benchmark::State& state)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << MakeBlock(1).vtx[0];
+    while (state.KeepRunning()) {
+        CDataStream ss(stream.begin(), stream.end(), SER_NETWORK, PROTOCOL_VERSION);
+        CTransaction tx;
+        ss >> tx;
+    }
+}
+
+static void SerializeTransaction(benchmark::State& state)
+{
+    CTransaction tx = MakeBlock(1).vtx[0];
+    while (state.KeepRunning()) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << tx;
+    }
+}
+
+BENCHMARK(BuildMerkleTree);
+BENCHMARK(DeserializeBlock);
+BENCHMARK(SerializeBlock);
+BENCHMARK(DeserializeTransaction);
+BENCHMARK(SerializeTransaction);
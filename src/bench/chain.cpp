@@ -0,0 +1,38 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/chain.h"
+
+#include "chainparams.h"
+#include "kernel.h"
+#include "main.h"
+
+const CBlockIndex* SetupBenchChain()
+{
+    LOCK(cs_main);
+    if (chainActive.Height() >= BENCH_CHAIN_HEIGHT - 1)
+        return chainActive.Tip();
+
+    CBlockIndex* pindexPrev = NULL;
+    for (int nHeight = 0; nHeight < BENCH_CHAIN_HEIGHT; nHeight++) {
+        CBlock block;
+        block.nVersion = CBlockHeader::CURRENT_VERSION;
+        block.hashPrevBlock = pindexPrev ? pindexPrev->GetBlockHash() : uint256(0);
+        block.nTime = Params().GenesisBlock().nTime + nHeight * 60;
+        block.nBits = 0x1e0fffff;
+        block.nNonce = nHeight;
+
+        CBlockIndex* pindex = blockIndexArena.Allocate(block);
+        BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(block.GetHash(), pindex)).first;
+        pindex->phashBlock = &((*mi).first);
+        pindex->pprev = pindexPrev;
+        pindex->nHeight = nHeight;
+        pindex->BuildSkip();
+        pindex->SetStakeModifier(0x1234567890abcdefULL + nHeight, nHeight % 10 == 0);
+        pindexPrev = pindex;
+    }
+    chainActive.SetTip(pindexPrev);
+    stakeModifierIndex.SetTip(pindexPrev);
+    return pindexPrev;
+}
@@ -0,0 +1,19 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_CHAIN_H
+#define BITCOIN_BENCH_CHAIN_H
+
+class CBlockIndex;
+
+//! Blocks in the synthetic chain used by the benchmarks
+static const int BENCH_CHAIN_HEIGHT = 2000;
+
+/**
+ * Build a synthetic active chain of BENCH_CHAIN_HEIGHT blocks, one minute
+ * apart, with a stake modifier every ten blocks. Only done once; returns the tip.
+ */
+const CBlockIndex* SetupBenchChain();
+
+#endif // BITCOIN_BENCH_CHAIN_H
@@ -0,0 +1,99 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "amount.h"
+#include "coins.h"
+#include "random.h"
+
+#include <map>
+
+namespace
+{
+//! An in-memory base view, so the numbers are about the cache itself
+class CCoinsViewBench : public CCoinsView
+{
+    std::map<uint256, CCoins> map_;
+
+public:
+    bool GetCoins(const uint256& txid, CCoins& coins) const
+    {
+        std::map<uint256, CCoins>::const_iterator it = map_.find(txid);
+        if (it == map_.end())
+            return false;
+        coins = it->second;
+        return true;
+    }
+
+    bool HaveCoins(const uint256& txid) const { return map_.count(txid) > 0; }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    {
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+            if (it->second.coins.IsPruned())
+                map_.erase(it->first);
+            else
+                map_[it->first] = it->second.coins;
+        }
+        mapCoins.clear();
+        return true;
+    }
+};
+
+//! nTx transactions with 20 outputs each, roughly the shape of masternode payouts
+std::vector<uint256> FillCoins(CCoinsView& view, unsigned int nTx)
+{
+    std::vector<uint256> txids;
+    CCoinsViewCache cache(&view);
+    for (unsigned int i = 0; i < nTx; i++) {
+        txids.push_back(GetRandHash());
+        CCoinsModifier coins = cache.ModifyCoins(txids.back());
+        coins->nVersion = 1;
+        coins->nHeight = 1000;
+        coins->vout.resize(20);
+        for (unsigned int j = 0; j < 20; j++) {
+            coins->vout[j].nValue = COIN;
+            coins->vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, (unsigned char)j) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+    }
+    cache.Flush();
+    return txids;
+}
+}
+
+//! Pull coins from the parent view into an empty cache
+static void CoinsCacheFetch(benchmark::State& state)
+{
+    CCoinsViewBench base;
+    std::vector<uint256> txids = FillCoins(base, 1000);
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(&base);
+        for (const uint256& txid : txids)
+            cache.AccessCoins(txid);
+    }
+}
+
+//! Spend one output of each of 1000 transactions and flush that into a parent cache
+static void CoinsCacheFlush(benchmark::State& state)
+{
+    CCoinsViewBench base;
+    std::vector<uint256> txids = FillCoins(base, 1000);
+    CCoinsViewCache parent(&base);
+    unsigned int n = 0;
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(&parent);
+        for (const uint256& txid : txids)
+            cache.ModifyCoins(txid)->Spend(n % 20);
+        cache.Flush();
+        if (++n % 20 == 0) {
+            // everything is spent; start over from the base
+            parent.Flush();
+            txids = FillCoins(base, 1000);
+        }
+    }
+}
+
+BENCHMARK(CoinsCacheFetch);
+BENCHMARK(CoinsCacheFlush);
@@ -0,0 +1,86 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench/chain.h"
+
+#include "amount.h"
+#include "chain.h"
+#include "kernel.h"
+#include "main.h"
+#include "random.h"
+
+//! Stake from the block at height 100 of the bench chain, a day later
+static void KernelSetup(CBlock& blockFrom, CTransaction& txPrev, unsigned int& nTimeTx)
+{
+    SetupBenchChain();
+    LOCK(cs_main);
+    blockFrom = CBlock(chainActive[100]->GetBlockHeader());
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1000 * COIN;
+    txPrev = tx;
+    nTimeTx = blockFrom.GetBlockTime() + 24 * 60 * 60;
+}
+
+static void StakeKernelHash(benchmark::State& state)
+{
+    CBlock blockFrom;
+    CTransaction txPrev;
+    unsigned int nTimeTx;
+    KernelSetup(blockFrom, txPrev, nTimeTx);
+    COutPoint prevout(txPrev.GetHash(), 0);
+    uint256 hashProofOfStake;
+    while (state.KeepRunning()) {
+        unsigned int nTime = nTimeTx;
+        CheckStakeKernelHash(0x1e0fffff, blockFrom, txPrev, prevout, nTime, 0, true, hashProofOfStake);
+    }
+}
+
+//! A full staking attempt: the hash drift search over 60 timestamps
+static void StakeKernelHashSearch(benchmark::State& state)
+{
+    CBlock blockFrom;
+    CTransaction txPrev;
+    unsigned int nTimeTx;
+    KernelSetup(blockFrom, txPrev, nTimeTx);
+    COutPoint prevout(txPrev.GetHash(), 0);
+    uint256 hashProofOfStake;
+    while (state.KeepRunning()) {
+        unsigned int nTime = nTimeTx;
+        // an unreachable target, so every timestamp is tried
+        CheckStakeKernelHash(0x03000001, blockFrom, txPrev, prevout, nTime, 60, false, hashProofOfStake);
+    }
+}
+
+//! The same search over the precomputed stake table, for 100 coins
+static void StakeKernelTableSearch(benchmark::State& state)
+{
+    CBlock blockFrom;
+    CTransaction txPrev;
+    unsigned int nTimeTx;
+    KernelSetup(blockFrom, txPrev, nTimeTx);
+    std::vector<CStakeKernelInput> vInputs;
+    {
+        LOCK(cs_main);
+        for (unsigned int n = 0; n < 100; n++) {
+            CStakeKernelInput input;
+            if (GetStakeKernelInput(COutPoint(txPrev.GetHash(), n), txPrev.vout[0].nValue, blockFrom.GetHash(), nTimeTx, input))
+                vInputs.push_back(input);
+        }
+    }
+    assert(vInputs.size() == 100);
+    size_t nKernel;
+    uint256 hashProofOfStake;
+    while (state.KeepRunning()) {
+        unsigned int nTime = nTimeTx;
+        FindStakeKernel(vInputs, 0x03000001, nTime, 60, 0, nKernel, hashProofOfStake);
+    }
+}
+
+BENCHMARK(StakeKernelHash);
+BENCHMARK(StakeKernelHashSearch);
+BENCHMARK(StakeKernelTableSearch);
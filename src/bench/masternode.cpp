@@ -0,0 +1,128 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench/chain.h"
+
+#include "chain.h"
+#include "key.h"
+#include "masternode-sigcheck.h"
+#include "masternodeman.h"
+#include "obfuscation.h"
+#include "random.h"
+#include "timedata.h"
+
+#include <boost/thread.hpp>
+
+//! Rank one masternode among nCount at a recent height, as payment voting does
+static void MasternodeRank(benchmark::State& state, int nCount)
+{
+    const CBlockIndex* pindexTip = SetupBenchChain();
+    CMasternodeMan man;
+    CTxIn vin;
+    for (int i = 0; i < nCount; i++) {
+        CMasternode mn;
+        mn.vin = CTxIn(COutPoint(GetRandHash(), 0));
+        mn.sigTime = GetAdjustedTime() - 24 * 60 * 60;
+        man.Add(mn);
+        vin = mn.vin;
+    }
+    int nHeight = pindexTip->nHeight - 100;
+    while (state.KeepRunning()) {
+        man.GetMasternodeRank(vin, nHeight, 0, false);
+        // move along the chain so the block hash cache sees a realistic mix
+        if (--nHeight < pindexTip->nHeight - 1000)
+            nHeight = pindexTip->nHeight - 100;
+    }
+}
+
+static void MasternodeRank_100(benchmark::State& state) { MasternodeRank(state, 100); }
+static void MasternodeRank_1000(benchmark::State& state) { MasternodeRank(state, 1000); }
+static void MasternodeRank_5000(benchmark::State& state) { MasternodeRank(state, 5000); }
+
+BENCHMARK(MasternodeRank_100);
+BENCHMARK(MasternodeRank_1000);
+BENCHMARK(MasternodeRank_5000);
+
+//! Masternodes in the synthetic list sync
+static const int BENCH_DSEG_MASTERNODES = 3000;
+
+//! Signed mnb messages for BENCH_DSEG_MASTERNODES masternodes, as a dseg reply gets them sent
+static const std::vector<CDataStream>& SetupDsegResponse()
+{
+    static std::vector<CDataStream> vMessages;
+    if (!vMessages.empty())
+        return vMessages;
+
+    SetupBenchChain();
+    for (int i = 0; i < BENCH_DSEG_MASTERNODES; i++) {
+        CKey keyCollateral, keyMasternode;
+        keyCollateral.MakeNewKey(true);
+        keyMasternode.MakeNewKey(true);
+        CPubKey pubKeyMasternode = keyMasternode.GetPubKey();
+        CTxIn vin(COutPoint(GetRandHash(), 0));
+        CMasternodeBroadcast mnb(CService("10.0.0.1", 32322), vin, keyCollateral.GetPubKey(), pubKeyMasternode, PROTOCOL_VERSION);
+        mnb.lastPing = CMasternodePing(vin);
+        mnb.lastPing.Sign(keyMasternode, pubKeyMasternode);
+        mnb.Sign(keyCollateral);
+
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << mnb;
+        vMessages.push_back(ss);
+    }
+    return vMessages;
+}
+
+//! The signature checks CMasternodeBroadcast::CheckAndUpdate does for one message
+static void VerifyBroadcast(const CDataStream& msg)
+{
+    CDataStream vRecv(msg);
+    CMasternodeBroadcast mnb;
+    vRecv >> mnb;
+    std::string strError;
+    bool fOk = obfuScationSigner.VerifyMessage(mnb.pubKeyCollateralAddress, mnb.sig, mnb.GetStrMessage(), strError);
+    fOk &= obfuScationSigner.VerifyMessage(mnb.pubKeyMasternode, mnb.lastPing.vchSig, mnb.lastPing.GetStrMessage(), strError);
+    assert(fOk);
+}
+
+//! Check every signature of the list sync one message after the other
+static void MasternodeSigVerify_Serial(benchmark::State& state)
+{
+    const std::vector<CDataStream>& vMessages = SetupDsegResponse();
+    while (state.KeepRunning()) {
+        obfuScationSigner.ClearRecoveredKeys();
+        for (const CDataStream& msg : vMessages)
+            VerifyBroadcast(msg);
+    }
+}
+
+//! Check the list sync in batches on the signature check threads, then apply the messages in order
+static void MasternodeSigVerify_Batch(benchmark::State& state)
+{
+    const std::vector<CDataStream>& vMessages = SetupDsegResponse();
+    boost::thread_group threads;
+    nMnSigCheckThreads = std::max(1, (int)boost::thread::hardware_concurrency() - 1);
+    for (int i = 0; i < nMnSigCheckThreads; i++)
+        threads.create_thread(&ThreadMasternodeSigCheck);
+
+    while (state.KeepRunning()) {
+        obfuScationSigner.ClearRecoveredKeys();
+        for (size_t nStart = 0; nStart < vMessages.size(); nStart += MAX_SIGCHECK_LOOKAHEAD) {
+            size_t nEnd = std::min(vMessages.size(), nStart + MAX_SIGCHECK_LOOKAHEAD);
+            CMasternodeSigBatch batch;
+            for (size_t i = nStart; i < nEnd; i++)
+                batch.AddMessage("mnb", vMessages[i]);
+            batch.Verify();
+            for (size_t i = nStart; i < nEnd; i++)
+                VerifyBroadcast(vMessages[i]);
+        }
+    }
+
+    threads.interrupt_all();
+    threads.join_all();
+    nMnSigCheckThreads = 0;
+}
+
+BENCHMARK(MasternodeSigVerify_Serial);
+BENCHMARK(MasternodeSigVerify_Batch);
@@ -0,0 +1,51 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "amount.h"
+#include "main.h"
+#include "random.h"
+#include "txmempool.h"
+
+#include <list>
+
+//! nChains chains of nDepth transactions, each spending its predecessor
+static std::vector<CTransaction> MakeChains(unsigned int nChains, unsigned int nDepth)
+{
+    std::vector<CTransaction> vtx;
+    for (unsigned int i = 0; i < nChains; i++) {
+        uint256 hashPrev = GetRandHash();
+        for (unsigned int j = 0; j < nDepth; j++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(hashPrev, 0);
+            tx.vin[0].scriptSig = CScript() << OP_1;
+            tx.vout.resize(2);
+            tx.vout[0].nValue = 10 * COIN;
+            tx.vout[0].scriptPubKey = CScript() << OP_1;
+            tx.vout[1].nValue = COIN;
+            tx.vout[1].scriptPubKey = CScript() << OP_2;
+            vtx.push_back(tx);
+            hashPrev = vtx.back().GetHash();
+        }
+    }
+    return vtx;
+}
+
+static void MempoolAddRemove(benchmark::State& state)
+{
+    std::vector<CTransaction> vtx = MakeChains(100, 25);
+    CTxMemPool pool(CFeeRate(1000));
+    while (state.KeepRunning()) {
+        for (const CTransaction& tx : vtx)
+            pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 10000, 0, 0.0, 1));
+        std::list<CTransaction> removed;
+        // removing the chain roots takes their descendants along
+        for (unsigned int i = 0; i < vtx.size(); i += 25)
+            pool.remove(vtx[i], removed, true);
+    }
+}
+
+BENCHMARK(MempoolAddRemove);
@@ -0,0 +1,61 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "keystore.h"
+#include "script/interpreter.h"
+#include "script/sigcache.h"
+#include "script/sign.h"
+#include "script/standard.h"
+
+//! A pay-to-pubkey-hash output and a transaction that spends it
+static void SetupP2PKH(CMutableTransaction& txCredit, CMutableTransaction& txSpend)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+
+    txCredit.vin.resize(1);
+    txCredit.vout.resize(1);
+    txCredit.vout[0].nValue = 1;
+    txCredit.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(CTransaction(txCredit).GetHash(), 0);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = 1;
+    SignSignature(keystore, CTransaction(txCredit), txSpend, 0);
+}
+
+static void VerifyScriptP2PKH(benchmark::State& state)
+{
+    CMutableTransaction txCredit, txSpend;
+    SetupP2PKH(txCredit, txSpend);
+    const CTransaction tx(txSpend);
+    const CScript& scriptPubKey = txCredit.vout[0].scriptPubKey;
+    while (state.KeepRunning()) {
+        ScriptError err;
+        VerifyScript(tx.vin[0].scriptSig, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0), &err);
+    }
+}
+
+//! The same verification as a block would do it after the signature was cached at mempool acceptance
+static void VerifyScriptP2PKHSigCache(benchmark::State& state)
+{
+    CMutableTransaction txCredit, txSpend;
+    SetupP2PKH(txCredit, txSpend);
+    const CTransaction tx(txSpend);
+    const CScript& scriptPubKey = txCredit.vout[0].scriptPubKey;
+    ScriptError err;
+    VerifyScript(tx.vin[0].scriptSig, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, CachingTransactionSignatureChecker(&tx, 0, true), &err);
+    while (state.KeepRunning()) {
+        VerifyScript(tx.vin[0].scriptSig, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, CachingTransactionSignatureChecker(&tx, 0, false), &err);
+    }
+}
+
+BENCHMARK(VerifyScriptP2PKH);
+BENCHMARK(VerifyScriptP2PKHSigCache);
@@ -0,0 +1,133 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include "memusage.h"
+
+#include <list>
+
+// Blocks are big and few, a max size block must still fit in one shard
+CRawDataCache rawBlockCache(4);
+CRawDataCache rawTxCache(16);
+
+CRawDataCache::CRawDataCache(size_t nShards) : vShards(nShards), nMaxBytes(0)
+{
+}
+
+size_t CRawDataCache::EntryUsage(const CRawDataRef& data)
+{
+    // The data itself, its shared pointer control block, and lrumap's list and map nodes
+    return memusage::MallocUsage(sizeof(CRawData) + 16) + memusage::DynamicUsage(data->vch) +
+           memusage::MallocUsage(sizeof(EntryMap::value_type) + 2 * sizeof(void*)) +
+           memusage::MallocUsage(sizeof(memusage::stl_tree_node<std::pair<const uint256, std::list<EntryMap::value_type>::iterator> >));
+}
+
+void CRawDataCache::EraseEntry(Shard& shard, const uint256& hash)
+{
+    CRawDataRef data;
+    if (!shard.entries.get(hash, data))
+        return;
+    shard.nBytes -= EntryUsage(data);
+    shard.entries.erase(hash);
+}
+
+void CRawDataCache::Trim(Shard& shard)
+{
+    size_t nShardMax = ShardMaxBytes();
+    while (shard.nBytes > nShardMax && !shard.entries.empty()) {
+        shard.nBytes -= EntryUsage(shard.entries.back().second);
+        shard.entries.pop_back();
+    }
+}
+
+bool CRawDataCache::Get(const uint256& hash, CRawDataRef& data)
+{
+    Shard& shard = GetShard(hash);
+    LOCK(shard.cs);
+    if (!shard.entries.get(hash, data)) {
+        shard.nMisses++;
+        return false;
+    }
+    shard.nHits++;
+    return true;
+}
+
+void CRawDataCache::InsertEntry(Shard& shard, const uint256& hash, const CRawDataRef& data)
+{
+    EraseEntry(shard, hash);
+    shard.entries.insert(hash, data);
+    shard.nBytes += EntryUsage(data);
+    Trim(shard);
+}
+
+void CRawDataCache::Insert(const uint256& hash, const CRawDataRef& data)
+{
+    if (!IsEnabled() || EntryUsage(data) > ShardMaxBytes())
+        return;
+
+    Shard& shard = GetShard(hash);
+    LOCK(shard.cs);
+    InsertEntry(shard, hash, data);
+}
+
+void CRawDataCache::Insert(const uint256& hash, const CRawDataRef& data, uint64_t nGeneration)
+{
+    if (!IsEnabled() || EntryUsage(data) > ShardMaxBytes())
+        return;
+
+    Shard& shard = GetShard(hash);
+    LOCK(shard.cs);
+    if (shard.nGeneration != nGeneration)
+        return;
+    InsertEntry(shard, hash, data);
+}
+
+uint64_t CRawDataCache::GetGeneration(const uint256& hash) const
+{
+    const Shard& shard = GetShard(hash);
+    LOCK(shard.cs);
+    return shard.nGeneration;
+}
+
+void CRawDataCache::Erase(const uint256& hash)
+{
+    Shard& shard = GetShard(hash);
+    LOCK(shard.cs);
+    EraseEntry(shard, hash);
+    shard.nGeneration++;
+}
+
+void CRawDataCache::Clear()
+{
+    for (Shard& shard : vShards) {
+        LOCK(shard.cs);
+        shard.entries.clear();
+        shard.nBytes = 0;
+        shard.nGeneration++;
+    }
+}
+
+void CRawDataCache::SetMaxBytes(size_t nMaxBytesIn)
+{
+    nMaxBytes = nMaxBytesIn;
+    for (Shard& shard : vShards) {
+        LOCK(shard.cs);
+        Trim(shard);
+    }
+}
+
+CRawDataCacheStats CRawDataCache::GetStats() const
+{
+    CRawDataCacheStats stats;
+    stats.nMaxBytes = nMaxBytes;
+    for (const Shard& shard : vShards) {
+        LOCK(shard.cs);
+        stats.nEntries += shard.entries.size();
+        stats.nBytes += shard.nBytes;
+        stats.nHits += shard.nHits;
+        stats.nMisses += shard.nMisses;
+    }
+    return stats;
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include "lrumap.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <memory>
+#include <vector>
+
+#include <stdint.h>
+
+//! -rawcachesize default (MiB), split between blocks and transactions
+static const int64_t DEFAULT_RAW_CACHE_SIZE = 32;
+
+/** Network serialization of a block or transaction and the block it came from */
+struct CRawData {
+    uint256 hashBlock;
+    std::vector<unsigned char> vch;
+
+    CRawData() {}
+    CRawData(const uint256& hashBlockIn) : hashBlock(hashBlockIn) {}
+};
+
+typedef std::shared_ptr<const CRawData> CRawDataRef;
+
+struct CRawDataCacheStats {
+    uint64_t nEntries;
+    uint64_t nBytes;
+    uint64_t nMaxBytes;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    CRawDataCacheStats() : nEntries(0), nBytes(0), nMaxBytes(0), nHits(0), nMisses(0) {}
+};
+
+/**
+ * Byte bounded LRU cache of serialized blocks or transactions, keyed by hash.
+ * Entries are split over shards by hash, each with its own lock and its own
+ * share of the budget, so that message handler, RPC and REST threads serving
+ * different hashes do not contend. Entries are handed out as shared pointers
+ * and stay valid after they are evicted.
+ */
+class CRawDataCache
+{
+private:
+    typedef lrumap<uint256, CRawDataRef> EntryMap;
+
+    struct Shard {
+        mutable CCriticalSection cs;
+        //! not bounded by count, Trim() evicts by nBytes instead
+        EntryMap entries;
+        //! memory usage of entries
+        size_t nBytes;
+        //! bumped by every Erase() and Clear(), see GetGeneration()
+        uint64_t nGeneration;
+        uint64_t nHits;
+        uint64_t nMisses;
+
+        Shard() : nBytes(0), nGeneration(0), nHits(0), nMisses(0) {}
+    };
+
+    std::vector<Shard> vShards;
+    size_t nMaxBytes;
+
+    Shard& GetShard(const uint256& hash) { return vShards[hash.GetLow64() % vShards.size()]; }
+    const Shard& GetShard(const uint256& hash) const { return vShards[hash.GetLow64() % vShards.size()]; }
+    size_t ShardMaxBytes() const { return nMaxBytes / vShards.size(); }
+    static size_t EntryUsage(const CRawDataRef& data);
+    void EraseEntry(Shard& shard, const uint256& hash);
+    void InsertEntry(Shard& shard, const uint256& hash, const CRawDataRef& data);
+    void Trim(Shard& shard);
+
+public:
+    CRawDataCache(size_t nShards);
+
+    //! Look hash up and mark it as most recently used
+    bool Get(const uint256& hash, CRawDataRef& data);
+    //! Insert or replace hash as the most recently used entry; entries larger than a shard's budget are not kept
+    void Insert(const uint256& hash, const CRawDataRef& data);
+    /**
+     * Insert unless an entry was erased from the shard of hash since GetGeneration()
+     * returned nGeneration: data read before an Erase() may be what it erased.
+     */
+    void Insert(const uint256& hash, const CRawDataRef& data, uint64_t nGeneration);
+    uint64_t GetGeneration(const uint256& hash) const;
+    void Erase(const uint256& hash);
+    void Clear();
+
+    //! Set the total budget in bytes, 0 disables the cache
+    void SetMaxBytes(size_t nMaxBytesIn);
+    bool IsEnabled() const { return nMaxBytes > 0; }
+
+    CRawDataCacheStats GetStats() const;
+};
+
+//! Recently served blocks, for getdata, getblock and /rest/block
+extern CRawDataCache rawBlockCache;
+//! Recently looked up confirmed transactions, for GetTransaction
+extern CRawDataCache rawTxCache;
+
+#endif // BITCOIN_BLOCKCACHE_H
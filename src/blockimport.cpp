@@ -0,0 +1,193 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "streams.h"
+#include "util.h"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+CBlockImportPipeline::CBlockImportPipeline(FILE* fileIn, CDiskBlockPos* dbp, int nWorkers) : nQueueBase(0), nNextParse(0), nBytesInFlight(0), fReaderDone(false), fResync(false), nResyncPos(0), fStop(false)
+{
+    threads.create_thread(boost::bind(&CBlockImportPipeline::ThreadReader, this, fileIn, dbp));
+    for (int i = 0; i < std::max(nWorkers, 1); i++)
+        threads.create_thread(boost::bind(&CBlockImportPipeline::ThreadWorker, this));
+}
+
+CBlockImportPipeline::~CBlockImportPipeline()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+        condReader.notify_all();
+        condWorker.notify_all();
+    }
+    threads.join_all();
+}
+
+void CBlockImportPipeline::ThreadReader(FILE* fileIn, CDiskBlockPos* dbp)
+{
+    RenameThread("esbcoin-loadblk-read");
+    try {
+        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+        CBufferedFile blkdat(fileIn, 16 * MAX_BLOCK_SIZE, MAX_BLOCK_SIZE + 8, SER_DISK, CLIENT_VERSION);
+        uint64_t nRewind = blkdat.GetPos();
+        bool fEnd = false;
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                if (!fResync && (fEnd || blkdat.eof())) {
+                    // Nothing left to read unless the consumer finds a bad record and asks for a rescan
+                    fReaderDone = true;
+                    condConsumer.notify_all();
+                    while (!fStop && !fResync)
+                        condReader.wait(lock);
+                }
+                if (fStop)
+                    break;
+                if (fResync) {
+                    fResync = false;
+                    fReaderDone = false;
+                    fEnd = false;
+                    nRewind = nResyncPos;
+                    if (!blkdat.Seek(nRewind))
+                        throw std::runtime_error("CBlockImportPipeline : seek failed");
+                }
+            }
+
+            blkdat.SetPos(nRewind);
+            nRewind++;         // start one byte further next time, in case of failure
+            blkdat.SetLimit(); // remove former limit
+            unsigned int nSize = 0;
+            try {
+                // locate a header
+                unsigned char buf[MESSAGE_START_SIZE];
+                blkdat.FindByte(Params().MessageStart()[0]);
+                nRewind = blkdat.GetPos() + 1;
+                blkdat >> FLATDATA(buf);
+                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                    continue;
+                // read size
+                blkdat >> nSize;
+                if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
+                    continue;
+            } catch (const std::exception&) {
+                // no valid block header found; don't complain
+                fEnd = true;
+                continue;
+            }
+            boost::shared_ptr<CImportBlock> job(new CImportBlock());
+            job->nRewind = nRewind;
+            try {
+                uint64_t nBlockPos = blkdat.GetPos();
+                if (dbp)
+                    job->pos = CDiskBlockPos(dbp->nFile, nBlockPos);
+                blkdat.SetLimit(nBlockPos + nSize);
+                job->nSize = nSize;
+                job->vData.resize(nSize);
+                blkdat.read(&job->vData[0], nSize);
+                nRewind = blkdat.GetPos();
+            } catch (const std::exception& e) {
+                LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
+                continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!fStop && !fResync && nBytesInFlight > MAX_BYTES_IN_FLIGHT)
+                condReader.wait(lock);
+            // a rescan drops whatever was read past the bad record, including this one
+            if (fStop || fResync)
+                continue;
+            nBytesInFlight += nSize;
+            queue.push_back(job);
+            condWorker.notify_one();
+        }
+    } catch (const std::exception& e) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        strReaderError = e.what();
+    }
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fReaderDone = true;
+    fResync = false;
+    condConsumer.notify_all();
+}
+
+void CBlockImportPipeline::ThreadWorker()
+{
+    RenameThread("esbcoin-loadblk-parse");
+    while (true) {
+        boost::shared_ptr<CImportBlock> job;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!fStop && nNextParse >= nQueueBase + queue.size())
+                condWorker.wait(lock);
+            if (fStop)
+                return;
+            job = queue[nNextParse - nQueueBase];
+            nNextParse++;
+        }
+
+        try {
+            CDataStream ss(&job->vData[0], &job->vData[0] + job->vData.size(), SER_DISK, CLIENT_VERSION);
+            ss >> job->block;
+            job->hash = job->block.GetHash();
+            bool mutated;
+            uint256 hashMerkleRoot = job->block.BuildMerkleTree(&mutated);
+            // Leave failing blocks unchecked so that the connect stage reports them as usual
+            job->fPreChecked = hashMerkleRoot == job->block.hashMerkleRoot && !mutated && job->block.CheckBlockSignature();
+            job->fValid = true;
+        } catch (const std::exception& e) {
+            job->strError = e.what();
+        }
+        std::vector<char>().swap(job->vData);
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        job->fParsed = true;
+        condConsumer.notify_all();
+    }
+}
+
+bool CBlockImportPipeline::Next(boost::shared_ptr<CImportBlock>& jobRet)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true) {
+        while (queue.empty() || !queue.front()->fParsed) {
+            if (queue.empty() && fReaderDone && !fResync) {
+                if (!strReaderError.empty())
+                    throw std::runtime_error(strReaderError);
+                return false;
+            }
+            condConsumer.wait(lock);
+        }
+        jobRet = queue.front();
+        queue.pop_front();
+        nQueueBase++;
+        nBytesInFlight -= jobRet->nSize;
+        condReader.notify_one();
+        if (jobRet->fValid)
+            return true;
+
+        // The size field may be what is corrupted, so the records cut after this one can't be trusted:
+        // drop them and rescan from the byte after this record's magic
+        LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, jobRet->strError);
+        queue.clear();
+        nNextParse = nQueueBase;
+        nBytesInFlight = 0;
+        fResync = true;
+        nResyncPos = jobRet->nRewind;
+        condReader.notify_all();
+    }
+}
+
+size_t CBlockImportPipeline::QueueSize()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return queue.size();
+}
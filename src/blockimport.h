@@ -0,0 +1,83 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKIMPORT_H
+#define BITCOIN_BLOCKIMPORT_H
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "uint256.h"
+
+#include <deque>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+/** A size-delimited block record read from a block file, parsed by an import worker. */
+struct CImportBlock {
+    std::vector<char> vData;
+    unsigned int nSize;
+    //! file position one byte past the record's magic, where the scan resumes if the record is bad
+    uint64_t nRewind;
+    CDiskBlockPos pos;
+    CBlock block;
+    uint256 hash;
+    //! merkle root and block signature were verified by the worker
+    bool fPreChecked;
+    bool fParsed;
+    bool fValid;
+    std::string strError;
+
+    CImportBlock() : nSize(0), nRewind(0), fPreChecked(false), fParsed(false), fValid(false) {}
+};
+
+/**
+ * Pipelined block file import: one reader thread does large sequential reads
+ * and splits the file into raw block records, a pool of workers deserializes
+ * them and does the context-free hashing (block hash, merkle root, block
+ * signature), and the calling thread connects the results in file order.
+ *
+ * A record that fails to deserialize is not skipped as a whole: everything
+ * read past it is dropped and the reader rescans from the byte after its
+ * magic, so a block hidden inside a corrupted or truncated record is still
+ * found, as with the single threaded scan.
+ */
+class CBlockImportPipeline
+{
+private:
+    static const uint64_t MAX_BYTES_IN_FLIGHT = 64 * 1024 * 1024;
+
+    boost::mutex mutex;
+    boost::condition_variable condReader;   // space became available, or a rescan was requested
+    boost::condition_variable condWorker;   // a record was queued
+    boost::condition_variable condConsumer; // a record was parsed, or the reader finished
+    std::deque<boost::shared_ptr<CImportBlock> > queue;
+    uint64_t nQueueBase;  // sequence number of queue.front()
+    uint64_t nNextParse;  // sequence number of the next record to hand to a worker
+    uint64_t nBytesInFlight;
+    bool fReaderDone;     // the reader reached the end of the file and waits for a rescan or stop
+    bool fResync;         // the consumer asked the reader to rescan from nResyncPos
+    uint64_t nResyncPos;
+    bool fStop;
+    std::string strReaderError;
+    boost::thread_group threads;
+
+    void ThreadReader(FILE* fileIn, CDiskBlockPos* dbp);
+    void ThreadWorker();
+
+public:
+    CBlockImportPipeline(FILE* fileIn, CDiskBlockPos* dbp, int nWorkers);
+    ~CBlockImportPipeline();
+
+    /** Wait for the next well-formed record in file order. Returns false once the file is exhausted. */
+    bool Next(boost::shared_ptr<CImportBlock>& jobRet);
+
+    size_t QueueSize();
+};
+
+#endif // BITCOIN_BLOCKIMPORT_H
@@ -5,8 +5,57 @@
 
 #include "chain.h"
 
+#include "memusage.h"
+
 using namespace std;
 
+/**
+ * CBlockIndexArena implementation
+ */
+
+void* CBlockIndexArena::AllocateRaw()
+{
+    if (nChunkUsed == CHUNK_SIZE) {
+        vChunks.push_back(static_cast<CBlockIndex*>(::operator new(CHUNK_SIZE * sizeof(CBlockIndex))));
+        nChunkUsed = 0;
+    }
+    return vChunks.back() + nChunkUsed++;
+}
+
+CBlockIndex* CBlockIndexArena::Allocate()
+{
+    return new (AllocateRaw()) CBlockIndex();
+}
+
+CBlockIndex* CBlockIndexArena::Allocate(const CBlock& block)
+{
+    return new (AllocateRaw()) CBlockIndex(block);
+}
+
+void CBlockIndexArena::Clear()
+{
+    for (size_t i = 0; i < vChunks.size(); i++) {
+        size_t nEntries = (i + 1 == vChunks.size()) ? nChunkUsed : CHUNK_SIZE;
+        for (size_t j = 0; j < nEntries; j++)
+            vChunks[i][j].~CBlockIndex();
+        ::operator delete(vChunks[i]);
+    }
+    vChunks.clear();
+    nChunkUsed = CHUNK_SIZE;
+}
+
+size_t CBlockIndexArena::size() const
+{
+    if (vChunks.empty())
+        return 0;
+    return (vChunks.size() - 1) * CHUNK_SIZE + nChunkUsed;
+}
+
+size_t CBlockIndexArena::DynamicMemoryUsage() const
+{
+    return memusage::MallocUsage(CHUNK_SIZE * sizeof(CBlockIndex)) * vChunks.size() + memusage::DynamicUsage(vChunks);
+}
+
 /**
  * CChain implementation
  */
@@ -97,6 +146,26 @@ const CBlockIndex* CChain::FindFork(const CBlockIndex* pindex) const
     return pindex;
 }
 
+CChainSnapshot::CChainSnapshot(const CChainSnapshot& prev, const CChain& chain) : nHeight(chain.Height())
+{
+    // Highest block both chains agree on
+    int nFork = std::min(prev.Height(), nHeight);
+    while (nFork >= 0 && prev[nFork] != chain[nFork])
+        nFork--;
+
+    // Full chunks up to there are shared, the rest is copied from the chain
+    int nShared = (nFork + 1) / CHUNK_SIZE;
+    vChunks.assign(prev.vChunks.begin(), prev.vChunks.begin() + nShared);
+    for (int nStart = nShared * CHUNK_SIZE; nStart <= nHeight; nStart += CHUNK_SIZE) {
+        int nEnd = std::min(nHeight + 1, nStart + CHUNK_SIZE);
+        std::shared_ptr<std::vector<CBlockIndex*> > chunk(new std::vector<CBlockIndex*>());
+        chunk->reserve(nEnd - nStart);
+        for (int nHeightIn = nStart; nHeightIn < nEnd; nHeightIn++)
+            chunk->push_back(chain[nHeightIn]);
+        vChunks.push_back(chunk);
+    }
+}
+
 uint256 CBlockIndex::GetBlockTrust() const
 {
     uint256 bnTarget;
@@ -14,6 +14,7 @@
 #include "uint256.h"
 #include "util.h"
 
+#include <memory>
 #include <vector>
 
 #include <boost/lexical_cast.hpp>
@@ -119,9 +120,6 @@ public:
     //! pointer to the index of some further predecessor of this block
     CBlockIndex* pskip;
 
-    //ppcoin: trust score of block chain
-    uint256 bnChainTrust;
-
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
@@ -160,11 +158,9 @@ public:
     uint256 GetBlockTrust() const;
     uint64_t nStakeModifier;             // hash modifier for proof-of-stake
     unsigned int nStakeModifierChecksum; // checksum of index; in-memeory only
-    COutPoint prevoutStake;
     unsigned int nStakeTime;
-    uint256 hashProofOfStake;
-    int64_t nMint;
-    int64_t nMoneySupply;
+    COutPoint prevoutStake;
+    int64_t nMoneySupply;               // the block's mint is the difference to pprev's
 
     //! block header
     int nVersion;
@@ -191,7 +187,6 @@ public:
         nStatus = 0;
         nSequenceId = 0;
 
-        nMint = 0;
         nMoneySupply = 0;
         nFlags = 0;
         nStakeModifier = 0;
@@ -222,13 +217,10 @@ public:
         nNonce = block.nNonce;
 
         //Proof of Stake
-        bnChainTrust = uint256();
-        nMint = 0;
         nMoneySupply = 0;
         nFlags = 0;
         nStakeModifier = 0;
         nStakeModifierChecksum = 0;
-        hashProofOfStake = uint256();
 
         if (block.IsProofOfStake()) {
             SetProofOfStake();
@@ -315,6 +307,14 @@ public:
         nFlags |= BLOCK_PROOF_OF_STAKE;
     }
 
+    //! Coins created by this block; zero until it was connected
+    int64_t GetMint() const
+    {
+        if (nMoneySupply == 0)
+            return 0;
+        return nMoneySupply - (pprev ? pprev->nMoneySupply : 0);
+    }
+
     unsigned int GetStakeEntropyBit() const
     {
         unsigned int nEntropyBit = ((GetBlockHash().Get64()) & 1);
@@ -396,16 +396,19 @@ class CDiskBlockIndex : public CBlockIndex
 public:
     uint256 hashPrev;
     uint256 hashNext;
+    int64_t nMint;
 
     CDiskBlockIndex()
     {
         hashPrev = uint256();
         hashNext = uint256();
+        nMint = 0;
     }
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex)
     {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256(0));
+        nMint = pindex->GetMint();
     }
 
     ADD_SERIALIZE_METHODS;
@@ -437,7 +440,6 @@ public:
         } else {
             const_cast<CDiskBlockIndex*>(this)->prevoutStake.SetNull();
             const_cast<CDiskBlockIndex*>(this)->nStakeTime = 0;
-            const_cast<CDiskBlockIndex*>(this)->hashProofOfStake = uint256();
         }
 
         // block header
@@ -474,6 +476,40 @@ public:
     }
 };
 
+/**
+ * Allocates block index entries in large contiguous chunks instead of one
+ * heap object each. This saves the allocator overhead of millions of small
+ * objects and keeps entries loaded in sequence next to each other in memory.
+ * Entries are never freed individually, only all at once by Clear().
+ */
+class CBlockIndexArena
+{
+private:
+    //! Entries per chunk
+    static const size_t CHUNK_SIZE = 4096;
+
+    std::vector<CBlockIndex*> vChunks;
+    //! Entries handed out from the last chunk
+    size_t nChunkUsed;
+
+    void* AllocateRaw();
+
+public:
+    CBlockIndexArena() : nChunkUsed(CHUNK_SIZE) {}
+    ~CBlockIndexArena() { Clear(); }
+
+    CBlockIndex* Allocate();
+    CBlockIndex* Allocate(const CBlock& block);
+
+    //! Destroy all entries; every pointer handed out becomes invalid
+    void Clear();
+
+    //! Number of entries handed out
+    size_t size() const;
+    //! Bytes reserved by the chunks
+    size_t DynamicMemoryUsage() const;
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain
 {
@@ -555,4 +591,47 @@ public:
     const CBlockIndex* FindFork(const CBlockIndex* pindex) const;
 };
 
+/**
+ * Immutable copy of a CChain, so that readers can walk the active chain
+ * without holding cs_main. A snapshot made from its predecessor shares all
+ * chunks of the height index below the fork point and only copies the rest,
+ * which keeps publishing one per tip change cheap.
+ */
+class CChainSnapshot
+{
+private:
+    static const int CHUNK_SIZE = 1024;
+
+    std::vector<std::shared_ptr<const std::vector<CBlockIndex*> > > vChunks;
+    int nHeight;
+
+public:
+    CChainSnapshot() : nHeight(-1) {}
+    CChainSnapshot(const CChainSnapshot& prev, const CChain& chain);
+
+    /** Returns the index entry at a particular height in this chain, or NULL if no such height exists. */
+    CBlockIndex* operator[](int nHeightIn) const
+    {
+        if (nHeightIn < 0 || nHeightIn > nHeight)
+            return NULL;
+        return (*vChunks[nHeightIn / CHUNK_SIZE])[nHeightIn % CHUNK_SIZE];
+    }
+
+    CBlockIndex* Tip() const { return (*this)[nHeight]; }
+    int Height() const { return nHeight; }
+
+    bool Contains(const CBlockIndex* pindex) const
+    {
+        return (*this)[pindex->nHeight] == pindex;
+    }
+
+    CBlockIndex* Next(const CBlockIndex* pindex) const
+    {
+        if (Contains(pindex))
+            return (*this)[pindex->nHeight + 1];
+        else
+            return NULL;
+    }
+};
+
 #endif // BITCOIN_CHAIN_H
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,27 @@ public:
     CSHA256& Reset();
 };
 
+/** Autodetect the best available SHA256 implementation.
+ *  Returns the name of the implementation.
+ */
+std::string SHA256AutoDetect();
+
+/** Compute multiple double-SHA256's of 64-byte blobs.
+ *  output:  pointer to a blocks*32 byte output buffer
+ *  input:   pointer to a blocks*64 byte input buffer
+ *  blocks:  the number of hashes to compute.
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
+/** Compute multiple double-SHA256's of messages of at most 55 bytes, which
+ *  fit a single 64-byte block together with their padding.
+ *  output:  pointer to a blocks*32 byte output buffer
+ *  input:   pointer to a blocks*64 byte buffer of blocks padded with SHA256Pad1Block
+ *  blocks:  the number of hashes to compute.
+ */
+void SHA256D1Block(unsigned char* output, const unsigned char* input, size_t blocks);
+
+/** Append the SHA-256 padding to a len byte message at the start of a 64-byte block. */
+void SHA256Pad1Block(unsigned char* block, size_t len);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
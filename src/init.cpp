@@ -15,11 +15,14 @@
 #include "activemasternode.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockcache.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
+#include "crypto/sha256.h"
 #include "key.h"
 #include "main.h"
 #include "masternode-payments.h"
+#include "masternode-sigcheck.h"
 #include "masternodeconfig.h"
 #include "masternodeman.h"
 #include "miner.h"
@@ -254,6 +257,7 @@ void Shutdown()
     pwalletMain = NULL;
 #endif
     LogPrintf("%s: done\n", __func__);
+    StopDebugLogThread();
 }
 
 /**
@@ -316,16 +320,20 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "esbcoind.pid"));
 #endif
+    strUsage += HelpMessageOpt("-rawcachesize=<n>", strprintf(_("Keep recently served blocks and transactions in <n> megabytes of memory, 0 to disable (default: %u)"), DEFAULT_RAW_CACHE_SIZE));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-reindexthreads=<n>", strprintf(_("Set the number of block parsing threads used by -reindex and -loadblock (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_REINDEX_THREADS, DEFAULT_REINDEX_THREADS));
     strUsage += HelpMessageOpt("-resync", _("Delete blockchain folders and resync from scratch") + " " + _("on startup"));
 #if !defined(WIN32)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain an index of transactions and unspent outputs by address, used by the getaddress* rpc calls (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 0));
     strUsage += HelpMessageOpt("-forcestart", _("Attempt to force blockchain corruption recovery") + " " + _("on startup"));
 
@@ -374,6 +382,7 @@ std::string HelpMessage(HelpMessageMode mode)
             FormatMoney(CWallet::minTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in esbcoin/kB) to add to transactions you send (default: %s)"), FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Set the number of block matching threads used by wallet rescans (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_RESCAN_THREADS, DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet.dat") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), 0));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), 1));
@@ -427,10 +436,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-help-debug", _("Show all debugging options (usage: --help -help-debug)"));
     strUsage += HelpMessageOpt("-logips", strprintf(_("Include IP addresses in debug output (default: %u)"), 0));
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(_("Prepend debug output with timestamp (default: %u)"), 1));
+    strUsage += HelpMessageOpt("-logqueuesize=<n>", strprintf(_("Queue up to <n> debug.log messages for a background thread to write, 0 to write them directly (default: %u)"), DEFAULT_LOG_QUEUE_SIZE));
     if (GetBoolArg("-help-debug", false)) {
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf(_("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default:%u)"), 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf(_("Require high priority for relaying free or low-fee transactions (default:%u)"), 1));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit size of signature cache to <n> entries (default: %u)"), 50000));
+        strUsage += HelpMessageOpt("-sigcachesize=<n>", strprintf(_("Limit size of signature cache to <n> MiB (default: %u)"), DEFAULT_SIG_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in esbcoin/Kb) smaller than this are considered zero fee for relaying (default: %s)"), FormatMoney(::minRelayTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-printtoconsole", strprintf(_("Send trace/debug info to console instead of debug.log file (default: %u)"), 0));
@@ -461,6 +471,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-mnconflock=<n>", strprintf(_("Lock masternodes from masternode configuration file (default: %u)"), 1));
     strUsage += HelpMessageOpt("-masternodeprivkey=<n>", _("Set the masternode private key"));
     strUsage += HelpMessageOpt("-masternodeaddr=<n>", strprintf(_("Set external address:port to get to this masternode (example: %s)"), "128.127.106.235:32322"));
+    strUsage += HelpMessageOpt("-mnsigcheckthreads=<n>", strprintf(_("Set the number of threads checking masternode and SwiftX message signatures ahead of processing (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_MNSIGCHECK_THREADS, DEFAULT_MNSIGCHECK_THREADS));
 
     strUsage += HelpMessageGroup(_("Obfuscation options:"));
     strUsage += HelpMessageOpt("-enableobfuscation=<n>", strprintf(_("Enable use of automated obfuscation for funds stored in this wallet (0-1, default: %u)"), 0));
@@ -493,6 +504,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), 32321, 42321));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), 4));
+    strUsage += HelpMessageOpt("-rpcbatchthreads=<n>", strprintf(_("Set the number of threads running the requests of a JSON-RPC batch in parallel (0 to %d, 0 = one after another, default: %d)"), MAX_RPC_BATCH_THREADS, DEFAULT_RPC_BATCH_THREADS));
     strUsage += HelpMessageOpt("-rpckeepalive", strprintf(_("RPC support for HTTP persistent connections (default: %d)"), 1));
 
     strUsage += HelpMessageGroup(_("RPC SSL options: (see the Bitcoin Wiki for SSL setup instructions)"));
@@ -794,6 +806,16 @@ bool AppInit2(boost::thread_group& threadGroup)
     if (GetBoolArg("-benchmark", false))
         InitWarning(_("Warning: Unsupported argument -benchmark ignored, use -debug=bench."));
 
+    // -maxsigcachesize counted signature cache entries, -sigcachesize is in MiB
+    if (mapArgs.count("-maxsigcachesize")) {
+        int64_t nEntries = std::max((int64_t)0, std::min(GetArg("-maxsigcachesize", 0), (MAX_SIG_CACHE_SIZE << 20) / SIG_CACHE_ENTRY_SIZE));
+        int64_t nSigCacheSize = (nEntries * SIG_CACHE_ENTRY_SIZE + (1 << 20) - 1) >> 20;
+        if (SoftSetArg("-sigcachesize", strprintf("%d", nSigCacheSize)))
+            InitWarning(strprintf(_("Warning: Deprecated argument -maxsigcachesize=%d (entries) read as -sigcachesize=%d (MiB)."), nEntries, nSigCacheSize));
+        else
+            InitWarning(_("Warning: Deprecated argument -maxsigcachesize ignored, use -sigcachesize."));
+    }
+
     // Checkmempool and checkblockindex default to true in regtest mode
     mempool.setSanityCheck(GetBoolArg("-checkmempool", Params().DefaultConsistencyChecks()));
     fCheckBlockIndex = GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
@@ -808,6 +830,24 @@ bool AppInit2(boost::thread_group& threadGroup)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // the connect stage runs on the import thread itself, so leave one core for it
+    nReindexThreads = GetArg("-reindexthreads", DEFAULT_REINDEX_THREADS);
+    if (nReindexThreads <= 0)
+        nReindexThreads += boost::thread::hardware_concurrency() - 1;
+    if (nReindexThreads < 1)
+        nReindexThreads = 1;
+    else if (nReindexThreads > MAX_REINDEX_THREADS)
+        nReindexThreads = MAX_REINDEX_THREADS;
+
+    // the message handler keeps verifying inline, so no workers is a valid setting
+    nMnSigCheckThreads = GetArg("-mnsigcheckthreads", DEFAULT_MNSIGCHECK_THREADS);
+    if (nMnSigCheckThreads <= 0)
+        nMnSigCheckThreads += boost::thread::hardware_concurrency() - 1;
+    if (nMnSigCheckThreads < 0)
+        nMnSigCheckThreads = 0;
+    else if (nMnSigCheckThreads > MAX_MNSIGCHECK_THREADS)
+        nMnSigCheckThreads = MAX_MNSIGCHECK_THREADS;
+
     fServer = GetBoolArg("-server", false);
     setvbuf(stdout, NULL, _IOLBF, 0); /// ***TODO*** do we still need this after -printtoconsole is gone?
 
@@ -876,6 +916,14 @@ bool AppInit2(boost::thread_group& threadGroup)
     bSpendZeroConfChange = GetArg("-spendzeroconfchange", true);
     fSendFreeTransactions = GetArg("-sendfreetransactions", false);
 
+    nRescanThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+    if (nRescanThreads <= 0)
+        nRescanThreads += boost::thread::hardware_concurrency();
+    if (nRescanThreads < 1)
+        nRescanThreads = 1;
+    else if (nRescanThreads > MAX_RESCAN_THREADS)
+        nRescanThreads = MAX_RESCAN_THREADS;
+
     std::string strWalletFile = GetArg("-wallet", "wallet.dat");
 #endif // ENABLE_WALLET
 
@@ -891,6 +939,8 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
 
+    std::string sha256_algo = SHA256AutoDetect();
+
     // Sanity check
     if (!InitSanityCheck())
         return InitError(_("Initialization sanity check failed. ESBC is shutting down."));
@@ -916,9 +966,11 @@ bool AppInit2(boost::thread_group& threadGroup)
 #endif
     if (GetBoolArg("-shrinkdebugfile", !fDebug))
         ShrinkDebugFile();
+    StartDebugLogThread(std::max(GetArg("-logqueuesize", DEFAULT_LOG_QUEUE_SIZE), (int64_t)0));
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("esbcoin version %s (%s)\n", FormatFullVersion(), CLIENT_DATE);
     LogPrintf("Using OpenSSL version %s\n", SSLeay_version(SSLEAY_VERSION));
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
 #ifdef ENABLE_WALLET
     LogPrintf("Using BerkeleyDB version %s\n", DbEnv::version(0, 0, 0));
 #endif
@@ -931,11 +983,16 @@ bool AppInit2(boost::thread_group& threadGroup)
     std::ostringstream strErrors;
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    LogPrintf("Using %u threads for block import parsing\n", nReindexThreads);
     if (nScriptCheckThreads) {
         for (int i = 0; i < nScriptCheckThreads - 1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    LogPrintf("Using %u threads for masternode signature checks\n", nMnSigCheckThreads);
+    for (int i = 0; i < nMnSigCheckThreads; i++)
+        threadGroup.create_thread(&ThreadMasternodeSigCheck);
+
     if (mapArgs.count("-sporkkey")) // spork priv key
     {
         if (!sporkManager.SetPrivKey(GetArg("-sporkkey", "")))
@@ -1276,9 +1333,15 @@ bool AppInit2(boost::thread_group& threadGroup)
     nTotalCache -= nBlockTreeDBCache;
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
     nTotalCache -= nCoinDBCache;
-    nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
+    nCoinCacheUsage = nTotalCache; // the rest goes to the in-memory coins cache
     LogPrintf("Db Cache Size = %u\n", nDefaultDbCache);
-    LogPrintf("Coin Cache Size = %u\n", nCoinCacheSize);
+    LogPrintf("Coin Cache Size = %.1fMiB\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
+
+    // a quarter of the raw cache for transactions, the rest for blocks
+    int64_t nRawCache = std::max(GetArg("-rawcachesize", DEFAULT_RAW_CACHE_SIZE), (int64_t)0) << 20;
+    rawTxCache.SetMaxBytes(nRawCache / 4);
+    rawBlockCache.SetMaxBytes(nRawCache - nRawCache / 4);
+    LogPrintf("Raw Block/Tx Cache Size = %.1fMiB\n", nRawCache * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
     while (!fLoaded && !ShutdownRequested()) {
@@ -1301,6 +1364,13 @@ bool AppInit2(boost::thread_group& threadGroup)
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
 
+                // Convert coin databases written by older versions (stops early on shutdown)
+                if (!pcoinsdbview->Upgrade()) {
+                    strLoadError = _("Error upgrading chainstate database");
+                    break;
+                }
+                if (ShutdownRequested()) break;
+
                 if (fReindex)
                     pblocktree->WriteReindexing(true);
 
@@ -1332,6 +1402,12 @@ bool AppInit2(boost::thread_group& threadGroup)
                     break;
                 }
 
+                // Check for changed -addressindex state
+                if (fAddressIndex != GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -addressindex");
+                    break;
+                }
+
                 if (!fReindex) {
                     uiInterface.InitMessage(_("Verifying blocks..."));
                     {
@@ -1555,6 +1631,11 @@ bool AppInit2(boost::thread_group& threadGroup)
             LogPrintf("file format is unknown or invalid, please fix it manually\n");
     }
 
+    {
+        LOCK(cs_main);
+        masternodePayments.LoadLastPaidIndex(chainActive.Tip(), int(mnodeman.size() * 1.25));
+    }
+
     fMasterNode = GetBoolArg("-masternode", false);
 
     if ((fMasterNode || masternodeConfig.getCount() > -1) && fTxIndex == false) {
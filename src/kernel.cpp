@@ -8,10 +8,12 @@
 #include <boost/assign/list_of.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "db.h"
 #include "kernel.h"
+#include "lrumap.h"
 #include "spork.h"
-#include "script/interpreter.h"
 #include "timedata.h"
 #include "util.h"
 
@@ -242,6 +244,79 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     return true;
 }
 
+CStakeModifierIndex stakeModifierIndex;
+
+void CStakeModifierIndex::SetTip(const CBlockIndex* pindexNew)
+{
+    LOCK(cs);
+    if (pindexNew == pindexTip)
+        return;
+    if (!pindexNew) {
+        vGenerated.clear();
+        vMaxTime.clear();
+        pindexTip = NULL;
+        return;
+    }
+
+    // Find the fork point with the chain indexed so far
+    const CBlockIndex* pindexFork = pindexTip;
+    if (pindexFork && pindexFork->nHeight > pindexNew->nHeight)
+        pindexFork = pindexFork->GetAncestor(pindexNew->nHeight);
+    while (pindexFork && pindexNew->GetAncestor(pindexFork->nHeight) != pindexFork)
+        pindexFork = pindexFork->pprev;
+
+    int nForkHeight = pindexFork ? pindexFork->nHeight : -1;
+    while (!vGenerated.empty() && vGenerated.back()->nHeight > nForkHeight) {
+        vGenerated.pop_back();
+        vMaxTime.pop_back();
+    }
+
+    std::vector<const CBlockIndex*> vConnect;
+    for (const CBlockIndex* pindex = pindexNew; pindex && pindex->nHeight > nForkHeight; pindex = pindex->pprev) {
+        if (pindex->GeneratedStakeModifier())
+            vConnect.push_back(pindex);
+    }
+    for (std::vector<const CBlockIndex*>::reverse_iterator it = vConnect.rbegin(); it != vConnect.rend(); ++it) {
+        vMaxTime.push_back(std::max(vMaxTime.empty() ? (*it)->GetBlockTime() : vMaxTime.back(), (*it)->GetBlockTime()));
+        vGenerated.push_back(*it);
+    }
+    pindexTip = pindexNew;
+}
+
+static bool CompareHeight(const CBlockIndex* pindex, int nHeight)
+{
+    return pindex->nHeight <= nHeight;
+}
+
+const CBlockIndex* CStakeModifierIndex::Find(int nHeightFrom, int64_t nTime) const
+{
+    LOCK(cs);
+    // first generated block above nHeightFrom
+    size_t nStart = std::lower_bound(vGenerated.begin(), vGenerated.end(), nHeightFrom, CompareHeight) - vGenerated.begin();
+    if (nStart == vGenerated.size())
+        return NULL;
+
+    if (nStart == 0 || vMaxTime[nStart - 1] < nTime) {
+        // nothing before nStart reaches nTime, so the running maximum
+        // first reaches it at the first block from nStart that does
+        size_t n = std::lower_bound(vMaxTime.begin() + nStart, vMaxTime.end(), nTime) - vMaxTime.begin();
+        return n < vGenerated.size() ? vGenerated[n] : NULL;
+    }
+
+    // an earlier block is timestamped past nTime: scan forward
+    for (size_t n = nStart; n < vGenerated.size(); n++) {
+        if (vGenerated[n]->GetBlockTime() >= nTime)
+            return vGenerated[n];
+    }
+    return NULL;
+}
+
+size_t CStakeModifierIndex::size() const
+{
+    LOCK(cs);
+    return vGenerated.size();
+}
+
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
 bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake, int64_t nTime)
@@ -256,21 +331,16 @@ bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int
     if (ActiveProtocol() >= CONSENSUS_FORK_PROTO && nTime >= CONSENSUS_FORK_PROTO_TIME)
         nStakeModifierSelectionInterval = nStakeMinAge * 3 / 4;
     const CBlockIndex* pindex = pindexFrom;
-    CBlockIndex* pindexNext = chainActive[pindexFrom->nHeight + 1];
 
-    // loop to find the stake modifier later by a selection interval
-    while (nStakeModifierTime < pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval) {
-        if (!pindexNext) {
+    // the first modifier of the active chain generated a selection interval later
+    if (nStakeModifierTime < pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval) {
+        pindex = stakeModifierIndex.Find(pindexFrom->nHeight, pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval);
+        if (!pindex) {
             // Should never happen
             return error("Null pindexNext\n");
         }
-
-        pindex = pindexNext;
-        pindexNext = chainActive[pindexNext->nHeight + 1];
-        if (pindex->GeneratedStakeModifier()) {
-            nStakeModifierHeight = pindex->nHeight;
-            nStakeModifierTime = pindex->GetBlockTime();
-        }
+        nStakeModifierHeight = pindex->nHeight;
+        nStakeModifierTime = pindex->GetBlockTime();
     }
     nStakeModifier = pindex->nStakeModifier;
     return true;
@@ -294,11 +364,67 @@ bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTarget
     return (uint256(hashProofOfStake) < bnCoinDayWeight * bnTargetPerCoinDay);
 }
 
+CStakeKernelHasher::CStakeKernelHasher(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, const COutPoint& prevout, CAmount nValueIn, const uint256& bnTargetPerCoinDay)
+{
+    // the stakeHash() preimage up to the timestamp
+    CDataStream ss(SER_GETHASH, 0);
+    ss << nStakeModifier << nTimeBlockFrom << prevout.n << prevout.hash;
+    assert(ss.size() == TIME_OFFSET);
+    memcpy(block, &ss[0], TIME_OFFSET);
+    WriteLE32(block + TIME_OFFSET, 0);
+    SHA256Pad1Block(block, TIME_OFFSET + 4);
+
+    // stakeTargetHit(): the stake weight is the coin amount
+    bnTarget = uint256(nValueIn) / 100 * bnTargetPerCoinDay;
+}
+
+const unsigned int CStakeKernelHasher::SEARCH_BATCH;
+
+bool CStakeKernelHasher::Search(unsigned int nTimeTx, unsigned int nHashDrift, unsigned int& nTimeRet, uint256& hashProofOfStake, int nHeightStart) const
+{
+    unsigned char vchBlocks[64 * SEARCH_BATCH];
+    unsigned char vchHashes[32 * SEARCH_BATCH];
+    for (unsigned int i = 0; i < nHashDrift; i += SEARCH_BATCH) {
+        //new block came in, move on
+        if (nHeightStart != -1 && chainActive.Height() != nHeightStart)
+            return false;
+
+        unsigned int nBatch = nHashDrift - i < SEARCH_BATCH ? nHashDrift - i : SEARCH_BATCH;
+        for (unsigned int j = 0; j < nBatch; j++) {
+            memcpy(vchBlocks + 64 * j, block, 64);
+            WriteLE32(vchBlocks + 64 * j + TIME_OFFSET, nTimeTx + nHashDrift - i - j);
+        }
+        SHA256D1Block(vchHashes, vchBlocks, nBatch);
+
+        for (unsigned int j = 0; j < nBatch; j++) {
+            uint256 hash;
+            memcpy(hash.begin(), vchHashes + 32 * j, 32);
+            if (hash < bnTarget) {
+                nTimeRet = nTimeTx + nHashDrift - i - j;
+                hashProofOfStake = hash;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 //instead of looping outside and reinitializing variables many times, we will give a nTimeTx and also search interval so that we can do all the hashing here
 bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake)
 {
     //assign new variables to make it easier to read
     int64_t nValueIn = txPrev.vout[prevout.n].nValue;
+
+    uint256 hashBlockFrom = blockFrom.GetHash();
+
+    //if wallet is simply checking to make sure a hash is valid
+    if (fCheck) {
+        BlockMap::iterator it = mapBlockIndex.find(hashBlockFrom);
+        if (it == mapBlockIndex.end())
+            return error("CheckStakeKernelHash() : block not indexed");
+        return CheckStakeKernelHash(nBits, it->second, nValueIn, prevout, nTimeTx, hashProofOfStake);
+    }
+
     unsigned int nTimeBlockFrom = blockFrom.GetBlockTime();
 
     if (nTimeTx < nTimeBlockFrom) // Transaction timestamp violation
@@ -315,47 +441,22 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
     uint64_t nStakeModifier = 0;
     int nStakeModifierHeight = 0;
     int64_t nStakeModifierTime = 0;
-    if (!GetKernelStakeModifier(blockFrom.GetHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake, nTimeTx)) {
+    if (!GetKernelStakeModifier(hashBlockFrom, nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake, nTimeTx)) {
         LogPrintf("CheckStakeKernelHash(): failed to get kernel stake modifier \n");
         return false;
     }
 
-    //create data stream once instead of repeating it in the loop
-    CDataStream ss(SER_GETHASH, 0);
-    ss << nStakeModifier;
-
-    //if wallet is simply checking to make sure a hash is valid
-    if (fCheck) {
-        hashProofOfStake = stakeHash(nTimeTx, ss, prevout.n, prevout.hash, nTimeBlockFrom);
-        return stakeTargetHit(hashProofOfStake, nValueIn, bnTargetPerCoinDay);
-    }
-
-    bool fSuccess = false;
     unsigned int nTryTime = 0;
-    unsigned int i;
-    int nHeightStart = chainActive.Height();
-    for (i = 0; i < (nHashDrift); i++) //iterate the hashing
-    {
-        //new block came in, move on
-        if (chainActive.Height() != nHeightStart)
-            break;
-
-        //hash this iteration
-        nTryTime = nTimeTx + nHashDrift - i;
-        hashProofOfStake = stakeHash(nTryTime, ss, prevout.n, prevout.hash, nTimeBlockFrom);
-
-        // if stake hash does not meet the target then continue to next iteration
-        if (!stakeTargetHit(hashProofOfStake, nValueIn, bnTargetPerCoinDay))
-            continue;
-
-        fSuccess = true; // if we make it this far then we have successfully created a stake hash
+    CStakeKernelHasher hasher(nStakeModifier, nTimeBlockFrom, prevout, nValueIn, bnTargetPerCoinDay);
+    bool fSuccess = hasher.Search(nTimeTx, nHashDrift, nTryTime, hashProofOfStake, chainActive.Height());
+    if (fSuccess) {
         nTimeTx = nTryTime;
 
         if (fDebug || fPrintProofOfStake) {
             LogPrintf("CheckStakeKernelHash() : using modifier %s at height=%d timestamp=%s for block from height=%d timestamp=%s\n",
                 boost::lexical_cast<std::string>(nStakeModifier).c_str(), nStakeModifierHeight,
                 DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nStakeModifierTime).c_str(),
-                mapBlockIndex[blockFrom.GetHash()]->nHeight,
+                mapBlockIndex[hashBlockFrom]->nHeight,
                 DateTimeStrFormat("%Y-%m-%d %H:%M:%S", blockFrom.GetBlockTime()).c_str());
             LogPrintf("CheckStakeKernelHash() : pass protocol=%s modifier=%s nTimeBlockFrom=%u prevoutHash=%s nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
                 "0.3",
@@ -363,7 +464,6 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
                 nTimeBlockFrom, prevout.hash.ToString().c_str(), nTimeBlockFrom, prevout.n, nTryTime,
                 hashProofOfStake.ToString().c_str());
         }
-        break;
     }
 
     mapHashedBlocks.clear();
@@ -371,51 +471,157 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
     return fSuccess;
 }
 
+bool GetStakeKernelInput(const COutPoint& prevout, CAmount nValue, const uint256& hashBlockFrom, unsigned int nTimeTx, CStakeKernelInput& input)
+{
+    BlockMap::iterator it = mapBlockIndex.find(hashBlockFrom);
+    if (it == mapBlockIndex.end())
+        return false;
+
+    int nStakeModifierHeight = 0;
+    int64_t nStakeModifierTime = 0;
+    if (!GetKernelStakeModifier(hashBlockFrom, input.nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false, nTimeTx))
+        return false;
+
+    input.prevout = prevout;
+    input.nValue = nValue;
+    input.nTimeBlockFrom = it->second->GetBlockTime();
+    return true;
+}
+
+bool FindStakeKernel(const std::vector<CStakeKernelInput>& vInputs, unsigned int nBits, unsigned int& nTimeTx, unsigned int nHashDrift, unsigned int nMinTime, size_t& nKernelRet, uint256& hashProofOfStake, int nHeightStart)
+{
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+
+    for (size_t nKernel = 0; nKernel < vInputs.size(); nKernel++) {
+        const CStakeKernelInput& input = vInputs[nKernel];
+        if (nTimeTx < input.nTimeBlockFrom || input.nTimeBlockFrom + nStakeMinAge > nTimeTx)
+            continue;
+
+        unsigned int nTryTime = 0;
+        CStakeKernelHasher hasher(input.nStakeModifier, input.nTimeBlockFrom, input.prevout, input.nValue, bnTargetPerCoinDay);
+        if (!hasher.Search(nTimeTx, nHashDrift, nTryTime, hashProofOfStake, nHeightStart)) {
+            if (nHeightStart != -1 && chainActive.Height() != nHeightStart)
+                return false;
+            continue;
+        }
+
+        // the first hit of an input is its latest timestamp; too early means no usable hit
+        if (nTryTime <= nMinTime)
+            continue;
+
+        nKernelRet = nKernel;
+        nTimeTx = nTryTime;
+        return true;
+    }
+    return false;
+}
+
+bool CheckStakeKernelHash(unsigned int nBits, const CBlockIndex* pindexFrom, CAmount nValueIn, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake)
+{
+    unsigned int nTimeBlockFrom = pindexFrom->GetBlockTime();
+
+    if (nTimeTx < nTimeBlockFrom) // Transaction timestamp violation
+        return error("CheckStakeKernelHash() : nTime violation");
+
+    if (nTimeBlockFrom + nStakeMinAge > nTimeTx) // Min age requirement
+        return false;
+
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+
+    uint64_t nStakeModifier = 0;
+    int nStakeModifierHeight = 0;
+    int64_t nStakeModifierTime = 0;
+    if (!GetKernelStakeModifier(pindexFrom->GetBlockHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false, nTimeTx)) {
+        LogPrintf("CheckStakeKernelHash(): failed to get kernel stake modifier \n");
+        return false;
+    }
+
+    CDataStream ss(SER_GETHASH, 0);
+    ss << nStakeModifier;
+    hashProofOfStake = stakeHash(nTimeTx, ss, prevout.n, prevout.hash, nTimeBlockFrom);
+    return stakeTargetHit(hashProofOfStake, nValueIn, bnTargetPerCoinDay);
+}
+
+//! Proofs of stake already checked, by block hash
+static const unsigned int PROOF_OF_STAKE_CACHE_SIZE = 1000;
+static lrumap<uint256, uint256> cacheProofOfStake(PROOF_OF_STAKE_CACHE_SIZE);
+static CCriticalSection cs_cacheProofOfStake;
+
+// The output a coinstake kernel spends and the block it was confirmed in
+static bool GetKernelOutput(const CBlock& block, const COutPoint& prevout, CTxOut& txoutRet, const CBlockIndex*& pindexFromRet)
+{
+    AssertLockHeld(cs_main);
+
+    // Still unspent at the tip: take it from the coins view, as long as the
+    // block it was confirmed in is also an ancestor of the staked block
+    const CCoins* coins = pcoinsTip->AccessCoins(prevout.hash);
+    BlockMap::iterator mi = mapBlockIndex.find(block.hashPrevBlock);
+    if (coins && coins->IsAvailable(prevout.n) && mi != mapBlockIndex.end()) {
+        const CBlockIndex* pindexFrom = chainActive[coins->nHeight];
+        if (pindexFrom && mi->second->GetAncestor(coins->nHeight) == pindexFrom) {
+            txoutRet = coins->vout[prevout.n];
+            pindexFromRet = pindexFrom;
+            return true;
+        }
+    }
+
+    // Spent at the tip or confirmed on another branch: find the transaction
+    uint256 hashBlock;
+    CTransaction txPrev;
+    if (!GetTransaction(prevout.hash, txPrev, hashBlock, true))
+        return error("CheckProofOfStake() : INFO: read txPrev failed");
+    if (prevout.n >= txPrev.vout.size())
+        return error("CheckProofOfStake() : kernel output %s does not exist", prevout.ToString());
+
+    BlockMap::iterator it = mapBlockIndex.find(hashBlock);
+    if (it == mapBlockIndex.end())
+        return error("CheckProofOfStake() : read block failed");
+
+    txoutRet = txPrev.vout[prevout.n];
+    pindexFromRet = it->second;
+    return true;
+}
+
 // Check kernel hash target and coinstake signature
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
+bool CheckProofOfStake(const CBlock& block, const uint256& hashBlock, uint256& hashProofOfStake)
 {
     const CTransaction tx = block.vtx[1];
     if (!tx.IsCoinStake())
         return error("CheckProofOfStake() : called on non-coinstake %s", tx.GetHash().ToString().c_str());
+    {
+        LOCK(cs_cacheProofOfStake);
+        if (cacheProofOfStake.get(hashBlock, hashProofOfStake))
+            return true;
+    }
 
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
     const CTxIn& txin = tx.vin[0];
 
-    // First try finding the previous transaction in database
-    uint256 hashBlock;
-    CTransaction txPrev;
-    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
-        return error("CheckProofOfStake() : INFO: read txPrev failed");
+    CTxOut txoutPrev;
+    const CBlockIndex* pindexFrom = NULL;
+    if (!GetKernelOutput(block, txin.prevout, txoutPrev, pindexFrom))
+        return false;
 
-    //verify signature and script
-    if (!VerifyScript(txin.scriptSig, txPrev.vout[txin.prevout.n].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
+    // ConnectBlock skips script checks below the last checkpoint, so the kernel signature is verified here
+    if (!VerifyScript(txin.scriptSig, txoutPrev.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
         return error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString().c_str());
 
-    CBlockIndex* pindex = NULL;
-    BlockMap::iterator it = mapBlockIndex.find(hashBlock);
-    if (it != mapBlockIndex.end())
-        pindex = it->second;
-    else
-        return error("CheckProofOfStake() : read block failed");
-
-    // Read block header
-    CBlock blockprev;
-    if (!ReadBlockFromDisk(blockprev, pindex->GetBlockPos()))
-        return error("CheckProofOfStake(): INFO: failed to find block");
-
     unsigned int nTime = block.nTime;
     if (ActiveProtocol() >= CONSENSUS_FORK_PROTO &&
         nTime >= CONSENSUS_FORK_PROTO_TIME &&
-        txPrev.vout[txin.prevout.n].nValue < Params().StakeInputMin())
+        txoutPrev.nValue < Params().StakeInputMin())
             return error("CheckProofOfStake(): stake input below minimal value");
 
     // skip check block (220056) with time 1554746413 > CheckStakeKernelHash error... need explore deeper
     if (nTime == 1554746413) return true;
 
-    unsigned int nInterval = 0;
-    if (!CheckStakeKernelHash(block.nBits, blockprev, txPrev, txin.prevout, nTime, nInterval, true, hashProofOfStake, fDebug))
+    if (!CheckStakeKernelHash(block.nBits, pindexFrom, txoutPrev.nValue, txin.prevout, nTime, hashProofOfStake))
         return error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s \n", tx.GetHash().ToString().c_str(), hashProofOfStake.ToString().c_str()); // may occur during initial download or if behind on block chain sync
 
+    LOCK(cs_cacheProofOfStake);
+    cacheProofOfStake.insert(hashBlock, hashProofOfStake);
     return true;
 }
 
@@ -427,14 +633,14 @@ bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx)
 }
 
 // Get stake modifier checksum
-unsigned int GetStakeModifierChecksum(const CBlockIndex* pindex)
+unsigned int GetStakeModifierChecksum(const CBlockIndex* pindex, const uint256& hashProofOfStake)
 {
     assert(pindex->pprev || pindex->GetBlockHash() == Params().HashGenesisBlock());
     // Hash previous checksum with flags, hashProofOfStake and nStakeModifier
     CDataStream ss(SER_GETHASH, 0);
     if (pindex->pprev)
         ss << pindex->pprev->nStakeModifierChecksum;
-    ss << pindex->nFlags << pindex->hashProofOfStake << pindex->nStakeModifier;
+    ss << pindex->nFlags << hashProofOfStake << pindex->nStakeModifier;
     uint256 hashChecksum = Hash(ss.begin(), ss.end());
     hashChecksum >>= (256 - 32);
     return hashChecksum.Get64();
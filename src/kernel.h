@@ -18,6 +18,36 @@ extern unsigned int getIntervalVersion(bool fTestNet);
 // ratio of group interval length between the last group and the first group
 static const int MODIFIER_INTERVAL_RATIO = 3;
 
+/**
+ * The blocks of the active chain that generated a stake modifier, in height
+ * order, so the modifier a kernel hashes with is found by binary search
+ * instead of walking the chain forward from the block the coin is from.
+ * Built when the block index is loaded and moved along with the tip.
+ */
+class CStakeModifierIndex
+{
+private:
+    mutable CCriticalSection cs;
+    //! Active chain blocks that generated a stake modifier, by height
+    std::vector<const CBlockIndex*> vGenerated;
+    //! vMaxTime[i] is the latest block time in vGenerated[0..i]
+    std::vector<int64_t> vMaxTime;
+    const CBlockIndex* pindexTip;
+
+public:
+    CStakeModifierIndex() : pindexTip(NULL) {}
+
+    //! Follow the active chain to pindexNew (NULL clears the index)
+    void SetTip(const CBlockIndex* pindexNew);
+
+    //! First block above nHeightFrom that generated a modifier with a block time of at least nTime, or NULL
+    const CBlockIndex* Find(int nHeightFrom, int64_t nTime) const;
+
+    size_t size() const;
+};
+
+extern CStakeModifierIndex stakeModifierIndex;
+
 // Compute the hash modifier for proof-of-stake
 bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier);
 
@@ -26,16 +56,71 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
 uint256 stakeHash(unsigned int nTimeTx, CDataStream ss, unsigned int prevoutIndex, uint256 prevoutHash, unsigned int nTimeBlockFrom);
 bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay);
 bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
+// Check the kernel of an output confirmed in pindexFrom at exactly nTimeTx
+bool CheckStakeKernelHash(unsigned int nBits, const CBlockIndex* pindexFrom, CAmount nValueIn, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake);
+
+/**
+ * Kernel hashing of one stake input for a range of timestamps. The preimage is
+ * serialized and padded once with only the timestamp left to fill in, and the
+ * timestamps are hashed in batches through the multi-buffer double SHA-256.
+ * Bit-exact with stakeHash() and stakeTargetHit().
+ */
+class CStakeKernelHasher
+{
+private:
+    //! offset of the timestamp in the kernel preimage
+    static const size_t TIME_OFFSET = 48;
+    //! timestamps hashed per SHA256D1Block call
+    static const unsigned int SEARCH_BATCH = 64;
+
+    unsigned char block[64];
+    uint256 bnTarget;
+
+public:
+    CStakeKernelHasher(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, const COutPoint& prevout, CAmount nValueIn, const uint256& bnTargetPerCoinDay);
+
+    //! Hash nTimeTx + nHashDrift down to nTimeTx + 1; sets nTimeRet and hashProofOfStake on the first hit.
+    //! Unless nHeightStart is -1, gives up between batches once the active chain is no longer at nHeightStart.
+    bool Search(unsigned int nTimeTx, unsigned int nHashDrift, unsigned int& nTimeRet, uint256& hashProofOfStake, int nHeightStart = -1) const;
+};
+
+/** Everything the kernel hash of one stakeable output depends on, resolved once
+ *  so the stake search needs neither the block index nor the wallet per hash */
+struct CStakeKernelInput {
+    COutPoint prevout;
+    CAmount nValue;
+    unsigned int nTimeBlockFrom;
+    uint64_t nStakeModifier;
+};
+
+/** Stake table of one staker (the stake miner thread, a setgenerate call) and when it was built.
+ *  Each caller of SearchStakeKernel keeps its own, so concurrent searches share nothing. */
+struct CStakeSearch {
+    std::vector<CStakeKernelInput> vStakeTable;
+    uint256 hashStakeTableTip;
+    int64_t nStakeTableTime;
+    int64_t nLastSearchTime;
+
+    CStakeSearch() : hashStakeTableTip(0), nStakeTableTime(0), nLastSearchTime(0) {}
+};
+
+// Resolve the kernel input of an output confirmed in hashBlockFrom, staked around nTimeTx
+bool GetStakeKernelInput(const COutPoint& prevout, CAmount nValue, const uint256& hashBlockFrom, unsigned int nTimeTx, CStakeKernelInput& input);
+
+// Search the timestamps (nTimeTx, nTimeTx + nHashDrift] of every input for a kernel meeting nBits
+// that is later than nMinTime. Sets nKernelRet, nTimeTx and hashProofOfStake on success return.
+// Unless nHeightStart is -1, gives up once a new block moves the active chain off nHeightStart
+bool FindStakeKernel(const std::vector<CStakeKernelInput>& vInputs, unsigned int nBits, unsigned int& nTimeTx, unsigned int nHashDrift, unsigned int nMinTime, size_t& nKernelRet, uint256& hashProofOfStake, int nHeightStart = -1);
 
-// Check kernel hash target and coinstake signature
+// Check kernel hash target of a block's coinstake
 // Sets hashProofOfStake on success return
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake);
+bool CheckProofOfStake(const CBlock& block, const uint256& hashBlock, uint256& hashProofOfStake);
 
 // Check whether the coinstake timestamp meets protocol
 bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx);
 
 // Get stake modifier checksum
-unsigned int GetStakeModifierChecksum(const CBlockIndex* pindex);
+unsigned int GetStakeModifierChecksum(const CBlockIndex* pindex, const uint256& hashProofOfStake);
 
 // Check stake modifier hard checkpoints
 bool CheckStakeModifierCheckpoints(int nHeight, unsigned int nStakeModifierChecksum);
@@ -0,0 +1,89 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_LRUMAP_H
+#define BITCOIN_LRUMAP_H
+
+#include <list>
+#include <map>
+#include <utility>
+
+/** STL-like map container that only keeps the N most recently used elements. */
+template <typename K, typename V>
+class lrumap
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<key_type, mapped_type> value_type;
+    typedef typename std::list<value_type>::size_type size_type;
+
+protected:
+    //! elements, most recently used first
+    std::list<value_type> list;
+    typedef typename std::list<value_type>::iterator list_iterator;
+    std::map<K, list_iterator> map;
+    size_type nMaxSize;
+
+public:
+    lrumap(size_type nMaxSizeIn = 0) { nMaxSize = nMaxSizeIn; }
+    size_type size() const { return list.size(); }
+    bool empty() const { return list.empty(); }
+    size_type count(const key_type& k) const { return map.count(k); }
+    void clear()
+    {
+        map.clear();
+        list.clear();
+    }
+    //! Look k up and mark it as most recently used
+    bool get(const key_type& k, mapped_type& v)
+    {
+        typename std::map<K, list_iterator>::iterator it = map.find(k);
+        if (it == map.end())
+            return false;
+        list.splice(list.begin(), list, it->second);
+        v = it->second->second;
+        return true;
+    }
+    //! Insert or replace k as the most recently used element, evicting the least recently used beyond the limit
+    void insert(const key_type& k, const mapped_type& v)
+    {
+        typename std::map<K, list_iterator>::iterator it = map.find(k);
+        if (it != map.end()) {
+            it->second->second = v;
+            list.splice(list.begin(), list, it->second);
+            return;
+        }
+        list.push_front(value_type(k, v));
+        map.insert(std::make_pair(k, list.begin()));
+        if (nMaxSize && list.size() > nMaxSize)
+            pop_back();
+    }
+    void erase(const key_type& k)
+    {
+        typename std::map<K, list_iterator>::iterator it = map.find(k);
+        if (it == map.end())
+            return;
+        list.erase(it->second);
+        map.erase(it);
+    }
+    //! The least recently used element; the map must not be empty
+    const value_type& back() const { return list.back(); }
+    //! Evict the least recently used element; the map must not be empty
+    void pop_back()
+    {
+        map.erase(list.back().first);
+        list.pop_back();
+    }
+    size_type max_size() const { return nMaxSize; }
+    size_type max_size(size_type s)
+    {
+        nMaxSize = s;
+        while (nMaxSize && list.size() > nMaxSize)
+            pop_back();
+        return nMaxSize;
+    }
+};
+
+#endif // BITCOIN_LRUMAP_H
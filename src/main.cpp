@@ -10,6 +10,7 @@
 
 #include "addrman.h"
 #include "alert.h"
+#include "blockimport.h"
 #include "gm.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -17,6 +18,7 @@
 #include "init.h"
 #include "kernel.h"
 #include "masternode-payments.h"
+#include "masternode-sigcheck.h"
 #include "masternodeman.h"
 #include "merkleblock.h"
 #include "net.h"
@@ -55,23 +57,30 @@ using namespace std;
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+//! Held with cs_main while mapBlockIndex changes, so LookupBlockIndex() needs only this one
+static CCriticalSection cs_mapBlockIndex;
+CBlockIndexArena blockIndexArena;
 map<uint256, uint256> mapProofOfStake;
 set<pair<COutPoint, unsigned int> > setStakeSeen;
 map<unsigned int, unsigned int> mapHashedBlocks;
 map<COutPoint, int> mapStakeSpent;
 CChain chainActive;
+static std::shared_ptr<const CChainSnapshot> pchainSnapshot(new CChainSnapshot());
+static CCriticalSection cs_chainSnapshot;
 CBlockIndex* pindexBestHeader = NULL;
 int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nReindexThreads = 1;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
+bool fAddressIndex = DEFAULT_ADDRESSINDEX;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
-unsigned int nCoinCacheSize = 5000;
+size_t nCoinCacheUsage = 5000 * 300;
 bool fAlerts = DEFAULT_ALERTS;
 bool fGM = DEFAULT_GM;
 
@@ -1040,33 +1049,46 @@ bool CheckTransaction(const CTransaction& tx, CValidationState& state, const int
     return true;
 }
 
+/**
+ * Resolve the prevout script and match it against the tx filter. Try the mempool and the tip first,
+ * and only then the tx index, which still finds outputs that are spent at the tip or were created
+ * on another branch.
+ */
+static bool IsFilteredPrevout(const COutPoint& prevout, const int64_t nBlockTime, CBitcoinAddress& addressRet)
+{
+    AssertLockHeld(cs_main);
+    {
+        LOCK(mempool.cs);
+        std::map<uint256, CTxMemPoolEntry>::const_iterator mi = mempool.mapTx.find(prevout.hash);
+        if (mi != mempool.mapTx.end()) {
+            const CTransaction& prevoutTx = mi->second.GetTx();
+            return prevout.n < prevoutTx.vout.size() && IsTxFilterScript(prevoutTx.vout[prevout.n].scriptPubKey, nBlockTime, addressRet);
+        }
+    }
+    const CCoins* coins = pcoinsTip->AccessCoins(prevout.hash);
+    if (coins && coins->IsAvailable(prevout.n))
+        return IsTxFilterScript(coins->vout[prevout.n].scriptPubKey, nBlockTime, addressRet);
+
+    CTransaction prevoutTx;
+    uint256 prevoutHashBlock;
+    if (!GetTransaction(prevout.hash, prevoutTx, prevoutHashBlock))
+        return false;
+    return prevout.n < prevoutTx.vout.size() && IsTxFilterScript(prevoutTx.vout[prevout.n].scriptPubKey, nBlockTime, addressRet);
+}
+
 bool CheckTxFilter(const CTransaction& tx, const int64_t nBlockTime)
 {
     if (nBlockTime != 0 && nBlockTime < GetAdjustedTime() - 24 * 60 * 60)
         return true;
     // Check if they are filtered spender in the current tx
-    if (!mapFilterAddress.empty()) {
-        CTransaction prevoutTx;
-        uint256 prevoutHashBlock;
-        txnouttype txType;
-        vector<CTxDestination> vDest;
+    if (!mapTxFilter.empty() && !tx.IsCoinBase()) {
+        LOCK(cs_main);
         CBitcoinAddress Address;
-        int nRequiredRet;
         for (const CTxIn& txin : tx.vin) {
-            if (!GetTransaction(txin.prevout.hash, prevoutTx, prevoutHashBlock))
-                continue;
-            if (!ExtractDestinations(prevoutTx.vout[txin.prevout.n].scriptPubKey, txType, vDest, nRequiredRet))
-                continue;
-            for (const CTxDestination& txDest : vDest) {
-                Address.Set(txDest);
-                auto it = mapFilterAddress.find(Address);
-                if (it != mapFilterAddress.end()) {
-                    if (nBlockTime == 0 || nBlockTime > (*it).second) {
-                        LogPrintf("CheckTxFilter(): Tx %s contains the filtered "
-                                  "address %s\n", tx.GetHash().ToString(), Address.ToString());
-                        return false;
-                    }
-                }
+            if (IsFilteredPrevout(txin.prevout, nBlockTime, Address)) {
+                LogPrintf("CheckTxFilter(): Tx %s contains the filtered "
+                          "address %s\n", tx.GetHash().ToString(), Address.ToString());
+                return false;
             }
         }
     }
@@ -1263,6 +1285,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                                         hash.ToString(), nFees, txMinFee),
                     REJECT_INSUFFICIENTFEE, "insufficient fee");
 
+            // Once the pool has been trimmed, transactions must pay more than what was evicted
+            CAmount mempoolRejectFee = pool.GetMinFee().GetFee(nSize);
+            if (fLimitFree && mempoolRejectFee > 0 && nFees < mempoolRejectFee)
+                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+
             // Require that free transactions have sufficient priority to be mined in the next block.
             if (GetBoolArg("-relaypriority", true) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(view.GetPriority(tx, chainActive.Height() + 1))) {
                 return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient priority");
@@ -1318,6 +1345,14 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
         // Store transaction in memory
         pool.addUnchecked(hash, entry);
+
+        // Evict the lowest fee rate packages if the pool grew too large
+        std::list<CTransaction> evicted;
+        pool.TrimToSize(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, evicted);
+        if (!evicted.empty())
+            LogPrint("mempool", "AcceptToMemoryPool : %u transactions evicted to make room for %s\n", evicted.size(), hash.ToString());
+        if (!pool.exists(hash))
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
     }
 
     SyncWithWallets(tx, NULL);
@@ -1521,14 +1556,27 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
 {
     CBlockIndex* pindexSlow = NULL;
     {
-        LOCK(cs_main);
-        {
-            if (mempool.lookup(hash, txOut)) {
-                return true;
-            }
+        // The mempool and the tx index have their own locks
+        if (mempool.lookup(hash, txOut)) {
+            return true;
         }
 
         if (fTxIndex) {
+            CRawDataRef data;
+            if (rawTxCache.Get(hash, data)) {
+                try {
+                    CDataStream ssTx((const char*)&data->vch[0], (const char*)&data->vch[0] + data->vch.size(), SER_DISK, CLIENT_VERSION);
+                    ssTx >> txOut;
+                } catch (std::exception& e) {
+                    return error("%s : Deserialize error - %s", __func__, e.what());
+                }
+                hashBlock = data->hashBlock;
+                return true;
+            }
+
+            // Taken before the read: without cs_main, ConnectBlock() or DisconnectTip() may
+            // erase the entry while this thread still holds the transaction with its old block
+            uint64_t nCacheGeneration = rawTxCache.GetGeneration(hash);
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
                 CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
@@ -1545,6 +1593,14 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
                 hashBlock = header.GetHash();
                 if (txOut.GetHash() != hash)
                     return error("%s : txid mismatch", __func__);
+
+                if (rawTxCache.IsEnabled()) {
+                    std::shared_ptr<CRawData> pdata(new CRawData(hashBlock));
+                    CDataStream ssTx(SER_DISK, CLIENT_VERSION);
+                    ssTx << txOut;
+                    pdata->vch.assign(ssTx.begin(), ssTx.end());
+                    rawTxCache.Insert(hash, pdata, nCacheGeneration);
+                }
                 return true;
             }
 
@@ -1553,6 +1609,7 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         }
 
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
+            LOCK(cs_main);
             int nHeight = -1;
             {
                 CCoinsViewCache& view = *pcoinsTip;
@@ -1644,6 +1701,79 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos)
+{
+    // Start at the message start and size that WriteBlockToDisk put in front of the block
+    if (pos.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("%s : invalid block position %u in file %d", __func__, pos.nPos, pos.nFile);
+    CDiskBlockPos posHeader(pos.nFile, pos.nPos - MESSAGE_START_SIZE - sizeof(unsigned int));
+
+    CAutoFile filein(OpenBlockFile(posHeader, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed", __func__);
+
+    try {
+        MessageStartChars pchMessageStart;
+        unsigned int nSize;
+        filein >> FLATDATA(pchMessageStart) >> nSize;
+        if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+            return error("%s : bad message start before position %u in file %d", __func__, pos.nPos, pos.nFile);
+        if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
+            return error("%s : bad block size %u at position %u in file %d", __func__, nSize, pos.nPos, pos.nFile);
+        vchBlock.resize(nSize);
+        filein.read((char*)&vchBlock[0], nSize);
+    } catch (std::exception& e) {
+        return error("%s : I/O error - %s", __func__, e.what());
+    }
+
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CBlockIndex* pindex)
+{
+    if (!ReadRawBlockFromDisk(vchBlock, pindex->GetBlockPos()))
+        return false;
+
+    // The header alone tells whether these are the bytes of the right block
+    CBlockHeader header;
+    try {
+        CDataStream ssHeader((const char*)&vchBlock[0], (const char*)&vchBlock[0] + 80, SER_DISK, CLIENT_VERSION);
+        ssHeader >> header;
+    } catch (std::exception& e) {
+        return error("%s : Deserialize error - %s", __func__, e.what());
+    }
+    if (header.GetHash() != pindex->GetBlockHash())
+        return error("%s : GetHash() doesn't match index for %s", __func__, pindex->GetBlockHash().ToString());
+    return true;
+}
+
+bool ReadRawBlockCached(CRawDataRef& data, const CBlockIndex* pindex)
+{
+    if (rawBlockCache.Get(pindex->GetBlockHash(), data))
+        return true;
+
+    std::shared_ptr<CRawData> pdata(new CRawData(pindex->GetBlockHash()));
+    if (!ReadRawBlockFromDisk(pdata->vch, pindex))
+        return false;
+    rawBlockCache.Insert(pindex->GetBlockHash(), pdata);
+    data = pdata;
+    return true;
+}
+
+bool ReadBlockCached(CBlock& block, const CBlockIndex* pindex)
+{
+    CRawDataRef data;
+    if (!ReadRawBlockCached(data, pindex))
+        return false;
+    try {
+        CDataStream ssBlock((const char*)&data->vch[0], (const char*)&data->vch[0] + data->vch.size(), SER_DISK, CLIENT_VERSION);
+        ssBlock >> block;
+    } catch (std::exception& e) {
+        return error("%s : Deserialize error - %s", __func__, e.what());
+    }
+    return true;
+}
+
 
 double ConvertBitsToDouble(unsigned int nBits)
 {
@@ -2060,11 +2190,16 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock() : block and undo data inconsistent");
 
+    CAddressIndexUpdate addressIndexUpdate;
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction& tx = block.vtx[i];
         uint256 hash = tx.GetHash();
 
+        if (fAddressIndex)
+            addressIndexUpdate.DisconnectOutputs(tx, pindex->nHeight);
+
         // Check that all outputs are available and match the outputs in the block itself
         // exactly. Note that transactions with only provably unspendable outputs won't
         // have outputs available even in the block itself, so we handle that case
@@ -2115,6 +2250,9 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 coins->vout[out.n] = undo.txout;
                 // erase the spent input
                 mapStakeSpent.erase(out);
+
+                if (fAddressIndex)
+                    addressIndexUpdate.DisconnectInput(tx, j, undo.txout, coins->nHeight, pindex->nHeight);
             }
         }
     }
@@ -2125,6 +2263,15 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         txFilterState = false;
     }
 
+    // VerifyDB disconnects into a throwaway view (and passes pfClean); only touch the index for real disconnects
+    if (fAddressIndex && !pfClean) {
+        if (!addressIndexUpdate.Write(*pblocktree, false))
+            return state.Abort("Failed to write address index");
+    }
+
+    if (!pfClean)
+        masternodePayments.DisconnectBlockPayees(block, pindex);
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -2241,6 +2388,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
+    CAddressIndexUpdate addressIndexUpdate;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     CAmount nValueOut = 0;
     CAmount nValueIn = 0;
@@ -2275,9 +2423,15 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL))
                 return false;
             control.Add(vChecks);
+
+            if (fAddressIndex)
+                addressIndexUpdate.ConnectInputs(tx, view, pindex->nHeight);
         }
         nValueOut += tx.GetValueOut();
 
+        if (fAddressIndex)
+            addressIndexUpdate.ConnectOutputs(tx, pindex->nHeight);
+
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
@@ -2291,7 +2445,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // ppcoin: track money supply and mint amount info
     CAmount nMoneySupplyPrev = pindex->pprev ? pindex->pprev->nMoneySupply : 0;
     pindex->nMoneySupply = nMoneySupplyPrev + nValueOut - nValueIn;
-    pindex->nMint = pindex->nMoneySupply - nMoneySupplyPrev;
+    CAmount nMint = pindex->nMoneySupply - nMoneySupplyPrev;
 
     if (!pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)))
         return error("Connect() : WriteBlockIndex for pindex failed");
@@ -2305,10 +2459,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (block.IsProofOfWork())
         nExpectedMint += nFees;
 
-    if (!IsBlockValueValid(block, nExpectedMint, pindex->nMint)) {
+    if (!IsBlockValueValid(block, nExpectedMint, nMint)) {
         return state.DoS(100,
             error("ConnectBlock() : reward pays too much (actual=%s vs limit=%s)",
-                FormatMoney(pindex->nMint), FormatMoney(nExpectedMint)),
+                FormatMoney(nMint), FormatMoney(nExpectedMint)),
             REJECT_INVALID, "bad-cb-amount");
     }
 
@@ -2339,9 +2493,20 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (fTxIndex)
+    if (fTxIndex) {
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
+        // A transaction read while its index entry still pointed to a disconnected block must not be served any longer
+        for (const PAIRTYPE(uint256, CDiskTxPos) & txpos : vPos)
+            rawTxCache.Erase(txpos.first);
+    }
+
+    if (fAddressIndex) {
+        if (!addressIndexUpdate.Write(*pblocktree, true))
+            return state.Abort("Failed to write address index");
+    }
+
+    masternodePayments.ConnectBlockPayees(block, pindex);
 
     // add new entries
     for (const CTransaction tx: block.vtx) {
@@ -2402,14 +2567,14 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
     static int64_t nLastWrite = 0;
     try {
         if ((mode == FLUSH_STATE_ALWAYS) ||
-            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
+            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
-            // Typical CCoins structures on disk are around 100 bytes in size.
+            // Per-output coin records on disk are around 50 bytes in size.
             // Pushing a new one to the database can cause it to be written
             // twice (once in the log, and once in the tables). This is already
             // an overestimation, as most will delete an existing entry or
             // overwrite one. Still, use a conservative safety factor of 2.
-            if (!CheckDiskSpace(100 * 2 * 2 * pcoinsTip->GetCacheSize()))
+            if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // First make sure all block and undo data is flushed to disk.
             FlushBlockFile();
@@ -2453,9 +2618,33 @@ void FlushStateToDisk()
 }
 
 /** Update chainActive and related internal data structures. */
+std::shared_ptr<const CChainSnapshot> GetChainSnapshot()
+{
+    LOCK(cs_chainSnapshot);
+    return pchainSnapshot;
+}
+
+/** Publish chainActive for readers that don't take cs_main; call after every change to it */
+static void PublishChainSnapshot()
+{
+    std::shared_ptr<const CChainSnapshot> snapshot(new CChainSnapshot(*GetChainSnapshot(), chainActive));
+    LOCK(cs_chainSnapshot);
+    pchainSnapshot = snapshot;
+}
+
+CBlockIndex* LookupBlockIndex(const uint256& hash)
+{
+    LOCK(cs_mapBlockIndex);
+    BlockMap::const_iterator mi = mapBlockIndex.find(hash);
+    return mi == mapBlockIndex.end() ? NULL : mi->second;
+}
+
 void static UpdateTip(CBlockIndex* pindexNew)
 {
     chainActive.SetTip(pindexNew);
+    PublishChainSnapshot();
+    stakeModifierIndex.SetTip(pindexNew);
+    InvalidateBlockHashCache(pindexNew->nHeight);
 
     // New best block
     nTimeBestReceived = GetTime();
@@ -2521,6 +2710,10 @@ bool static DisconnectTip(CValidationState& state)
     }
     mempool.removeCoinbaseSpends(pcoinsTip, pindexDelete->nHeight);
     mempool.check(pcoinsTip);
+    // The block stays on disk, but it left the chain and its transactions no longer confirm in it
+    rawBlockCache.Erase(pindexDelete->GetBlockHash());
+    for (const CTransaction& tx : block.vtx)
+        rawTxCache.Erase(tx.GetHash());
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev);
     // Let wallets know transactions went from 1-confirmed to
@@ -2592,6 +2785,15 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     nTimeChainState += nTime5 - nTime4;
     LogPrint("bench", "  - Writing chainstate: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001, nTimeChainState * 0.000001);
 
+    // A new tip is what peers are about to ask for
+    if (rawBlockCache.IsEnabled() && !IsInitialBlockDownload()) {
+        std::shared_ptr<CRawData> pdata(new CRawData(pindexNew->GetBlockHash()));
+        CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+        ssBlock << *pblock;
+        pdata->vch.assign(ssBlock.begin(), ssBlock.end());
+        rawBlockCache.Insert(pindexNew->GetBlockHash(), pdata);
+    }
+
     // Remove conflicting transactions from the mempool.
     list<CTransaction> txConflicted;
     mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, txConflicted);
@@ -2972,22 +3174,24 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex)
     return true;
 }
 
-CBlockIndex* AddToBlockIndex(const CBlock& block)
+CBlockIndex* AddToBlockIndex(const CBlock& block, const uint256& hash)
 {
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator it = mapBlockIndex.find(hash);
     if (it != mapBlockIndex.end())
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = blockIndexArena.Allocate(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
-    BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+    BlockMap::iterator mi;
+    {
+        LOCK(cs_mapBlockIndex);
+        mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+    }
 
     //mark as PoS seen
     if (pindexNew->IsProofOfStake())
@@ -3003,18 +3207,16 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         //update previous block pointer
         pindexNew->pprev->pnext = pindexNew;
 
-        // ppcoin: compute chain trust score
-        pindexNew->bnChainTrust = (pindexNew->pprev ? pindexNew->pprev->bnChainTrust : 0) + pindexNew->GetBlockTrust();
-
         // ppcoin: compute stake entropy bit for stake modifier
         if (!pindexNew->SetStakeEntropyBit(pindexNew->GetStakeEntropyBit()))
             LogPrintf("AddToBlockIndex() : SetStakeEntropyBit() failed \n");
 
-        // ppcoin: record proof-of-stake hash value
+        // ppcoin: look up proof-of-stake hash value, only needed for the checksum
+        uint256 hashProofOfStake = 0;
         if (pindexNew->IsProofOfStake()) {
             if (!mapProofOfStake.count(hash))
                 LogPrintf("AddToBlockIndex() : hashProofOfStake not found in map \n");
-            pindexNew->hashProofOfStake = mapProofOfStake[hash];
+            hashProofOfStake = mapProofOfStake[hash];
         }
 
         // ppcoin: compute stake modifier
@@ -3023,7 +3225,7 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         if (!ComputeNextStakeModifier(pindexNew->pprev, nStakeModifier, fGeneratedStakeModifier))
             LogPrintf("AddToBlockIndex() : ComputeNextStakeModifier() failed \n");
         pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
-        pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew);
+        pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew, hashProofOfStake);
         if (!CheckStakeModifierCheckpoints(pindexNew->nHeight, pindexNew->nStakeModifierChecksum))
             LogPrintf("AddToBlockIndex() : Rejected by stake modifier checkpoint height=%d, modifier=%s \n", pindexNew->nHeight, boost::lexical_cast<std::string>(nStakeModifier));
     }
@@ -3321,10 +3523,10 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     return true;
 }
 
-bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
+bool CheckWork(const CBlock& block, const uint256& hash, CBlockIndex* const pindexPrev)
 {
     if (!pindexPrev)
-        return error("%s : null pindexPrev for block %s", __func__, block.GetHash().ToString().c_str());
+        return error("%s : null pindexPrev for block %s", __func__, hash.ToString().c_str());
 
     unsigned int nBitsRequired = GetNextWorkRequired(pindexPrev);
 
@@ -3333,9 +3535,7 @@ bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
 
     if (block.IsProofOfStake()) {
         uint256 hashProofOfStake;
-        uint256 hash = block.GetHash();
-
-        if (!CheckProofOfStake(block, hashProofOfStake)) {
+        if (!CheckProofOfStake(block, hash, hashProofOfStake)) {
             LogPrintf("WARNING: ProcessBlock(): check proof-of-stake failed for block %s\n", hash.ToString().c_str());
             return false;
         }
@@ -3346,10 +3546,8 @@ bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
     return true;
 }
 
-bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* const pindexPrev)
+bool ContextualCheckBlockHeader(const CBlockHeader& block, const uint256& hash, CValidationState& state, CBlockIndex* const pindexPrev)
 {
-    uint256 hash = block.GetHash();
-
     if (hash == Params().HashGenesisBlock())
         return true;
 
@@ -3451,11 +3649,10 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex** ppindex)
+bool AcceptBlockHeader(const CBlock& block, const uint256& hash, CValidationState& state, CBlockIndex** ppindex)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex* pindex = NULL;
 
@@ -3494,16 +3691,16 @@ bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex
                 }
             }
 
-            return state.DoS(100, error("%s : prev block height=%d hash=%s is invalid, unable to add block %s", __func__, pindexPrev->nHeight, block.hashPrevBlock.GetHex(), block.GetHash().GetHex()),
+            return state.DoS(100, error("%s : prev block height=%d hash=%s is invalid, unable to add block %s", __func__, pindexPrev->nHeight, block.hashPrevBlock.GetHex(), hash.GetHex()),
                 REJECT_INVALID, "bad-prevblk");
         }
     }
 
-    if (!ContextualCheckBlockHeader(block, state, pindexPrev))
+    if (!ContextualCheckBlockHeader(block, hash, state, pindexPrev))
         return false;
 
     if (pindex == NULL)
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, hash);
 
     if (ppindex)
         *ppindex = pindex;
@@ -3511,7 +3708,7 @@ bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex
     return true;
 }
 
-bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex, CDiskBlockPos* dbp, bool fAlreadyCheckedBlock)
+bool AcceptBlock(CBlock& block, const uint256& hash, CValidationState& state, CBlockIndex** ppindex, CDiskBlockPos* dbp, bool fAlreadyCheckedBlock)
 {
     AssertLockHeld(cs_main);
 
@@ -3519,7 +3716,7 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
 
     // Get prev block index
     CBlockIndex* pindexPrev = NULL;
-    if (block.GetHash() != Params().HashGenesisBlock()) {
+    if (hash != Params().HashGenesisBlock()) {
         BlockMap::iterator mi = mapBlockIndex.find(block.hashPrevBlock);
         if (mi == mapBlockIndex.end())
             return state.DoS(0, error("%s : prev block %s not found", __func__, block.hashPrevBlock.ToString().c_str()), 0, "bad-prevblk");
@@ -3535,15 +3732,15 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
                     return true;
                 }
             }
-            return state.DoS(100, error("%s : prev block %s is invalid, unable to add block %s", __func__, block.hashPrevBlock.GetHex(), block.GetHash().GetHex()),
+            return state.DoS(100, error("%s : prev block %s is invalid, unable to add block %s", __func__, block.hashPrevBlock.GetHex(), hash.GetHex()),
                 REJECT_INVALID, "bad-prevblk");
         }
     }
 
-    if (block.GetHash() != Params().HashGenesisBlock() && !CheckWork(block, pindexPrev))
+    if (hash != Params().HashGenesisBlock() && !CheckWork(block, hash, pindexPrev))
         return false;
 
-    if (!AcceptBlockHeader(block, state, &pindex))
+    if (!AcceptBlockHeader(block, hash, state, &pindex))
         return false;
 
     if (pindex->nStatus & BLOCK_HAVE_DATA) {
@@ -3643,11 +3840,12 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
-bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp)
+bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp, bool fPreChecked)
 {
     // Preliminary checks
     int64_t nStartTime = GetTimeMillis();
-    bool checked = CheckBlock(*pblock, state);
+    uint256 hash = pblock->GetHash();
+    bool checked = CheckBlock(*pblock, state, true, !fPreChecked);
 
     // ppcoin: check proof-of-stake
     // Limited duplicity on stake: prevents block flood attack
@@ -3656,10 +3854,10 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
     //    return error("ProcessNewBlock() : duplicate proof-of-stake (%s, %d) for block %s", pblock->GetProofOfStake().first.ToString().c_str(), pblock->GetProofOfStake().second, pblock->GetHash().ToString().c_str());
 
     // NovaCoin: check proof-of-stake block signature
-    if (!pblock->CheckBlockSignature())
+    if (!fPreChecked && !pblock->CheckBlockSignature(hash))
         return error("ProcessNewBlock() : bad proof-of-stake block signature");
 
-    if (pblock->GetHash() != Params().HashGenesisBlock() && pfrom != NULL) {
+    if (hash != Params().HashGenesisBlock() && pfrom != NULL) {
         //if we get this far, check if the prev block is our prev block, if not then request sync and return false
         BlockMap::iterator mi = mapBlockIndex.find(pblock->hashPrevBlock);
         if (mi == mapBlockIndex.end()) {
@@ -3671,9 +3869,9 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
     {
         LOCK(cs_main); // Replaces the former TRY_LOCK loop because busy waiting wastes too much resources
 
-        MarkBlockAsReceived(pblock->GetHash());
+        MarkBlockAsReceived(hash);
         if (!checked) {
-            return error("%s : CheckBlock FAILED for block %s", __func__, pblock->GetHash().GetHex());
+            return error("%s : CheckBlock FAILED for block %s", __func__, hash.GetHex());
         }
 
         // stake input check for prevent "Spent Stake" vulnerability
@@ -3710,7 +3908,7 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
 
         // Store to disk
         CBlockIndex* pindex = NULL;
-        bool ret = AcceptBlock(*pblock, state, &pindex, dbp, checked);
+        bool ret = AcceptBlock(*pblock, hash, state, &pindex, dbp, checked);
         if (pindex && pfrom) {
             mapBlockSource[pindex->GetBlockHash()] = pfrom->GetId();
         }
@@ -3756,7 +3954,7 @@ bool TestBlockValidity(CValidationState& state, const CBlock& block, CBlockIndex
     indexDummy.nHeight = pindexPrev->nHeight + 1;
 
     // NOTE: CheckBlockHeader is called by CheckBlock
-    if (!ContextualCheckBlockHeader(block, state, pindexPrev)) {
+    if (!ContextualCheckBlockHeader(block, block.GetHash(), state, pindexPrev)) {
         LogPrintf("TestBlockValidity(): !ContextualCheckBlockHeader"); return false;
     }
     if (!CheckBlock(block, state, fCheckPOW, fCheckMerkleRoot)) {
@@ -3845,10 +4043,11 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw runtime_error("LoadBlockIndex() : new CBlockIndex failed");
-    mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
+    {
+        LOCK(cs_mapBlockIndex);
+        mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+    }
 
     //mark as PoS seen
     if (pindexNew->IsProofOfStake())
@@ -4000,6 +4199,10 @@ bool static LoadBlockIndexDB(string& strError)
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have an address index
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddressIndex ? "enabled" : "disabled");
+
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -4008,6 +4211,8 @@ bool static LoadBlockIndexDB(string& strError)
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    PublishChainSnapshot();
+    stakeModifierIndex.SetTip(it->second);
 
     PruneBlockIndexCandidates();
 
@@ -4069,7 +4274,7 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
             }
         }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
+        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
             if (!DisconnectBlock(block, state, pindex, coins, &fClean))
                 return error("VerifyDB(3) : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
@@ -4108,10 +4313,21 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
 
 void UnloadBlockIndex()
 {
-    mapBlockIndex.clear();
+    {
+        LOCK(cs_mapBlockIndex);
+        mapBlockIndex.clear();
+    }
+    setDirtyBlockIndex.clear();
+    mapBlocksUnlinked.clear();
+    pindexBestHeader = NULL;
+    blockIndexArena.Clear();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    PublishChainSnapshot();
+    stakeModifierIndex.SetTip(NULL);
     pindexBestInvalid = NULL;
+    rawBlockCache.Clear();
+    rawTxCache.Clear();
 }
 
 bool LoadBlockIndex(string& strError)
@@ -4133,6 +4349,10 @@ bool InitBlockIndex()
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", true);
     pblocktree->WriteFlag("txindex", fTxIndex);
+
+    // Use the provided setting for -addressindex in the new database
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -4147,7 +4367,7 @@ bool InitBlockIndex()
                 return error("LoadBlockIndex() : FindBlockPos failed");
             if (!WriteBlockToDisk(block, blockPos))
                 return error("LoadBlockIndex() : writing genesis block to disk failed");
-            CBlockIndex* pindex = AddToBlockIndex(block);
+            CBlockIndex* pindex = AddToBlockIndex(block, block.GetHash());
             if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
                 return error("LoadBlockIndex() : genesis block not accepted");
             if (!ActivateBestChain(state, &block))
@@ -4169,65 +4389,50 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
+    int nRead = 0;
+    uint64_t nBytesRead = 0;
+    int64_t nLastProgress = nStart;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE, MAX_BLOCK_SIZE + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        CBlockImportPipeline pipeline(fileIn, dbp, nReindexThreads);
+        boost::shared_ptr<CImportBlock> job;
+        while (pipeline.Next(job)) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++;         // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+            nRead++;
+            nBytesRead += job->nSize;
+            int64_t nNow = GetTimeMillis();
+            if (nNow - nLastProgress >= 10000) {
+                double nElapsed = (nNow - nStart) / 1000.0;
+                LogPrintf("Block Import: %d blocks read (%.1f blocks/s, %.1f MB/s), %d loaded, %u queued\n",
+                    nRead, nRead / nElapsed, nBytesRead / nElapsed / 1000000.0, nLoaded, pipeline.QueueSize());
+                nLastProgress = nNow;
             }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
+
+            CBlock& block = job->block;
+            CDiskBlockPos* pos = dbp ? &job->pos : NULL;
+
+            // detect out of order blocks, and store them for later
+            const uint256& hash = job->hash;
+            if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+                LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                    block.hashPrevBlock.ToString());
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                        block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
+                    mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *pos));
+                continue;
+            }
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, NULL, &block, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
+            // process in case the block isn't known yet
+            if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                CValidationState state;
+                if (ProcessNewBlock(state, NULL, &block, pos, job->fPreChecked))
+                    nLoaded++;
+                if (state.IsError())
+                    break;
+            } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+                LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+            }
 
+            try {
                 // Recursively process earlier encountered successors of this block
                 deque<uint256> queue;
                 queue.push_back(hash);
@@ -4522,6 +4727,7 @@ void static ProcessGetData(CNode* pfrom)
         if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
 
             CBlock block;
+            const CBlockIndex* pindexSend = NULL;
             bool   send = false;
 
             {
@@ -4547,20 +4753,23 @@ void static ProcessGetData(CNode* pfrom)
                     // Don't send not-validated blocks
                     send = send && (mi->second->nStatus & BLOCK_HAVE_DATA);
 
-                    if(send) {
-
-                        // Send block from disk
-                        if (!ReadBlockFromDisk(block, mi->second))
-                            assert(!"cannot load block from disk");
-                    }
+                    if (send)
+                        pindexSend = mi->second;
                 }
             }
 
             if(send) {
-                if (inv.type == MSG_BLOCK)
-                    pfrom->PushMessage("block", block);
-                else // MSG_FILTERED_BLOCK)
+                // Stored blocks don't move, so they are read without cs_main
+                if (inv.type == MSG_BLOCK) {
+                    // Relay the bytes from disk as they are, they are already in network format
+                    CRawDataRef data;
+                    if (!ReadRawBlockCached(data, pindexSend))
+                        assert(!"cannot load block from disk");
+                    pfrom->PushMessage("block", CFlatData((void*)&data->vch[0], (void*)(&data->vch[0] + data->vch.size())));
+                } else // MSG_FILTERED_BLOCK)
                 {
+                    if (!ReadBlockCached(block, pindexSend))
+                        assert(!"cannot load block from disk");
                     LOCK(pfrom->cs_filter);
                     if (pfrom->pfilter) {
                         CMerkleBlock merkleBlock(block, *pfrom->pfilter);
@@ -5235,12 +5444,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
              * before headers are reimplemented on mainnet
              */
-            if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
+            uint256 hash = header.GetHash();
+            if (!AcceptBlockHeader((CBlock)header, hash, state, &pindexLast)) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
                     if (nDoS > 0)
                         Misbehaving(pfrom->GetId(), nDoS);
-                    std::string strError = "invalid header received " + header.GetHash().ToString();
+                    std::string strError = "invalid header received " + hash.ToString();
                     return error(strError.c_str());
                 }
             }
@@ -5542,6 +5752,37 @@ int ActiveProtocol()
 }
 
 // requires LOCK(cs_vRecvMsg)
+/**
+ * When the next message carries a masternode signature, check the signatures
+ * of all complete masternode messages waiting behind it in one parallel
+ * batch, so processing them in order afterwards only hits the cache.
+ */
+static void BatchMasternodeSigChecks(CNode* pfrom)
+{
+    if (!nMnSigCheckThreads || pfrom->vRecvMsg.empty())
+        return;
+    const CNetMessage& msgFront = pfrom->vRecvMsg.front();
+    if (!msgFront.complete() || msgFront.fSigChecked || !CMasternodeSigBatch::IsCheckedCommand(msgFront.hdr.GetCommand()))
+        return;
+
+    CMasternodeSigBatch batch;
+    unsigned int nLookahead = 0;
+    for (std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin(); it != pfrom->vRecvMsg.end() && nLookahead < MAX_SIGCHECK_LOOKAHEAD; ++it, ++nLookahead) {
+        CNetMessage& msg = *it;
+        if (!msg.complete())
+            break;
+        if (msg.fSigChecked || !msg.hdr.IsValid())
+            continue;
+        string strCommand = msg.hdr.GetCommand();
+        if (CMasternodeSigBatch::IsCheckedCommand(strCommand)) {
+            batch.AddMessage(strCommand, msg.vRecv);
+            msg.fSigChecked = true;
+        }
+    }
+    if (batch.size() > 1)
+        batch.Verify();
+}
+
 bool ProcessMessages(CNode* pfrom)
 {
     //if (fDebug)
@@ -5563,6 +5804,8 @@ bool ProcessMessages(CNode* pfrom)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    BatchMasternodeSigChecks(pfrom);
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -5927,10 +6170,8 @@ public:
     ~CMainCleanup()
     {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
 
         // orphan transactions
         mapOrphanTransactions.clear();
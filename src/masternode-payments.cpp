@@ -24,6 +24,7 @@ CMasternodePayments masternodePayments;
 CCriticalSection cs_vecPayments;
 CCriticalSection cs_mapMasternodeBlocks;
 CCriticalSection cs_mapMasternodePayeeVotes;
+CCriticalSection cs_mapMasternodeLastPaid;
 
 bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue, CAmount nMinted)
 {
@@ -309,14 +310,19 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
     }
 }
 
+std::string CMasternodePaymentWinner::GetStrMessage() const
+{
+    return vinMasternode.prevout.ToStringShort() +
+           boost::lexical_cast<std::string>(nBlockHeight) +
+           payee.ToString();
+}
+
 bool CMasternodePaymentWinner::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     std::string errorMessage;
     std::string strMasterNodeSignMessage;
 
-    std::string strMessage = vinMasternode.prevout.ToStringShort() +
-                             boost::lexical_cast<std::string>(nBlockHeight) +
-                             payee.ToString();
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrintf("CMasternodePing::Sign() - Error: %s\n", errorMessage.c_str());
@@ -620,6 +626,152 @@ void CMasternodePayments::CleanPaymentList()
     }
 }
 
+//
+// Collect the masternode payees of a block. FillBlockPayee appends the masternode payments to the
+// block reward transaction after the staker/miner's output and the dev fee, so every later output
+// that pays neither the staker/miner nor a dev fee address is a masternode payment.
+//
+static void GetBlockRewardPayees(const CBlock& block, int nBlockHeight, std::set<CScript>& setPayees)
+{
+    bool fProofOfStake = nBlockHeight > Params().LAST_POW_BLOCK();
+
+    if (block.vtx.size() < (fProofOfStake ? 2u : 1u))
+        return;
+
+    const CTransaction& txReward = fProofOfStake ? block.vtx[1] : block.vtx[0];
+    unsigned int nRewardOut = fProofOfStake ? 1 : 0;
+
+    if (txReward.vout.size() <= nRewardOut)
+        return;
+
+    std::set<CScript> setExcluded;
+    setExcluded.insert(txReward.vout[nRewardOut].scriptPubKey);
+    for (bool fNew : {false, true}) {
+        CBitcoinAddress devFeeAddress(Params().DevFeeAddress(fNew));
+        if (devFeeAddress.IsValid())
+            setExcluded.insert(GetScriptForDestination(devFeeAddress.Get()));
+    }
+
+    for (unsigned int i = nRewardOut + 1; i < txReward.vout.size(); i++) {
+        const CScript& script = txReward.vout[i].scriptPubKey;
+        if (script.empty() || setExcluded.count(script))
+            continue;
+        setPayees.insert(script);
+    }
+}
+
+void CMasternodePayments::ConnectBlockPayees(const CBlock& block, const CBlockIndex* pindex)
+{
+    std::set<CScript> setPayees;
+    GetBlockRewardPayees(block, pindex->nHeight, setPayees);
+
+    LOCK(cs_mapMasternodeLastPaid);
+
+    if (nLastPaidIndexStart < 0)
+        nLastPaidIndexStart = pindex->nHeight;
+
+    for (const CScript& payee : setPayees) {
+        std::vector<std::pair<int, int64_t> >& vPaid = mapMasternodeLastPaid[payee];
+
+        // VerifyDB may reconnect a block that is already indexed
+        if (!vPaid.empty() && vPaid.back().first >= pindex->nHeight)
+            continue;
+
+        vPaid.emplace_back(pindex->nHeight, pindex->GetBlockTime());
+        if (vPaid.size() > MNPAYMENTS_LAST_PAID_HISTORY)
+            vPaid.erase(vPaid.begin());
+    }
+}
+
+void CMasternodePayments::DisconnectBlockPayees(const CBlock& block, const CBlockIndex* pindex)
+{
+    std::set<CScript> setPayees;
+    GetBlockRewardPayees(block, pindex->nHeight, setPayees);
+
+    LOCK(cs_mapMasternodeLastPaid);
+
+    for (const CScript& payee : setPayees) {
+        auto it = mapMasternodeLastPaid.find(payee);
+        if (it == mapMasternodeLastPaid.end())
+            continue;
+
+        std::vector<std::pair<int, int64_t> >& vPaid = it->second;
+        while (!vPaid.empty() && vPaid.back().first >= pindex->nHeight)
+            vPaid.pop_back();
+
+        if (vPaid.empty())
+            mapMasternodeLastPaid.erase(it);
+    }
+
+    if (nLastPaidIndexStart > pindex->nHeight)
+        nLastPaidIndexStart = pindex->nHeight;
+}
+
+//
+// Seed the last paid index with the payees of the last nDepth blocks so that payment queue
+// selection does not have to fall back to walking the payment votes right after startup
+//
+void CMasternodePayments::LoadLastPaidIndex(const CBlockIndex* pindexTip, int nDepth)
+{
+    if (!pindexTip || nDepth <= 0)
+        return;
+
+    int64_t nStart = GetTimeMillis();
+
+    {
+        LOCK(cs_mapMasternodeLastPaid);
+        mapMasternodeLastPaid.clear();
+        nLastPaidIndexStart = -1;
+    }
+
+    int nBlocks = 0;
+    for (int nHeight = std::max(1, pindexTip->nHeight - nDepth + 1); nHeight <= pindexTip->nHeight; nHeight++) {
+        const CBlockIndex* pindex = pindexTip->GetAncestor(nHeight);
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex)) {
+            LogPrintf("CMasternodePayments::LoadLastPaidIndex - failed to read block %s\n", pindex->GetBlockHash().ToString());
+            LOCK(cs_mapMasternodeLastPaid);
+            mapMasternodeLastPaid.clear();
+            nLastPaidIndexStart = -1;
+            return;
+        }
+        ConnectBlockPayees(block, pindex);
+        nBlocks++;
+    }
+
+    LogPrintf("CMasternodePayments::LoadLastPaidIndex - indexed %d blocks  %dms\n", nBlocks, GetTimeMillis() - nStart);
+}
+
+//
+// Find the most recent block in [nMinHeight, nMaxHeight] that paid this script. Only heights from
+// GetLastPaidIndexStart() upwards are covered by the index.
+//
+bool CMasternodePayments::GetLastPaidBlock(const CScript& payee, int nMinHeight, int nMaxHeight, int64_t& nTimeRet)
+{
+    LOCK(cs_mapMasternodeLastPaid);
+
+    auto it = mapMasternodeLastPaid.find(payee);
+    if (it == mapMasternodeLastPaid.end())
+        return false;
+
+    for (auto paid = it->second.rbegin(); paid != it->second.rend(); ++paid) {
+        if (paid->first > nMaxHeight)
+            continue;
+        if (paid->first < nMinHeight)
+            return false;
+        nTimeRet = paid->second;
+        return true;
+    }
+
+    return false;
+}
+
+int CMasternodePayments::GetLastPaidIndexStart()
+{
+    LOCK(cs_mapMasternodeLastPaid);
+    return nLastPaidIndexStart;
+}
+
 bool CMasternodePaymentWinner::IsValid(CNode* pnode, std::string& strError)
 {
     CMasternode* pmn = mnodeman.Find(vinMasternode);
@@ -771,9 +923,7 @@ bool CMasternodePaymentWinner::SignatureValid()
     if (!pmn)
         return false;
 
-    std::string strMessage = vinMasternode.prevout.ToStringShort() +
-                             boost::lexical_cast<std::string>(nBlockHeight) +
-                             payee.ToString();
+    std::string strMessage = GetStrMessage();
 
     std::string errorMessage;
 
@@ -17,6 +17,7 @@ using namespace std;
 extern CCriticalSection cs_vecPayments;
 extern CCriticalSection cs_mapMasternodeBlocks;
 extern CCriticalSection cs_mapMasternodePayeeVotes;
+extern CCriticalSection cs_mapMasternodeLastPaid;
 
 class CMasternodePayments;
 class CMasternodePaymentWinner;
@@ -26,6 +27,7 @@ extern CMasternodePayments masternodePayments;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED 6
 #define MNPAYMENTS_SIGNATURES_TOTAL 10
+#define MNPAYMENTS_LAST_PAID_HISTORY 8
 
 void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 bool IsBlockPayeeValid(const CBlock& block, int nBlockHeight);
@@ -172,6 +174,7 @@ public:
         return ss.GetHash();
     }
 
+    std::string GetStrMessage() const;
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool IsValid(CNode* pnode, std::string& strError);
     bool SignatureValid();
@@ -216,6 +219,11 @@ private:
 
     int nLastBlockHeight;
 
+    // payee script -> most recent (height, block time) pairs at which it was paid by a connected block, oldest first
+    std::map<CScript, std::vector<std::pair<int, int64_t> > > mapMasternodeLastPaid;
+    // lowest height covered by mapMasternodeLastPaid, or -1 before any block was indexed
+    int nLastPaidIndexStart;
+
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
@@ -224,6 +232,7 @@ public:
     CMasternodePayments()
     {
         nLastBlockHeight = 0;
+        nLastPaidIndexStart = -1;
     }
 
     void Clear()
@@ -240,6 +249,12 @@ public:
     void Sync(CNode* node, int nCountNeeded);
     void CleanPaymentList();
 
+    void ConnectBlockPayees(const CBlock& block, const CBlockIndex* pindex);
+    void DisconnectBlockPayees(const CBlock& block, const CBlockIndex* pindex);
+    void LoadLastPaidIndex(const CBlockIndex* pindexTip, int nDepth);
+    bool GetLastPaidBlock(const CScript& payee, int nMinHeight, int nMaxHeight, int64_t& nTimeRet);
+    int GetLastPaidIndexStart();
+
     bool GetBlockPayee(int nBlockHeight, unsigned mnlevel, CScript& payee);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
     bool IsScheduled(CMasternode& mn, int nSameLevelMNCount, int nNotBlockHeight) const;
@@ -0,0 +1,84 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-sigcheck.h"
+
+#include "masternode-payments.h"
+#include "masternode.h"
+#include "obfuscation.h"
+#include "swifttx.h"
+#include "util.h"
+
+CCheckQueue<CMasternodeSigCheck> mnsigcheckqueue(128);
+int nMnSigCheckThreads = 0;
+
+void ThreadMasternodeSigCheck()
+{
+    RenameThread("esbcoin-mnsigcheck");
+    mnsigcheckqueue.Thread();
+}
+
+bool CMasternodeSigCheck::operator()()
+{
+    CKeyID keyID;
+    obfuScationSigner.RecoverMessageKey(vchSig, strMessage, keyID);
+    // a bad signature only fails its own message, never the batch
+    return true;
+}
+
+bool CMasternodeSigBatch::IsCheckedCommand(const std::string& strCommand)
+{
+    return strCommand == "mnb" || strCommand == "mnp" || strCommand == "mnw" || strCommand == "txlvote";
+}
+
+bool CMasternodeSigBatch::AddMessage(const std::string& strCommand, const CDataStream& vRecvIn)
+{
+    CDataStream vRecv(vRecvIn);
+    try {
+        if (strCommand == "mnb") {
+            CMasternodeBroadcast mnb;
+            vRecv >> mnb;
+            Add(mnb.sig, mnb.GetStrMessage());
+            if (mnb.lastPing != CMasternodePing())
+                Add(mnb.lastPing.vchSig, mnb.lastPing.GetStrMessage());
+        } else if (strCommand == "mnp") {
+            CMasternodePing mnp;
+            vRecv >> mnp;
+            Add(mnp.vchSig, mnp.GetStrMessage());
+        } else if (strCommand == "mnw") {
+            CMasternodePaymentWinner winner;
+            vRecv >> winner;
+            Add(winner.vchSig, winner.GetStrMessage());
+        } else if (strCommand == "txlvote") {
+            CConsensusVote vote;
+            vRecv >> vote;
+            Add(vote.vchMasterNodeSignature, vote.GetStrMessage());
+        } else {
+            return false;
+        }
+    } catch (const std::exception& e) {
+        // Malformed messages are rejected by their handler
+        LogPrint("masternode", "CMasternodeSigBatch::AddMessage : %s: %s\n", strCommand, e.what());
+        return false;
+    }
+    return true;
+}
+
+void CMasternodeSigBatch::Add(const std::vector<unsigned char>& vchSig, const std::string& strMessage)
+{
+    vChecks.push_back(CMasternodeSigCheck(vchSig, strMessage));
+}
+
+void CMasternodeSigBatch::Verify()
+{
+    CCheckQueueControl<CMasternodeSigCheck> control(nMnSigCheckThreads ? &mnsigcheckqueue : NULL);
+    if (nMnSigCheckThreads) {
+        control.Add(vChecks);
+    } else {
+        for (CMasternodeSigCheck& check : vChecks)
+            check();
+    }
+    control.Wait();
+    vChecks.clear();
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MASTERNODE_SIGCHECK_H
+#define MASTERNODE_SIGCHECK_H
+
+#include "checkqueue.h"
+#include "streams.h"
+
+#include <string>
+#include <vector>
+
+//! Maximum number of masternode signature check threads
+static const int MAX_MNSIGCHECK_THREADS = 16;
+//! -mnsigcheckthreads default (0 = auto)
+static const int DEFAULT_MNSIGCHECK_THREADS = 0;
+//! Number of a peer's queued messages scanned ahead for signatures to check
+static const unsigned int MAX_SIGCHECK_LOOKAHEAD = 100;
+
+class CMasternodeSigCheck;
+extern CCheckQueue<CMasternodeSigCheck> mnsigcheckqueue;
+extern int nMnSigCheckThreads;
+
+void ThreadMasternodeSigCheck();
+
+/**
+ * One signature of a masternode or SwiftX message. Checking it recovers the
+ * signing key into CObfuScationSigner's cache; whether that key is the right
+ * one is decided later, when the message itself is processed.
+ */
+class CMasternodeSigCheck
+{
+private:
+    std::vector<unsigned char> vchSig;
+    std::string strMessage;
+
+public:
+    CMasternodeSigCheck() {}
+    CMasternodeSigCheck(const std::vector<unsigned char>& vchSigIn, const std::string& strMessageIn) : vchSig(vchSigIn), strMessage(strMessageIn) {}
+
+    bool operator()();
+
+    void swap(CMasternodeSigCheck& check)
+    {
+        vchSig.swap(check.vchSig);
+        strMessage.swap(check.strMessage);
+    }
+};
+
+/**
+ * Accumulates the signatures of pending mnb, mnp, mnw and txlvote messages
+ * and checks them in parallel on mnsigcheckqueue. The messages are applied
+ * afterwards, one at a time and in order, by their usual handlers, whose
+ * signature checks then hit the cache.
+ */
+class CMasternodeSigBatch
+{
+private:
+    std::vector<CMasternodeSigCheck> vChecks;
+
+public:
+    static bool IsCheckedCommand(const std::string& strCommand);
+
+    //! Add the signatures carried by a serialized message; false if it has none or does not parse
+    bool AddMessage(const std::string& strCommand, const CDataStream& vRecv);
+    void Add(const std::vector<unsigned char>& vchSig, const std::string& strMessage);
+
+    size_t size() const { return vChecks.size(); }
+
+    //! Check all accumulated signatures, with the calling thread joining the workers
+    void Verify();
+};
+
+#endif
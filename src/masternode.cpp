@@ -14,13 +14,36 @@
 
 #include <boost/lexical_cast.hpp>
 
-// cache block hashes as we calculate them
-std::map<int64_t, uint256> mapCacheBlockHashes;
+// cache block hashes as we calculate them, one slot per height modulo the cache size
+struct CBlockHashCacheEntry {
+    int nHeight;
+    uint256 hash;
+
+    CBlockHashCacheEntry() : nHeight(-1) {}
+};
+static CBlockHashCacheEntry blockHashCache[MASTERNODE_BLOCK_HASH_CACHE_SIZE];
+// bumped on every invalidation so lookups racing a reorg don't store stale hashes
+static uint64_t nBlockHashCacheGeneration = 0;
+static CCriticalSection cs_blockHashCache;
+
+uint64_t GetBlockHashCacheGeneration()
+{
+    LOCK(cs_blockHashCache);
+    return nBlockHashCacheGeneration;
+}
 
-//Get the last hash that matches the modulus given. Processed in reverse order
+//Get the hash of the active chain block at the given height (the tip if nBlockHeight <= 0)
 bool GetBlockHash(uint256& hash, int nBlockHeight)
 {
-    auto active_tip = chainActive.Tip();
+    // the generation has to be read before the snapshot is taken: a reorg publishes its
+    // snapshot before invalidating, so a snapshot older than nGeneration can't exist
+    uint64_t nGeneration = GetBlockHashCacheGeneration();
+    return GetBlockHash(hash, nBlockHeight, *GetChainSnapshot(), nGeneration);
+}
+
+bool GetBlockHash(uint256& hash, int nBlockHeight, const CChainSnapshot& chain, uint64_t nGeneration)
+{
+    CBlockIndex* active_tip = chain.Tip();
 
     if(!active_tip)
         return false;
@@ -31,26 +54,39 @@ bool GetBlockHash(uint256& hash, int nBlockHeight)
     if(active_tip->nHeight < nBlockHeight)
         return false;
 
-    const auto& cached_hash = mapCacheBlockHashes.find(nBlockHeight);
-
-    if(cached_hash != mapCacheBlockHashes.cend()) {
-        hash = cached_hash->second;
-        return true;
+    CBlockHashCacheEntry& entry = blockHashCache[nBlockHeight % MASTERNODE_BLOCK_HASH_CACHE_SIZE];
+    {
+        LOCK(cs_blockHashCache);
+        if (entry.nHeight == nBlockHeight && nGeneration == nBlockHashCacheGeneration) {
+            hash = entry.hash;
+            return true;
+        }
     }
 
-    for(auto BlockReading = active_tip; BlockReading; BlockReading = BlockReading->pprev) {
-
-        if(BlockReading->nHeight != nBlockHeight)
-            continue;
-
-        auto ins_res = mapCacheBlockHashes.emplace(nBlockHeight, BlockReading->GetBlockHash());
+    // never cs_main here, callers may hold masternode locks
+    const CBlockIndex* pindex = chain[nBlockHeight];
+    if (!pindex)
+        return false;
 
-        hash = ins_res.first->second;
+    hash = pindex->GetBlockHash();
 
-        return true;
+    LOCK(cs_blockHashCache);
+    if (nGeneration == nBlockHashCacheGeneration) {
+        entry.nHeight = nBlockHeight;
+        entry.hash = hash;
     }
+    return true;
+}
 
-    return false;
+//Forget the cached hashes above nHeight, called whenever the active chain tip changes
+void InvalidateBlockHashCache(int nHeight)
+{
+    LOCK(cs_blockHashCache);
+    nBlockHashCacheGeneration++;
+    for (int i = 0; i < MASTERNODE_BLOCK_HASH_CACHE_SIZE; i++) {
+        if (blockHashCache[i].nHeight > nHeight)
+            blockHashCache[i].nHeight = -1;
+    }
 }
 
 CMasternode::CMasternode()
@@ -236,10 +272,10 @@ void CMasternode::Check(bool forceCheck)
 }
 
 //int64_t CMasternode::SecondsSincePayment(bool test)
-int64_t CMasternode::SecondsSincePayment()
+int64_t CMasternode::SecondsSincePayment(int nMnCount)
 {
 //    int64_t sec = (GetAdjustedTime() - GetLastPaid(test));
-    int64_t sec = (GetAdjustedTime() - GetLastPaid());
+    int64_t sec = (GetAdjustedTime() - GetLastPaid(nMnCount));
     int64_t month = 60 * 60 * 24 * 30;
 
     if (sec < month)
@@ -255,7 +291,7 @@ int64_t CMasternode::SecondsSincePayment()
 }
 
 //int64_t CMasternode::GetLastPaid(bool test)
-int64_t CMasternode::GetLastPaid()
+int64_t CMasternode::GetLastPaid(int nMnCount)
 {
     CBlockIndex* pindexPrev = chainActive.Tip();
 
@@ -273,28 +309,43 @@ int64_t CMasternode::GetLastPaid()
     // use a deterministic offset to break a tie -- 1.5 minutes
     int64_t nOffset = hash.GetCompact(false) % 90;
 
-    const CBlockIndex* BlockReading = pindexPrev;
+    if (nMnCount < 0)
+        nMnCount = mnodeman.CountEnabled(Level());
 
-    int nMnCount = 0;
-    nMnCount = int(mnodeman.CountEnabled(Level()) * 1.25); // new
+    nMnCount = int(nMnCount * 1.25); // new
 
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if (n >= nMnCount) {
-            return 0;
-        }
-        n++;
-
-        if (masternodePayments.mapMasternodeBlocks.count(BlockReading->nHeight)) {
-            /*
-                Search for this payee, with at least 6 votes.
-            */
-            if (masternodePayments.mapMasternodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, 6)) {
-                return BlockReading->nTime - nOffset;
-            }
-        }
+    // only look back as many blocks as there are masternodes (plus some slack)
+    int nMinHeight = std::max(1, pindexPrev->nHeight - nMnCount + 1);
+
+    // Until SPORK_12 switches every node over to last paid times from the paid outputs, keep
+    // taking them from the payees with enough payment votes so all nodes pick the same winners
+    int nWalkFrom = pindexPrev->nHeight;
+    if (IsSporkActive(SPORK_12_MN_LAST_PAID_INDEX)) {
+        int64_t nPaidTime;
+        if (masternodePayments.GetLastPaidBlock(mnpayee, nMinHeight, pindexPrev->nHeight, nPaidTime))
+            return nPaidTime - nOffset;
 
-        BlockReading = BlockReading->pprev;
+        // blocks below the start of the last paid index (not yet seeded) are looked up in the payment votes
+        int nIndexStart = masternodePayments.GetLastPaidIndexStart();
+        if (nIndexStart >= 0)
+            nWalkFrom = std::min(pindexPrev->nHeight, nIndexStart - 1);
+    }
+
+    if (nWalkFrom < nMinHeight)
+        return 0;
+
+    LOCK(cs_mapMasternodeBlocks);
+
+    for (const CBlockIndex* BlockReading = pindexPrev->GetAncestor(nWalkFrom); BlockReading && BlockReading->nHeight >= nMinHeight; BlockReading = BlockReading->pprev) {
+        auto mnblock = masternodePayments.mapMasternodeBlocks.find(BlockReading->nHeight);
+        if (mnblock == masternodePayments.mapMasternodeBlocks.end())
+            continue;
+
+        /*
+            Search for this payee, with at least 6 votes.
+        */
+        if (mnblock->second.HasPayeeWithVotes(mnpayee, 6))
+            return BlockReading->nTime - nOffset;
     }
 
     return 0;
@@ -511,6 +562,13 @@ bool CMasternodeBroadcast::CheckDefaultPort(const CService& service, std::string
     return true;
 }
 
+std::string CMasternodeBroadcast::GetStrMessage() const
+{
+    std::string vchPubKey(pubKeyCollateralAddress.begin(), pubKeyCollateralAddress.end());
+    std::string vchPubKey2(pubKeyMasternode.begin(), pubKeyMasternode.end());
+    return addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+}
+
 bool CMasternodeBroadcast::CheckAndUpdate(int& nDos)
 {
     // make sure signature isn't in the future (past is OK)
@@ -520,9 +578,7 @@ bool CMasternodeBroadcast::CheckAndUpdate(int& nDos)
         return false;
     }
 
-    std::string vchPubKey(pubKeyCollateralAddress.begin(), pubKeyCollateralAddress.end());
-    std::string vchPubKey2(pubKeyMasternode.begin(), pubKeyMasternode.end());
-    std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+    std::string strMessage = GetStrMessage();
 
     if (protocolVersion < masternodePayments.GetMinMasternodePaymentsProto()) {
         LogPrintf("mnb - ignoring outdated Masternode %s protocol version %d\n", vin.prevout.hash.ToString(), protocolVersion);
@@ -702,12 +758,9 @@ bool CMasternodeBroadcast::Sign(CKey& keyCollateralAddress)
 {
     std::string errorMessage;
 
-    std::string vchPubKey(pubKeyCollateralAddress.begin(), pubKeyCollateralAddress.end());
-    std::string vchPubKey2(pubKeyMasternode.begin(), pubKeyMasternode.end());
-
     sigTime = GetAdjustedTime();
 
-    std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, sig, keyCollateralAddress)) {
         LogPrintf("CMasternodeBroadcast::Sign() - Error: %s\n", errorMessage);
@@ -739,13 +792,18 @@ CMasternodePing::CMasternodePing(CTxIn& newVin)
 }
 
 
+std::string CMasternodePing::GetStrMessage() const
+{
+    return vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+}
+
 bool CMasternodePing::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     std::string errorMessage;
     std::string strMasterNodeSignMessage;
 
     sigTime = GetAdjustedTime();
-    std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrintf("CMasternodePing::Sign() - Error: %s\n", errorMessage);
@@ -791,7 +849,7 @@ bool CMasternodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled)
         // update only if there is no known ping for this masternode or
         // last ping was more then MASTERNODE_MIN_MNP_SECONDS-60 ago comparing to this one
         if (!pmn->IsPingedWithin((ActiveProtocol() >= CONSENSUS_FORK_PROTO) ? MASTERNODE_MIN_MNP_SECONDS2 - 60 : MASTERNODE_MIN_MNP_SECONDS - 60, sigTime)) {
-            std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+            std::string strMessage = GetStrMessage();
 
             std::string errorMessage = "";
             if (!obfuScationSigner.VerifyMessage(pmn->pubKeyMasternode, vchSig, strMessage, errorMessage)) {
@@ -24,15 +24,20 @@
 #define MASTERNODE_EXPIRATION_SECONDS (120 * 60)
 #define MASTERNODE_REMOVAL_SECONDS (130 * 60)
 #define MASTERNODE_CHECK_SECONDS 5
+//! Number of active chain block hashes kept by GetBlockHash, indexed by height modulo this size
+#define MASTERNODE_BLOCK_HASH_CACHE_SIZE 1024
 
 using namespace std;
 
 class CMasternode;
 class CMasternodeBroadcast;
 class CMasternodePing;
-extern map<int64_t, uint256> mapCacheBlockHashes;
 
 bool GetBlockHash(uint256& hash, int nBlockHeight);
+//! Lookup on a given snapshot; the cache is only used if it wasn't invalidated since nGeneration was read
+bool GetBlockHash(uint256& hash, int nBlockHeight, const CChainSnapshot& chain, uint64_t nGeneration);
+uint64_t GetBlockHashCacheGeneration();
+void InvalidateBlockHashCache(int nHeight);
 
 
 //
@@ -62,6 +67,7 @@ public:
         READWRITE(vchSig);
     }
 
+    std::string GetStrMessage() const;
     bool CheckAndUpdate(int& nDos, bool fRequireEnabled = true);
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     void Relay();
@@ -220,7 +226,8 @@ public:
     }
 
 //    int64_t SecondsSincePayment(bool test = false);
-    int64_t SecondsSincePayment();
+    // nMnCount: enabled masternodes of this level, -1 to count them here
+    int64_t SecondsSincePayment(int nMnCount = -1);
 
     bool UpdateFromNewBroadcast(CMasternodeBroadcast& mnb);
 
@@ -282,7 +289,7 @@ public:
     }
 
 //    int64_t GetLastPaid(bool test = false);
-    int64_t GetLastPaid();
+    int64_t GetLastPaid(int nMnCount = -1);
     bool IsValidNetAddr();
 };
 
@@ -298,6 +305,7 @@ public:
     CMasternodeBroadcast(CService newAddr, CTxIn newVin, CPubKey newPubkey, CPubKey newPubkey2, int protocolVersionIn);
     CMasternodeBroadcast(const CMasternode& mn);
 
+    std::string GetStrMessage() const;
     bool CheckAndUpdate(int& nDoS);
     bool CheckInputsAndAdd(int& nDos);
     bool Sign(CKey& keyCollateralAddress);
@@ -653,7 +653,7 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
         if (masternodePayments.IsScheduled(mn, nMnCount, nBlockHeight))
             continue;
 
-        vecMasternodeLastPaid.emplace_back(mn.SecondsSincePayment(), mn.vin);
+        vecMasternodeLastPaid.emplace_back(mn.SecondsSincePayment(nMnCount), mn.vin);
 //        vecMasternodeLastPaidTest.emplace_back(mn.SecondsSincePayment(true), mn.vin); // test
     }
 
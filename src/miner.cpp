@@ -10,6 +10,7 @@
 
 #include "amount.h"
 #include "hash.h"
+#include "kernel.h"
 #include "main.h"
 #include "masternode-sync.h"
 #include "net.h"
@@ -34,27 +35,6 @@ using namespace std;
 // esbcoinMiner
 //
 
-//
-// Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
-//
-class COrphan
-{
-public:
-    const CTransaction* ptx;
-    set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
-
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
-    {
-    }
-};
-
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 int64_t nLastCoinStakeSearchInterval = 0;
@@ -87,8 +67,12 @@ void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
     pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
 }
 
-CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake)
+CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake, const CStakeKernelInput* pStakeKernel, unsigned int nStakeTime)
 {
+    // Proof-of-stake templates are only assembled around a kernel that already hit the target
+    if (fProofOfStake && !pStakeKernel)
+        return nullptr;
+
     // Create new block
     unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate());
 
@@ -118,8 +102,6 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
     pblocktemplate->vTxSigOps.push_back(-1); // updated at end
 
     // ppcoin: if coinstake available add coinstake tx
-    static int64_t nLastCoinStakeSearchTime = GetAdjustedTime(); // only initialized at startup
-
     CMutableTransaction txCoinStake;
     if (fProofOfStake) {
         pblock->vtx[0].vout[0].SetEmpty();
@@ -148,7 +130,6 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
     uint64_t nBlockSize = 1000;
     uint64_t nBlockTx = 0;
     int nBlockSigOps = 100;
-    bool fSortedByFee = (nBlockPrioritySize <= 0);
     CBlockIndex* pindexPrev;
     {
         LOCK2(cs_main, mempool.cs);
@@ -157,133 +138,40 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         nHeight = pindexPrev->nHeight + 1;
         CCoinsViewCache view(pcoinsTip);
 
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
         bool fPrintPriority = GetBoolArg("-printpriority", false);
+        std::set<uint256> setInBlock;
+        std::set<uint256> setFailed;
 
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->second.GetTx();
+        // Check a transaction against the block assembled so far and append it
+        auto addTx = [&](const CTransaction& tx, double dPriority, const CFeeRate& feeRate) -> bool {
             if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
-                continue;
-
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            for (const CTxIn& txin : tx.vin) {
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
-                    continue;
-                }
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                assert(coins);
-
-                CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = nHeight - coins->nHeight;
-
-                dPriority += (double)nValueIn * nConf;
-            }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
-
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            } else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
-        }
-
-        // Collect transactions into block
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
+                return false;
 
             // Size limits
             unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
             if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
+                return false;
 
             // Legacy limits on sigOps:
             unsigned int nTxSigOps = GetLegacySigOpCount(tx);
             if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
+                return false;
 
             if (!view.HaveInputs(tx))
-                continue;
+                return false;
 
             CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
 
             nTxSigOps += GetP2SHSigOpCount(tx, view);
             if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-                continue;
+                return false;
 
             // Note that flags: we don't want to set mempool/IsStandard()
             // policy here, but we still have to ensure that the block we
             // create only contains transactions that are valid in new blocks.
             CValidationState state;
             if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
-                continue;
+                return false;
 
             CTxUndo txundo;
             UpdateCoins(tx, state, view, txundo, nHeight);
@@ -296,24 +184,115 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
             ++nBlockTx;
             nBlockSigOps += nTxSigOps;
             nFees += nTxFees;
+            setInBlock.insert(tx.GetHash());
 
             if (fPrintPriority) {
                 LogPrintf("priority %.1f fee %s txid %s\n",
                     dPriority, feeRate.ToString(), tx.GetHash().ToString());
             }
+            return true;
+        };
+
+        // High-priority transactions first, regardless of the fees they pay.
+        // Only those spending confirmed outputs qualify; everything else is
+        // picked up below together with its ancestors.
+        if (nBlockPrioritySize > 0) {
+            vector<TxPriority> vecPriority;
+            vecPriority.reserve(mempool.mapTx.size());
+            for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
+                 mi != mempool.mapTx.end(); ++mi) {
+                const CTxMemPoolEntry& entry = mi->second;
+                if (entry.GetCountWithAncestors() != 1)
+                    continue;
+                double dPriority = entry.GetPriority(nHeight);
+                CAmount nFeeDelta = 0;
+                mempool.ApplyDeltas(mi->first, dPriority, nFeeDelta);
+                vecPriority.push_back(TxPriority(dPriority, CFeeRate(entry.GetModifiedFee(), entry.GetTxSize()), &entry.GetTx()));
+            }
 
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                for (COrphan* porphan : mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
+            TxPriorityCompare comparer(false);
+            std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+            while (!vecPriority.empty()) {
+                // Take highest priority transaction off the priority queue:
+                double dPriority = vecPriority.front().get<0>();
+                CFeeRate feeRate = vecPriority.front().get<1>();
+                const CTransaction& tx = *(vecPriority.front().get<2>());
+
+                std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                vecPriority.pop_back();
+
+                // Switch to fee rate order once past the priority size or out of high-priority transactions
+                unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+                if (nBlockSize + nTxSize >= nBlockPrioritySize || !AllowFree(dPriority))
+                    break;
+
+                addTx(tx, dPriority, feeRate);
+            }
+        }
+
+        // Then whole packages, a transaction together with its unconfirmed
+        // ancestors, by the fee rate of the package. The mempool keeps this
+        // order up to date, so there is nothing to sort here.
+        const std::set<CMempoolScore>& setAncestorScore = mempool.GetAncestorScoreIndex();
+        unsigned int nConsecutiveFailed = 0;
+        for (std::set<CMempoolScore>::const_iterator it = setAncestorScore.begin(); it != setAncestorScore.end(); ++it) {
+            const uint256& hash = it->hash;
+            if (setInBlock.count(hash) || setFailed.count(hash))
+                continue;
+
+            // Skip free transactions if we're past the minimum block size:
+            if (it->GetFeeRate() < ::minRelayTxFee && nBlockSize >= nBlockMinSize)
+                break;
+
+            std::set<uint256> setAncestors;
+            mempool.CalculateAncestors(hash, setAncestors);
+            setAncestors.insert(hash);
+
+            std::vector<const CTxMemPoolEntry*> vPackage;
+            uint64_t nPackageSize = 0;
+            bool fAncestorFailed = false;
+            for (const uint256& hashAncestor : setAncestors) {
+                if (setInBlock.count(hashAncestor))
+                    continue;
+                if (setFailed.count(hashAncestor)) {
+                    fAncestorFailed = true;
+                    break;
+                }
+                const CTxMemPoolEntry& entry = mempool.mapTx[hashAncestor];
+                vPackage.push_back(&entry);
+                nPackageSize += entry.GetTxSize();
+            }
+            if (fAncestorFailed) {
+                setFailed.insert(hash);
+                continue;
+            }
+
+            if (nBlockSize + nPackageSize >= nBlockMaxSize) {
+                // Give up once the block is nearly full and nothing fits anymore
+                if (++nConsecutiveFailed > 1000 && nBlockSize > nBlockMaxSize - 4000)
+                    break;
+                continue;
+            }
+
+            // Parents go first: a transaction has more ancestors than any of its parents
+            std::sort(vPackage.begin(), vPackage.end(), [](const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) {
+                return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+            });
+
+            bool fPackageFailed = false;
+            for (const CTxMemPoolEntry* pentry : vPackage) {
+                if (!addTx(pentry->GetTx(), pentry->GetPriority(nHeight), CFeeRate(pentry->GetModifiedFee(), pentry->GetTxSize()))) {
+                    setFailed.insert(pentry->GetTx().GetHash());
+                    fPackageFailed = true;
+                    break;
                 }
             }
+            if (fPackageFailed) {
+                setFailed.insert(hash);
+                nConsecutiveFailed++;
+            } else {
+                nConsecutiveFailed = 0;
+            }
         }
     }
 
@@ -324,31 +303,14 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
     // Compute final transaction.
     if (fProofOfStake) {
         boost::this_thread::interruption_point();
-        pblock->nTime = GetAdjustedTime();
-//        CBlockIndex* pindexPrev = chainActive.Tip();
+        pblock->nTime = nStakeTime;
         pblock->nBits = GetNextWorkRequired(pindexPrev);
-        //CMutableTransaction txCoinStake;
-        int64_t nSearchTime = pblock->nTime; // search to current time
-        bool fStakeFound = false;
-        if (nSearchTime >= nLastCoinStakeSearchTime) {
-            unsigned int nTxNewTime = 0;
-            if (pwallet->CreateCoinStake(*pwallet, pblock->nBits, nSearchTime - nLastCoinStakeSearchTime, txCoinStake, nTxNewTime, nFees)) {
-                pblock->nTime = nTxNewTime;
-
-                LogPrintf("CreateNewBlock() if fProofOfStake: chainActive.Height() = %s \n", chainActive.Height());
-                //pblock->vtx[0].vout[0].SetEmpty();
-
-                //pblock->vtx.push_back(CTransaction(txCoinStake));
-                pblock->vtx[1] = CTransaction(txCoinStake);
-                fStakeFound = true;
-            }
-            nLastCoinStakeSearchInterval = nSearchTime - nLastCoinStakeSearchTime;
-            nLastCoinStakeSearchTime = nSearchTime;
-        }
-
-        if (!fStakeFound)
+        if (!pwallet->CreateCoinStake(*pwallet, *pStakeKernel, txCoinStake, nFees))
             return nullptr;
 
+        LogPrintf("CreateNewBlock() if fProofOfStake: chainActive.Height() = %s \n", chainActive.Height());
+        pblock->vtx[1] = CTransaction(txCoinStake);
+
     } else {
         txNew.vout[0].nValue       = block_value + nFees;
         txNew.vout[0].scriptPubKey = scriptPubKeyIn;
@@ -482,6 +444,55 @@ bool fGenerateESBCs = false;
 static bool fMintableCoins = false;
 static int nMintableLastCheck = 0;
 
+/**
+ * The stake table (one entry per stakeable output, with its stake modifier
+ * already resolved) is rebuilt when the tip moves, after nStakeSetUpdateTime,
+ * or after one of its coins staked.
+ */
+bool SearchStakeKernel(CWallet* pwallet, CBlockIndex* pindexPrev, CStakeSearch& search, CStakeKernelInput& kernelRet, unsigned int& nTimeRet)
+{
+    //prevent staking a time that won't be accepted
+    int64_t nSearchTime = GetAdjustedTime(); // search to current time
+    if (nSearchTime <= pindexPrev->nTime)
+        return false;
+    if (search.nLastSearchTime == 0)
+        search.nLastSearchTime = nSearchTime;
+    if (nSearchTime < search.nLastSearchTime)
+        return false;
+    nLastCoinStakeSearchInterval = nSearchTime - search.nLastSearchTime;
+    search.nLastSearchTime = nSearchTime;
+
+    if (search.hashStakeTableTip != pindexPrev->GetBlockHash() || GetTime() - search.nStakeTableTime > pwallet->nStakeSetUpdateTime) {
+        search.vStakeTable.clear();
+        search.hashStakeTableTip = 0;
+        if (!pwallet->GetStakeKernelInputs(search.vStakeTable, nSearchTime))
+            return false;
+        search.hashStakeTableTip = pindexPrev->GetBlockHash();
+        search.nStakeTableTime = GetTime();
+        LogPrint("staking", "SearchStakeKernel() : %u stake inputs at height %d\n", search.vStakeTable.size(), pindexPrev->nHeight);
+    }
+
+    if (search.vStakeTable.empty())
+        return false;
+
+    unsigned int nBits = GetNextWorkRequired(pindexPrev);
+    size_t nKernel = 0;
+    uint256 hashProofOfStake = 0;
+    nTimeRet = nSearchTime;
+    bool fFound = FindStakeKernel(search.vStakeTable, nBits, nTimeRet, pwallet->nHashDrift, pindexPrev->GetMedianTimePast(), nKernel, hashProofOfStake, pindexPrev->nHeight);
+
+    mapHashedBlocks.clear();
+    mapHashedBlocks[pindexPrev->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+    if (!fFound)
+        return false;
+
+    kernelRet = search.vStakeTable[nKernel];
+    search.hashStakeTableTip = 0; // the kernel is about to be spent, rebuild the table next round
+    if (fDebug && GetBoolArg("-printcoinstake", false))
+        LogPrintf("SearchStakeKernel() : kernel %s found at %u hashProof=%s\n", kernelRet.prevout.ToString(), nTimeRet, hashProofOfStake.ToString());
+    return true;
+}
+
 // ***TODO*** that part changed in bitcoin, we are using a mix with old one here for now
 
 void GenerateESBC(CWallet* pwallet, bool fProofOfStake)
@@ -493,6 +504,7 @@ void GenerateESBC(CWallet* pwallet, bool fProofOfStake)
     // Each thread has its own key and counter
     CReserveKey reservekey(pwallet);
     unsigned int nExtraNonce = 0;
+    CStakeSearch stakeSearch;
 
     while (fGenerateESBCs || fProofOfStake) {
         if (fProofOfStake) {
@@ -544,8 +556,21 @@ void GenerateESBC(CWallet* pwallet, bool fProofOfStake)
         if (!pindexPrev)
             continue;
 
+        // Proof-of-stake: find the kernel first, the block template is only worth building on a hit
+        CStakeKernelInput stakeKernel;
+        unsigned int nStakeTime = 0;
+        if (fProofOfStake) {
+            //prevent staking a time that won't be accepted
+            if (GetAdjustedTime() <= pindexPrev->nTime) {
+                MilliSleep(10000);
+                continue;
+            }
+            if (!SearchStakeKernel(pwallet, pindexPrev, stakeSearch, stakeKernel, nStakeTime))
+                continue;
+        }
+
         std::unique_ptr<CBlockTemplate> pblocktemplate(
-            fProofOfStake ? CreateNewBlock(CScript(), pwallet, fProofOfStake) : CreateNewBlockWithKey(reservekey, pwallet)
+            fProofOfStake ? CreateNewBlock(CScript(), pwallet, fProofOfStake, &stakeKernel, nStakeTime) : CreateNewBlockWithKey(reservekey, pwallet)
         );
 
         if (!pblocktemplate.get())
@@ -16,11 +16,15 @@ class CScript;
 class CWallet;
 
 struct CBlockTemplate;
+struct CStakeKernelInput;
+struct CStakeSearch;
 
 /** Run the miner threads */
 void GenerateESBCs(bool fGenerate, CWallet* pwallet, int nThreads);
-/** Generate a new block, without valid proof-of-work */
-CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake);
+/** Generate a new block, without valid proof-of-work; proof-of-stake blocks spend pStakeKernel at nStakeTime */
+CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake, const CStakeKernelInput* pStakeKernel = nullptr, unsigned int nStakeTime = 0);
+/** Kernel stage of the stake miner: find a kernel for the block after pindexPrev before any template is built */
+bool SearchStakeKernel(CWallet* pwallet, CBlockIndex* pindexPrev, CStakeSearch& search, CStakeKernelInput& kernelRet, unsigned int& nTimeRet);
 CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey, CWallet* pwallet);
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
@@ -0,0 +1,89 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MPSCQUEUE_H
+#define BITCOIN_MPSCQUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/**
+ * Bounded lock-free queue for many producers and one consumer, on a ring of
+ * slots that each carry a sequence number (after Dmitry Vyukov's bounded
+ * queue). Producers claim a slot with a compare and swap on the tail and
+ * publish it by advancing its sequence, so no producer ever waits on another
+ * or on the consumer; a full queue is reported instead. Elements come out in
+ * the order their slots were claimed.
+ */
+template <typename T>
+class CMPSCQueue
+{
+private:
+    struct Slot {
+        std::atomic<size_t> nSequence;
+        T value;
+    };
+
+    std::vector<Slot> vSlots;
+    size_t nMask;
+    std::atomic<size_t> nTail;
+    //! only touched by the consumer
+    size_t nHead;
+
+public:
+    //! nCapacity is rounded up to a power of two
+    CMPSCQueue(size_t nCapacity) : nTail(0), nHead(0)
+    {
+        size_t nSize = 2;
+        while (nSize < nCapacity)
+            nSize <<= 1;
+        std::vector<Slot> vSlotsIn(nSize);
+        vSlots.swap(vSlotsIn);
+        nMask = nSize - 1;
+        for (size_t i = 0; i < nSize; i++)
+            vSlots[i].nSequence.store(i, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return vSlots.size(); }
+
+    //! Move value into the queue; false, leaving value alone, if the queue is full
+    bool TryPush(T& value)
+    {
+        Slot* slot;
+        size_t nPos = nTail.load(std::memory_order_relaxed);
+        while (true) {
+            slot = &vSlots[nPos & nMask];
+            size_t nSequence = slot->nSequence.load(std::memory_order_acquire);
+            intptr_t nDiff = (intptr_t)nSequence - (intptr_t)nPos;
+            if (nDiff == 0) {
+                if (nTail.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (nDiff < 0) {
+                return false;
+            } else {
+                nPos = nTail.load(std::memory_order_relaxed);
+            }
+        }
+        std::swap(slot->value, value);
+        slot->nSequence.store(nPos + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! Move the oldest element out; false if there is none. Consumer thread only.
+    bool TryPop(T& value)
+    {
+        Slot& slot = vSlots[nHead & nMask];
+        if (slot.nSequence.load(std::memory_order_acquire) != nHead + 1)
+            return false;
+        std::swap(value, slot.value);
+        slot.nSequence.store(nHead + nMask + 1, std::memory_order_release);
+        nHead++;
+        return true;
+    }
+};
+
+#endif // BITCOIN_MPSCQUEUE_H
@@ -27,6 +27,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -34,6 +38,8 @@
 #include <miniupnpc/upnperrors.h>
 #endif
 
+#include <atomic>
+
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
@@ -62,11 +68,15 @@ namespace
 {
 const int MAX_OUTBOUND_CONNECTIONS = 16;
 
+//! How long the socket handler waits for socket events before doing housekeeping
+const int SOCKET_POLL_TIMEOUT_MS = 50;
+
 struct ListenSocket {
     SOCKET socket;
     bool whitelisted;
+    bool fReadable;
 
-    ListenSocket(SOCKET socket, bool whitelisted) : socket(socket), whitelisted(whitelisted) {}
+    ListenSocket(SOCKET socket, bool whitelisted) : socket(socket), whitelisted(whitelisted), fReadable(false) {}
 };
 }
 
@@ -83,6 +93,14 @@ static bool vfLimited[NET_MAX] = {};
 static CNode* pnodeLocalHost = NULL;
 uint64_t nLocalHostNonce = 0;
 static std::vector<ListenSocket> vhListenSocket;
+#ifdef HAVE_SYS_EPOLL_H
+//! Edge-triggered epoll set of all peer sockets, or -1 when select() is used
+static int hEpollSocket = -1;
+//! Self-pipe that interrupts epoll_wait() when data is queued for sending
+static int hWakeupPipe[2] = {-1, -1};
+static std::atomic<bool> fWakeupPending(false);
+static char chWakeupTag; // epoll_data.ptr of the wakeup pipe
+#endif
 CAddrMan addrman;
 int nMaxConnections = 125;
 bool fAddressesInitialized = false;
@@ -386,6 +404,65 @@ CNode* FindNode(const CService& addr)
     return NULL;
 }
 
+/** Set up the epoll set and wakeup pipe of the socket handler; select() stays in use if that fails */
+static void InitSocketEvents()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpollSocket != -1)
+        return;
+    hEpollSocket = epoll_create1(EPOLL_CLOEXEC);
+    if (hEpollSocket == -1) {
+        LogPrintf("%s : epoll_create1 failed: %s, using select()\n", __func__, NetworkErrorString(errno));
+        return;
+    }
+    struct epoll_event event;
+    if (pipe2(hWakeupPipe, O_NONBLOCK | O_CLOEXEC) == 0) {
+        event.events = EPOLLIN | EPOLLET;
+        event.data.ptr = &chWakeupTag;
+        epoll_ctl(hEpollSocket, EPOLL_CTL_ADD, hWakeupPipe[0], &event);
+    } else {
+        LogPrintf("%s : pipe2 failed: %s\n", __func__, NetworkErrorString(errno));
+        hWakeupPipe[0] = hWakeupPipe[1] = -1;
+    }
+    // Listen sockets stay level-triggered: one connection is accepted per wakeup
+    for (ListenSocket& hListenSocket : vhListenSocket) {
+        event.events = EPOLLIN;
+        event.data.ptr = &hListenSocket;
+        if (epoll_ctl(hEpollSocket, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0)
+            LogPrintf("%s : epoll_ctl failed for listen socket: %s\n", __func__, NetworkErrorString(errno));
+    }
+    LogPrintf("Using epoll for peer sockets\n");
+#endif
+}
+
+/** Add a new peer's socket to the epoll set (no-op with select()) */
+static void RegisterNodeSocket(CNode* pnode)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpollSocket == -1 || pnode->hSocket == INVALID_SOCKET)
+        return;
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(hEpollSocket, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("%s : epoll_ctl failed for peer=%d: %s\n", __func__, pnode->id, NetworkErrorString(errno));
+        pnode->fDisconnect = true;
+    }
+#endif
+}
+
+/** Interrupt the socket handler's wait, e.g. because data was queued for a peer */
+static void WakeSocketHandler()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (hWakeupPipe[1] == -1 || fWakeupPending.exchange(true))
+        return;
+    char c = 0;
+    if (write(hWakeupPipe[1], &c, 1) != 1)
+        fWakeupPending = false;
+#endif
+}
+
 CNode* ConnectNode(CAddress addrConnect, const char* pszDest, bool obfuScationMaster)
 {
     if (pszDest == NULL) {
@@ -425,6 +502,7 @@ CNode* ConnectNode(CAddress addrConnect, const char* pszDest, bool obfuScationMa
         // Add node
         CNode* pnode = new CNode(hSocket, addrConnect, pszDest ? pszDest : "", false);
         pnode->AddRef();
+        RegisterNodeSocket(pnode);
 
         {
             LOCK(cs_vNodes);
@@ -449,6 +527,12 @@ void CNode::CloseSocketDisconnect()
     fDisconnect = true;
     if (hSocket != INVALID_SOCKET) {
         LogPrint("net", "disconnecting peer=%d\n", id);
+#ifdef HAVE_SYS_EPOLL_H
+        // Remove explicitly: a copy of the descriptor inherited by a child
+        // process would otherwise keep it registered after close()
+        if (hEpollSocket != -1)
+            epoll_ctl(hEpollSocket, EPOLL_CTL_DEL, hSocket, NULL);
+#endif
         CloseSocket(hSocket);
     }
 
@@ -710,6 +794,201 @@ void SocketSendData(CNode* pnode)
 
 static list<CNode*> vNodesDisconnected;
 
+/**
+ * Whether to read more from a peer. If there is data to send, we first drain
+ * the write buffer before receiving more. This avoids needlessly queueing
+ * received data if the remote peer is not itself receiving, and so properly
+ * uses TCP flow control signalling. Otherwise we read as long as there is no
+ * complete message in the receive buffer, or there is space left in it.
+ * Together, at least one of the following is always possible, so we don't
+ * deadlock:
+ * - We send some data.
+ * - We wait for data to be received (and disconnect after timeout).
+ * - We process a message in the buffer (message handler thread).
+ */
+static bool IsReceiveBufferOpen(CNode* pnode)
+{
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (lockSend && !pnode->vSendMsg.empty())
+            return false;
+    }
+    AssertLockHeld(pnode->cs_vRecvMsg);
+    return pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+           pnode->GetTotalRecvSize() <= ReceiveFloodSize();
+}
+
+/** Wait for socket readiness with select() and mark the ready sockets */
+static void WaitSocketEventsSelect()
+{
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = SOCKET_POLL_TIMEOUT_MS * 1000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes) {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend && !pnode->vSendMsg.empty()) {
+                    FD_SET(pnode->hSocket, &fdsetSend);
+                    continue;
+                }
+            }
+            {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (lockRecv && IsReceiveBufferOpen(pnode))
+                    FD_SET(pnode->hSocket, &fdsetRecv);
+            }
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+        &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    boost::this_thread::interruption_point();
+
+    if (nSelect == SOCKET_ERROR) {
+        if (have_fds) {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        MilliSleep(timeout.tv_usec / 1000);
+    }
+
+    for (ListenSocket& hListenSocket : vhListenSocket)
+        hListenSocket.fReadable = hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv);
+
+    LOCK(cs_vNodes);
+    for (CNode* pnode : vNodes) {
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        pnode->fSocketReadable = FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError);
+        pnode->fSocketWritable = FD_ISSET(pnode->hSocket, &fdsetSend);
+    }
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/**
+ * Wait for epoll events and mark the sockets they report. Peer sockets are
+ * edge-triggered, so their flags stay set until a recv() or send() on them
+ * would block. Nodes are only deleted by this thread, after their socket
+ * left the epoll set, so the CNode pointers in the events are always valid.
+ */
+static void WaitSocketEventsEpoll()
+{
+    static const int MAX_EVENTS = 256;
+    struct epoll_event events[MAX_EVENTS];
+    int nEvents = epoll_wait(hEpollSocket, events, MAX_EVENTS, SOCKET_POLL_TIMEOUT_MS);
+    boost::this_thread::interruption_point();
+
+    if (nEvents < 0) {
+        if (errno != EINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+            MilliSleep(SOCKET_POLL_TIMEOUT_MS);
+        }
+        return;
+    }
+
+    for (ListenSocket& hListenSocket : vhListenSocket)
+        hListenSocket.fReadable = false;
+
+    for (int i = 0; i < nEvents; i++) {
+        void* ptr = events[i].data.ptr;
+        if (ptr == &chWakeupTag) {
+            fWakeupPending = false;
+            char buf[64];
+            while (read(hWakeupPipe[0], buf, sizeof(buf)) > 0) {
+            }
+            continue;
+        }
+
+        bool fListenSocket = false;
+        for (ListenSocket& hListenSocket : vhListenSocket) {
+            if (ptr == &hListenSocket) {
+                hListenSocket.fReadable = true;
+                fListenSocket = true;
+                break;
+            }
+        }
+        if (fListenSocket)
+            continue;
+
+        CNode* pnode = static_cast<CNode*>(ptr);
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+            pnode->fSocketReadable = true;
+        if (events[i].events & EPOLLOUT)
+            pnode->fSocketWritable = true;
+    }
+}
+#endif
+
+/**
+ * Receive from a peer whose socket was reported readable. With edge-triggered
+ * epoll, keep reading until the socket would block or the receive buffer is
+ * full; in the latter case fSocketReadable stays set and reading resumes on
+ * a later pass.
+ */
+static void SocketRecvData(CNode* pnode, bool fEdgeTriggered)
+{
+    while (pnode->hSocket != INVALID_SOCKET) {
+        if (fEdgeTriggered && !IsReceiveBufferOpen(pnode))
+            return;
+
+        // typical socket buffer is 8K-64K
+        char pchBuf[0x10000];
+        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+        if (nBytes > 0) {
+            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+                pnode->CloseSocketDisconnect();
+            pnode->nLastRecv = GetTime();
+            pnode->nRecvBytes += nBytes;
+            pnode->RecordBytesRecv(nBytes);
+        } else if (nBytes == 0) {
+            // socket closed gracefully
+            if (!pnode->fDisconnect)
+                LogPrint("net", "socket closed\n");
+            pnode->CloseSocketDisconnect();
+        } else if (nBytes < 0) {
+            // error
+            int nErr = WSAGetLastError();
+            if (nErr == WSAEWOULDBLOCK) {
+                pnode->fSocketReadable = false;
+            } else if (nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
+                if (!pnode->fDisconnect)
+                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+                pnode->CloseSocketDisconnect();
+            }
+        }
+        if (!fEdgeTriggered || nBytes <= 0)
+            return;
+    }
+}
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
@@ -776,88 +1055,23 @@ void ThreadSocketHandler()
         }
 
         //
-        // Find which sockets have data to receive
+        // Find which sockets are ready
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            for (CNode* pnode : vNodes) {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-            &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
-
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
-        }
+        bool fEdgeTriggered = false;
+#ifdef HAVE_SYS_EPOLL_H
+        fEdgeTriggered = hEpollSocket != -1;
+        if (fEdgeTriggered)
+            WaitSocketEventsEpoll();
+        else
+#endif
+            WaitSocketEventsSelect();
 
         //
         // Accept new connections
         //
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+        for (ListenSocket& hListenSocket : vhListenSocket) {
+            if (hListenSocket.socket != INVALID_SOCKET && hListenSocket.fReadable) {
+                hListenSocket.fReadable = false;
                 struct sockaddr_storage sockaddr;
                 socklen_t len = sizeof(sockaddr);
                 SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
@@ -880,7 +1094,7 @@ void ThreadSocketHandler()
                     int nErr = WSAGetLastError();
                     if (nErr != WSAEWOULDBLOCK)
                         LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
-                } else if (!IsSelectableSocket(hSocket)) {
+                } else if (!fEdgeTriggered && !IsSelectableSocket(hSocket)) {
                     LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
                     CloseSocket(hSocket);
                 } else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS) {
@@ -893,6 +1107,7 @@ void ThreadSocketHandler()
                     CNode* pnode = new CNode(hSocket, addr, "", true);
                     pnode->AddRef();
                     pnode->fWhitelisted = whitelisted;
+                    RegisterNodeSocket(pnode);
 
                     {
                         LOCK(cs_vNodes);
@@ -920,35 +1135,10 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
+            if (pnode->fSocketReadable) {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv) {
-                    {
-                        // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        if (nBytes > 0) {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
-                                pnode->CloseSocketDisconnect();
-                            pnode->nLastRecv = GetTime();
-                            pnode->nRecvBytes += nBytes;
-                            pnode->RecordBytesRecv(nBytes);
-                        } else if (nBytes == 0) {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect)
-                                LogPrint("net", "socket closed\n");
-                            pnode->CloseSocketDisconnect();
-                        } else if (nBytes < 0) {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
-                                if (!pnode->fDisconnect)
-                                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
-                }
+                if (lockRecv)
+                    SocketRecvData(pnode, fEdgeTriggered);
             }
 
             //
@@ -956,10 +1146,14 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
+            if (pnode->fSocketWritable) {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
+                if (lockSend && !pnode->vSendMsg.empty()) {
                     SocketSendData(pnode);
+                    // anything left means the socket would block: wait for the next EPOLLOUT
+                    if (!pnode->vSendMsg.empty())
+                        pnode->fSocketWritable = false;
+                }
             }
 
             //
@@ -1633,6 +1827,7 @@ void StartNode(boost::thread_group& threadGroup)
     MapPort(GetBoolArg("-upnp", DEFAULT_UPNP));
 
     // Send and receive from sockets, accept connections
+    InitSocketEvents();
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "net", &ThreadSocketHandler));
 
     // Initiate outbound connections from -addnode
@@ -1683,6 +1878,15 @@ public:
             if (hListenSocket.socket != INVALID_SOCKET)
                 if (!CloseSocket(hListenSocket.socket))
                     LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
+#ifdef HAVE_SYS_EPOLL_H
+        if (hEpollSocket != -1)
+            close(hEpollSocket);
+        if (hWakeupPipe[0] != -1) {
+            close(hWakeupPipe[0]);
+            close(hWakeupPipe[1]);
+        }
+        hEpollSocket = hWakeupPipe[0] = hWakeupPipe[1] = -1;
+#endif
 
         // clean up some globals (to help leak detection)
         for (CNode* pnode : vNodes)
@@ -1948,6 +2152,8 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     fNetworkNode = false;
     fSuccessfullyConnected = false;
     fDisconnect = false;
+    fSocketReadable = false;
+    fSocketWritable = false;
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
@@ -2074,5 +2280,11 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
     if (it == vSendMsg.begin())
         SocketSendData(this);
 
+    // Whatever could not be written right away is up to the socket handler
+    bool fWakeSocketHandler = !vSendMsg.empty();
+
     LEAVE_CRITICAL_SECTION(cs_vSend);
+
+    if (fWakeSocketHandler)
+        WakeSocketHandler();
 }
@@ -186,6 +186,8 @@ public:
 
     int64_t nTime; // time (in microseconds) of message receipt.
 
+    bool fSigChecked; // masternode signature already checked in a batch
+
     CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), vRecv(nTypeIn, nVersionIn)
     {
         hdrbuf.resize(24);
@@ -193,6 +195,7 @@ public:
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
+        fSigChecked = false;
     }
 
     bool complete() const
@@ -232,6 +235,9 @@ public:
     CCriticalSection cs_vRecvMsg;
     uint64_t nRecvBytes;
     int nRecvVersion;
+    // readiness of hSocket as last reported to the socket handler thread (only used by that thread)
+    bool fSocketReadable;
+    bool fSocketWritable;
 
     int64_t nLastSend;
     int64_t nLastRecv;
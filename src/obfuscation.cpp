@@ -2167,22 +2167,61 @@ bool CObfuScationSigner::SignMessage(std::string strMessage, std::string& errorM
     return true;
 }
 
-bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
+static uint256 GetMessageHash(const std::string& strMessage)
 {
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
+    return ss.GetHash();
+}
 
-    CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
+bool CObfuScationSigner::RecoverMessageKey(const vector<unsigned char>& vchSig, const std::string& strMessage, CKeyID& keyIDRet)
+{
+    uint256 hashMessage = GetMessageHash(strMessage);
+    uint256 hashEntry = Hash(hashMessage.begin(), hashMessage.end(), vchSig.begin(), vchSig.end());
+
+    {
+        LOCK(cs_cacheRecoveredKeys);
+        if (cacheRecoveredKeys.get(hashEntry, keyIDRet))
+            return true;
+    }
+
+    CPubKey pubkey;
+    if (!pubkey.RecoverCompact(hashMessage, vchSig))
+        return false;
+    keyIDRet = pubkey.GetID();
+
+    LOCK(cs_cacheRecoveredKeys);
+    cacheRecoveredKeys.insert(hashEntry, keyIDRet);
+    return true;
+}
+
+bool CObfuScationSigner::HasRecoveredKey(const vector<unsigned char>& vchSig, const std::string& strMessage)
+{
+    uint256 hashMessage = GetMessageHash(strMessage);
+    uint256 hashEntry = Hash(hashMessage.begin(), hashMessage.end(), vchSig.begin(), vchSig.end());
+    LOCK(cs_cacheRecoveredKeys);
+    return cacheRecoveredKeys.count(hashEntry) != 0;
+}
+
+void CObfuScationSigner::ClearRecoveredKeys()
+{
+    LOCK(cs_cacheRecoveredKeys);
+    cacheRecoveredKeys.clear();
+}
+
+bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
+{
+    CKeyID keyID;
+    if (!RecoverMessageKey(vchSig, strMessage, keyID)) {
         errorMessage = _("Error recovering public key.");
         return false;
     }
 
-    if (fDebug && pubkey2.GetID() != pubkey.GetID())
-        LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
+    if (fDebug && keyID != pubkey.GetID())
+        LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", keyID.ToString(), pubkey.GetID().ToString());
 
-    return (pubkey2.GetID() == pubkey.GetID());
+    return (keyID == pubkey.GetID());
 }
 
 bool CObfuscationQueue::Sign()
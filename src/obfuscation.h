@@ -10,6 +10,7 @@
 #include "masternode-payments.h"
 #include "masternode-sync.h"
 #include "masternodeman.h"
+#include "lrumap.h"
 #include "obfuscation-relay.h"
 #include "sync.h"
 
@@ -246,7 +247,17 @@ public:
  */
 class CObfuScationSigner
 {
+private:
+    //! Number of recovered message signers to remember
+    static const size_t RECOVERED_KEYS_CACHE_SIZE = 20000;
+
+    //! Signer recovered from Hash(message hash, signature)
+    lrumap<uint256, CKeyID> cacheRecoveredKeys;
+    CCriticalSection cs_cacheRecoveredKeys;
+
 public:
+    CObfuScationSigner() : cacheRecoveredKeys(RECOVERED_KEYS_CACHE_SIZE) {}
+
     /// Is the inputs associated with this public key? (and there is deposit esbcoin amount - checking if valid masternode)
     bool IsVinAssociatedWithPubkey(CTxIn& vin, CPubKey& pubkey);
     /// Set the private/public key values, returns true if successful
@@ -255,6 +266,12 @@ public:
     bool SetKey(std::string strSecret, std::string& errorMessage, CKey& key, CPubKey& pubkey);
     /// Sign the message, returns true if successful
     bool SignMessage(std::string strMessage, std::string& errorMessage, std::vector<unsigned char>& vchSig, CKey key);
+    /// Recover the key that signed the message; remembered so that checking the same signature again is cheap
+    bool RecoverMessageKey(const std::vector<unsigned char>& vchSig, const std::string& strMessage, CKeyID& keyIDRet);
+    /// Is the signer of this message signature already remembered?
+    bool HasRecoveredKey(const std::vector<unsigned char>& vchSig, const std::string& strMessage);
+    /// Forget all remembered signers
+    void ClearRecoveredKeys();
     /// Verify the message, returns true if succcessful
     bool VerifyMessage(CPubKey pubkey, std::vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage);
 };
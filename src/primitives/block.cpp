@@ -6,6 +6,7 @@
 
 #include "primitives/block.h"
 
+#include "crypto/sha256.h"
 #include "hash.h"
 #include "script/standard.h"
 #include "script/sign.h"
@@ -63,15 +64,17 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
     bool mutated = false;
     for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
     {
-        for (int i = 0; i < nSize; i += 2)
-        {
-            int i2 = std::min(i+1, nSize-1);
-            if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTree[j+i] == vMerkleTree[j+i2]) {
-                // Two identical hashes at the end of the list at a particular level.
-                mutated = true;
-            }
-            vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                        BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
+        if (nSize % 2 == 0 && vMerkleTree[j+nSize-2] == vMerkleTree[j+nSize-1]) {
+            // Two identical hashes at the end of the list at a particular level.
+            mutated = true;
+        }
+        // The pairs of a level are adjacent 64 byte blobs, hash them all in one batch
+        size_t nLevelEnd = vMerkleTree.size();
+        vMerkleTree.resize(nLevelEnd + (nSize + 1) / 2);
+        SHA256D64(vMerkleTree[nLevelEnd].begin(), vMerkleTree[j].begin(), nSize / 2);
+        if (nSize % 2) {
+            const uint256& last = vMerkleTree[j+nSize-1];
+            vMerkleTree.back() = Hash(BEGIN(last), END(last), BEGIN(last), END(last));
         }
         j += nSize;
     }
@@ -215,7 +218,7 @@ bool CBlock::SignBlock(const CKeyStore& keystore)
     return false;
 }
 
-bool CBlock::CheckBlockSignature() const
+bool CBlock::CheckBlockSignature(const uint256& hash) const
 {
     if (IsProofOfWork())
         return vchBlockSig.empty();
@@ -238,7 +241,7 @@ bool CBlock::CheckBlockSignature() const
         if (vchBlockSig.empty())
             return false;
 
-        return pubkey.Verify(GetHash(), vchBlockSig);
+        return pubkey.Verify(hash, vchBlockSig);
     }
     else if(whichType == TX_PUBKEYHASH)
     {
@@ -253,7 +256,7 @@ bool CBlock::CheckBlockSignature() const
         if (vchBlockSig.empty())
             return false;
 
-        return pubkey.Verify(GetHash(), vchBlockSig);
+        return pubkey.Verify(hash, vchBlockSig);
 
     }
 
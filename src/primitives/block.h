@@ -143,7 +143,9 @@ public:
     }
 
     bool SignBlock(const CKeyStore& keystore);
-    bool CheckBlockSignature() const;
+    bool CheckBlockSignature() const { return CheckBlockSignature(GetHash()); }
+    //! hash must be GetHash(), for callers that already have it
+    bool CheckBlockSignature(const uint256& hash) const;
 
     std::pair<COutPoint, unsigned int> GetProofOfStake() const
     {
@@ -161,10 +161,13 @@ CTxOut getPrevOut(const COutPoint& out)
 
 void getNextIn(const COutPoint& Out, uint256& Hash, unsigned int& n)
 {
-    // Hash = 0;
-    // n = 0;
-    // if (paddressmap)
-    //    paddressmap->ReadNextIn(Out, Hash, n);
+    Hash = 0;
+    n = 0;
+    CSpentIndexValue spent;
+    if (fAddressIndex && pblocktree->ReadSpentIndex(Out, spent)) {
+        Hash = spent.txid;
+        n = spent.inputIndex;
+    }
 }
 
 const CBlockIndex* getexplorerBlockIndex(int64_t height)
@@ -325,7 +328,7 @@ std::string TxToString(uint256 BlockHash, const CTransaction& tx)
         const CTxOut& Out = tx.vout[i];
         uint256 HashNext = uint256S("0");
         unsigned int nNext = 0;
-        bool fAddrIndex = false;
+        bool fAddrIndex = fAddressIndex;
         getNextIn(COutPoint(TxHash, i), HashNext, nNext);
         std::string OutputsContentCells[] =
             {
@@ -387,37 +390,35 @@ std::string AddressToString(const CBitcoinAddress& Address)
             _("Balance")};
     std::string TxContent = table + makeHTMLTableRow(TxLabels, sizeof(TxLabels) / sizeof(std::string));
 
-    std::set<COutPoint> PrevOuts;
-    /*
-    CScript AddressScript;
-    AddressScript.SetDestination(Address.Get());
+    if (!fAddressIndex)
+        return ""; // it will take too long to find transactions by address
 
-    CAmount Sum = 0;
-    bool fAddrIndex = false;
+    CScript AddressScript = GetScriptForDestination(Address.Get());
+    uint160 hashBytes;
+    GetAddressIndexHash(AddressScript, hashBytes);
 
-    if (!fAddrIndex)
-        return ""; // it will take too long to find transactions by address
-    else
-    {
-        std::vector<CDiskTxPos> Txs;
-        paddressmap->GetTxs(Txs, AddressScript.GetID());
-        for (const CDiskTxPos& pos : Txs)
-        {
-            CTransaction tx;
-            CBlock block;
-            uint256 bhash = block.GetHash();
-            GetTransaction(pos.nTxOffset, tx, bhash);
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(block.GetHash());
-            if (mi == mapBlockIndex.end())
-                continue;
-            CBlockIndex* pindex = (*mi).second;
-            if (!pindex || !chainActive.Contains(pindex))
-                continue;
-            std::string Prepend = "<a href=\"" + itostr(pindex->nHeight) + "\">" + TimeToString(pindex->nTime) + "</a>";
-            TxContent += TxToRow(tx, AddressScript, Prepend, &Sum);
-        }
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    if (!pblocktree->ReadAddressIndex(hashBytes, addressIndex))
+        return "";
+
+    CAmount Sum = 0;
+    std::set<uint256> setSeen;
+    for (const std::pair<CAddressIndexKey, CAmount>& entry : addressIndex) {
+        if (!setSeen.insert(entry.first.txhash).second)
+            continue;
+        CTransaction tx;
+        uint256 hashBlock;
+        if (!GetTransaction(entry.first.txhash, tx, hashBlock, true))
+            continue;
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi == mapBlockIndex.end())
+            continue;
+        CBlockIndex* pindex = (*mi).second;
+        if (!pindex || !chainActive.Contains(pindex))
+            continue;
+        std::string Prepend = "<a href=\"" + itostr(pindex->nHeight) + "\">" + TimeToString(pindex->nTime) + "</a>";
+        TxContent += TxToRow(tx, AddressScript, Prepend, &Sum);
     }
-    */
     TxContent += "</table>";
 
     std::string Content;
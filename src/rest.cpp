@@ -104,35 +104,36 @@ static bool rest_block(AcceptedConnection* conn,
     if (!ParseHashStr(hashStr, hash))
         throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
-    CBlock block;
-    CBlockIndex* pblockindex = NULL;
-    {
-        LOCK(cs_main);
-        if (mapBlockIndex.count(hash) == 0)
-            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
-
-        pblockindex = mapBlockIndex[hash];
-        if (!ReadBlockFromDisk(block, pblockindex))
-            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
-    }
-
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
+    // Stored blocks don't move, so none of this needs cs_main
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex || !(pblockindex->nStatus & BLOCK_HAVE_DATA))
+        throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
 
     switch (rf) {
     case RF_BINARY: {
-        string binaryBlock = ssBlock.str();
-        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, binaryBlock.size(), "application/octet-stream") << binaryBlock << std::flush;
+        // The bytes on disk are already the network serialization
+        CRawDataRef data;
+        if (!ReadRawBlockCached(data, pblockindex))
+            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, data->vch.size(), "application/octet-stream");
+        conn->stream().write((const char*)&data->vch[0], data->vch.size());
+        conn->stream() << std::flush;
         return true;
     }
 
     case RF_HEX: {
-        string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        CRawDataRef data;
+        if (!ReadRawBlockCached(data, pblockindex))
+            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+        string strHex = HexStr(data->vch.begin(), data->vch.end()) + "\n";
         conn->stream() << HTTPReply(HTTP_OK, strHex, fRun, false, "text/plain") << std::flush;
         return true;
     }
 
     case RF_JSON: {
+        CBlock block;
+        if (!ReadBlockCached(block, pblockindex))
+            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
         UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
         string strJSON = objBlock.write() + "\n";
         conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
@@ -51,12 +51,13 @@ double GetDifficulty(const CBlockIndex* blockindex)
 
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
 {
+    std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", block.GetHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    if (chain->Contains(blockindex))
+        confirmations = chain->Height() - blockindex->nHeight + 1;
     result.push_back(Pair("confirmations", confirmations));
     result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
     result.push_back(Pair("height", blockindex->nHeight));
@@ -80,7 +81,7 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
 
     if (blockindex->pprev)
         result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex* pnext = chainActive.Next(blockindex);
+    CBlockIndex* pnext = chain->Next(blockindex);
     if (pnext)
         result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
     return result;
@@ -112,7 +113,7 @@ UniValue getblockcount(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getblockcount", "") + HelpExampleRpc("getblockcount", ""));
 
-    return chainActive.Height();
+    return GetChainSnapshot()->Height();
 }
 
 UniValue getbestblockhash(const UniValue& params, bool fHelp)
@@ -126,7 +127,7 @@ UniValue getbestblockhash(const UniValue& params, bool fHelp)
             "\nExamples\n" +
             HelpExampleCli("getbestblockhash", "") + HelpExampleRpc("getbestblockhash", ""));
 
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    return GetChainSnapshot()->Tip()->GetBlockHash().GetHex();
 }
 
 UniValue getdifficulty(const UniValue& params, bool fHelp)
@@ -233,10 +234,10 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
             HelpExampleCli("getblockhash", "1000") + HelpExampleRpc("getblockhash", "1000"));
 
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height())
+    CBlockIndex* pblockindex = (*GetChainSnapshot())[nHeight];
+    if (!pblockindex)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
 
-    CBlockIndex* pblockindex = chainActive[nHeight];
     return pblockindex->GetBlockHash().GetHex();
 }
 
@@ -281,22 +282,23 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
+    // Runs without cs_main: see the threadSafe flag in the RPC table
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (!ReadBlockFromDisk(block, pblockindex))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
-
     if (!fVerbose) {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        // Hex of the bytes on disk, which are the network serialization
+        CRawDataRef data;
+        if (!ReadRawBlockCached(data, pblockindex))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+        return HexStr(data->vch.begin(), data->vch.end());
     }
 
+    CBlock block;
+    if (!ReadBlockCached(block, pblockindex))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
     return blockToJSON(block, pblockindex);
 }
 
@@ -623,6 +625,15 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
             "{\n"
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
+            "  \"sigcache\": {                (json object) Script signature cache\n"
+            "    \"entries\": xxxxx           (numeric) Cached signatures\n"
+            "    \"maxentries\": xxxxx        (numeric) Cache capacity in signatures\n"
+            "    \"bytes\": xxxxx             (numeric) Memory allocated for the cache\n"
+            "    \"hits\": xxxxx              (numeric) Lookups that found a cached signature\n"
+            "    \"misses\": xxxxx            (numeric) Lookups that had to verify the signature\n"
+            "    \"inserts\": xxxxx           (numeric) Signatures added to the cache\n"
+            "    \"evictions\": xxxxx         (numeric) Signatures dropped to make room\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getmempoolinfo", "") + HelpExampleRpc("getmempoolinfo", ""));
@@ -631,6 +642,18 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
     ret.push_back(Pair("size", (int64_t)mempool.size()));
     ret.push_back(Pair("bytes", (int64_t)mempool.GetTotalTxSize()));
 
+    CSignatureCacheStats sigcache;
+    GetSignatureCacheStats(sigcache);
+    UniValue sigcacheObj(UniValue::VOBJ);
+    sigcacheObj.push_back(Pair("entries", (uint64_t)sigcache.nEntries));
+    sigcacheObj.push_back(Pair("maxentries", (uint64_t)sigcache.nMaxEntries));
+    sigcacheObj.push_back(Pair("bytes", (uint64_t)sigcache.nBytes));
+    sigcacheObj.push_back(Pair("hits", (uint64_t)sigcache.nHits));
+    sigcacheObj.push_back(Pair("misses", (uint64_t)sigcache.nMisses));
+    sigcacheObj.push_back(Pair("inserts", (uint64_t)sigcache.nInserts));
+    sigcacheObj.push_back(Pair("evictions", (uint64_t)sigcache.nEvictions));
+    ret.push_back(Pair("sigcache", sigcacheObj));
+
     return ret;
 }
 
@@ -105,19 +105,36 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"autocombinerewards", 0},
     {"autocombinerewards", 1},
     {"obfuscation", 1},
+    {"getaddresstxids", 0},
+    {"getaddressbalance", 0},
+    {"getaddressutxos", 0},
+};
+
+/** Of the above, params that also take a bare string; only a JSON object is converted */
+static const CRPCConvertParam vRPCObjectOrStringParams[] = {
+    {"getaddresstxids", 0},
+    {"getaddressbalance", 0},
+    {"getaddressutxos", 0},
 };
 
 class CRPCConvertTable
 {
 private:
     std::set<std::pair<std::string, int> > members;
+    std::set<std::pair<std::string, int> > membersObjectOrString;
 
 public:
     CRPCConvertTable();
 
-    bool convert(const std::string& method, int idx)
+    bool convert(const std::string& method, int idx, const std::string& strVal)
     {
-        return (members.count(std::make_pair(method, idx)) > 0);
+        std::pair<std::string, int> key = std::make_pair(method, idx);
+        if (membersObjectOrString.count(key) > 0) {
+            size_t nStart = strVal.find_first_not_of(" \t\r\n");
+            if (nStart == std::string::npos || strVal[nStart] != '{')
+                return false;
+        }
+        return (members.count(key) > 0);
     }
 };
 
@@ -130,6 +147,14 @@ CRPCConvertTable::CRPCConvertTable()
         members.insert(std::make_pair(vRPCConvertParams[i].methodName,
             vRPCConvertParams[i].paramIdx));
     }
+
+    const unsigned int n_elem_object_or_string =
+        (sizeof(vRPCObjectOrStringParams) / sizeof(vRPCObjectOrStringParams[0]));
+
+    for (unsigned int i = 0; i < n_elem_object_or_string; i++) {
+        membersObjectOrString.insert(std::make_pair(vRPCObjectOrStringParams[i].methodName,
+            vRPCObjectOrStringParams[i].paramIdx));
+    }
 }
 
 static CRPCConvertTable rpcCvtTable;
@@ -155,7 +180,7 @@ UniValue RPCConvertValues(const std::string &strMethod, const std::vector<std::s
         const std::string& strVal = strParams[idx];
 
         // insert string value directly
-        if (!rpcCvtTable.convert(strMethod, idx)) {
+        if (!rpcCvtTable.convert(strMethod, idx, strVal)) {
             params.push_back(strVal);
         } else {
             // parse string as JSON, insert bool/number/object/etc. value
@@ -192,9 +192,21 @@ UniValue setgenerate(const UniValue& params, bool fHelp)
         unsigned int nExtraNonce = 0;
         UniValue blockHashes(UniValue::VARR);
         bool fPoS = nHeight >= Params().LAST_POW_BLOCK();
+        CStakeSearch stakeSearch;
         while (nHeight < nHeightEnd) {
+            CStakeKernelInput stakeKernel;
+            unsigned int nStakeTime = 0;
+            if (fPoS) {
+                CBlockIndex* pindexPrev = NULL;
+                {
+                    LOCK(cs_main);
+                    pindexPrev = chainActive.Tip();
+                }
+                if (!SearchStakeKernel(pwalletMain, pindexPrev, stakeSearch, stakeKernel, nStakeTime))
+                    throw JSONRPCError(RPC_INTERNAL_ERROR, "No stake kernel found");
+            }
             std::unique_ptr<CBlockTemplate> pblocktemplate(
-                fPoS ? CreateNewBlock(CScript(), pwalletMain, fPoS) : CreateNewBlockWithKey(reservekey, pwalletMain)
+                fPoS ? CreateNewBlock(CScript(), pwalletMain, fPoS, &stakeKernel, nStakeTime) : CreateNewBlockWithKey(reservekey, pwalletMain)
             );
             if (!pblocktemplate.get())
                 throw JSONRPCError(RPC_INTERNAL_ERROR, "Wallet keypool empty");
@@ -8,16 +8,19 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "blockcache.h"
 #include "clientversion.h"
 #include "init.h"
 #include "main.h"
 #include "masternode-sync.h"
+#include "memusage.h"
 #include "net.h"
 #include "netbase.h"
 #include "rpcserver.h"
 #include "spork.h"
 #include "gm.h"
 #include "timedata.h"
+#include "txdb.h"
 #include "util.h"
 #ifdef ENABLE_WALLET
 #include "wallet.h"
@@ -480,6 +483,264 @@ UniValue setmocktime(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+/** Bytes the block index entry used to carry for fields that are now derived or kept elsewhere (chain trust, proof-of-stake hash, mint) */
+static const size_t BLOCK_INDEX_REMOVED_FIELDS_SIZE = 2 * sizeof(uint256) + sizeof(int64_t);
+
+static UniValue RawDataCacheToJSON(const CRawDataCache& cache)
+{
+    CRawDataCacheStats stats = cache.GetStats();
+    uint64_t nLookups = stats.nHits + stats.nMisses;
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("entries", stats.nEntries));
+    obj.push_back(Pair("bytes", stats.nBytes));
+    obj.push_back(Pair("maxbytes", stats.nMaxBytes));
+    obj.push_back(Pair("hits", stats.nHits));
+    obj.push_back(Pair("misses", stats.nMisses));
+    obj.push_back(Pair("hitratio", nLookups ? (double)stats.nHits / nLookups : 0.0));
+    return obj;
+}
+
+UniValue getmemoryinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getmemoryinfo\n"
+            "\nReturns information about memory usage.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blockindex\": {           (json object) Block index\n"
+            "    \"entries\": xxxxx,       (numeric) Number of block index entries\n"
+            "    \"entrysize\": xxxxx,     (numeric) Size of one entry in bytes\n"
+            "    \"arena\": xxxxx,         (numeric) Bytes allocated for the entries\n"
+            "    \"map\": xxxxx,           (numeric) Bytes used by the hash to entry map\n"
+            "    \"arenasaved\": xxxxx     (numeric) Bytes saved by the arena and the dropped bnChainTrust, hashProofOfStake\n"
+            "                              and nMint fields, compared to one heap allocation per entry with them\n"
+            "  },\n"
+            "  \"blockcache\": {           (json object) Cache of recently served serialized blocks (-rawcachesize)\n"
+            "    \"entries\": xxxxx,       (numeric) Number of cached blocks\n"
+            "    \"bytes\": xxxxx,         (numeric) Memory used by the cached blocks\n"
+            "    \"maxbytes\": xxxxx,      (numeric) Memory the cache may use\n"
+            "    \"hits\": xxxxx,          (numeric) Lookups served from the cache\n"
+            "    \"misses\": xxxxx,        (numeric) Lookups that went to disk\n"
+            "    \"hitratio\": x.xxx       (numeric) Hits over all lookups\n"
+            "  },\n"
+            "  \"txcache\": {              (json object) Cache of recently looked up confirmed transactions, same fields\n"
+            "    ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getmemoryinfo", "") + HelpExampleRpc("getmemoryinfo", ""));
+
+    LOCK(cs_main);
+
+    size_t nEntries = blockIndexArena.size();
+    size_t nArena = blockIndexArena.DynamicMemoryUsage();
+    size_t nHeapLayout = nEntries * memusage::MallocUsage(sizeof(CBlockIndex) + BLOCK_INDEX_REMOVED_FIELDS_SIZE);
+
+    UniValue blockindex(UniValue::VOBJ);
+    blockindex.push_back(Pair("entries", (uint64_t)nEntries));
+    blockindex.push_back(Pair("entrysize", (uint64_t)sizeof(CBlockIndex)));
+    blockindex.push_back(Pair("arena", (uint64_t)nArena));
+    blockindex.push_back(Pair("map", (uint64_t)memusage::DynamicUsage(mapBlockIndex)));
+    blockindex.push_back(Pair("arenasaved", nHeapLayout > nArena ? (uint64_t)(nHeapLayout - nArena) : (uint64_t)0));
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("blockindex", blockindex));
+    obj.push_back(Pair("blockcache", RawDataCacheToJSON(rawBlockCache)));
+    obj.push_back(Pair("txcache", RawDataCacheToJSON(rawTxCache)));
+    return obj;
+}
+
+static void GetAddressIndexHashes(const UniValue& param, std::vector<std::pair<uint160, std::string> >& vHashes)
+{
+    std::vector<UniValue> vAddresses;
+    if (param.isStr()) {
+        vAddresses.push_back(param);
+    } else if (param.isObject()) {
+        UniValue addressValues = find_value(param.get_obj(), "addresses");
+        if (!addressValues.isArray())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses is expected to be an array");
+        vAddresses = addressValues.getValues();
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Expected an address or an object with an addresses array");
+    }
+
+    for (const UniValue& value : vAddresses) {
+        CBitcoinAddress address(value.get_str());
+        if (!address.IsValid())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + value.get_str());
+
+        uint160 hashBytes;
+        GetAddressIndexHash(GetScriptForDestination(address.Get()), hashBytes);
+        vHashes.push_back(std::make_pair(hashBytes, address.ToString()));
+    }
+}
+
+static bool HeightSort(const std::pair<CAddressUnspentKey, CAddressUnspentValue>& a, const std::pair<CAddressUnspentKey, CAddressUnspentValue>& b)
+{
+    return a.second.nHeight < b.second.nHeight;
+}
+
+UniValue getaddresstxids(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddresstxids {\"addresses\": [\"address\", ...], \"start\": n, \"end\": n}\n"
+            "\nReturns the txids for the given addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"addresses\"  (array, required) The esbcoin addresses\n"
+            "  \"start\"      (numeric, optional) The first block height to include\n"
+            "  \"end\"        (numeric, optional) The last block height to include\n"
+            "}\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"  (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}'") +
+            HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}"));
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, restart with -addressindex -reindex");
+
+    std::vector<std::pair<uint160, std::string> > vHashes;
+    GetAddressIndexHashes(params[0], vHashes);
+
+    int nStart = 0;
+    int nEnd = 0;
+    if (params[0].isObject()) {
+        UniValue startValue = find_value(params[0].get_obj(), "start");
+        UniValue endValue = find_value(params[0].get_obj(), "end");
+        if (startValue.isNum())
+            nStart = startValue.get_int();
+        if (endValue.isNum())
+            nEnd = endValue.get_int();
+        if (nStart < 0 || nEnd < 0 || (nEnd > 0 && nEnd < nStart))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start or end height");
+    }
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    for (const std::pair<uint160, std::string>& hash : vHashes) {
+        if (!pblocktree->ReadAddressIndex(hash.first, addressIndex, nStart, nEnd))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+
+    // entries of each address are sorted by height; merge them and drop duplicates
+    std::set<std::pair<int, uint256> > setTxids;
+    for (const std::pair<CAddressIndexKey, CAmount>& entry : addressIndex)
+        setTxids.insert(std::make_pair(entry.first.nHeight, entry.first.txhash));
+
+    UniValue result(UniValue::VARR);
+    for (const std::pair<int, uint256>& txid : setTxids)
+        result.push_back(txid.second.GetHex());
+
+    return result;
+}
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance {\"addresses\": [\"address\", ...]}\n"
+            "\nReturns the balance for the given addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"addresses\"  (array, required) The esbcoin addresses\n"
+            "}\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": x.xxx,   (numeric) The current balance\n"
+            "  \"received\": x.xxx   (numeric) The total amount received, including change\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}'") +
+            HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}"));
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, restart with -addressindex -reindex");
+
+    std::vector<std::pair<uint160, std::string> > vHashes;
+    GetAddressIndexHashes(params[0], vHashes);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    for (const std::pair<uint160, std::string>& hash : vHashes) {
+        if (!pblocktree->ReadAddressIndex(hash.first, addressIndex))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+
+    CAmount nBalance = 0;
+    CAmount nReceived = 0;
+    for (const std::pair<CAddressIndexKey, CAmount>& entry : addressIndex) {
+        if (entry.second > 0)
+            nReceived += entry.second;
+        nBalance += entry.second;
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", ValueFromAmount(nBalance)));
+    result.push_back(Pair("received", ValueFromAmount(nReceived)));
+
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos {\"addresses\": [\"address\", ...]}\n"
+            "\nReturns all unspent outputs for the given addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"addresses\"  (array, required) The esbcoin addresses\n"
+            "}\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"address\",  (string) The address\n"
+            "    \"txid\": \"hash\",        (string) The output txid\n"
+            "    \"outputIndex\": n,        (numeric) The output index\n"
+            "    \"script\": \"hex\",       (string) The script hex\n"
+            "    \"amount\": x.xxx,         (numeric) The output amount\n"
+            "    \"height\": n              (numeric) The block height\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}'") +
+            HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}"));
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, restart with -addressindex -reindex");
+
+    std::vector<std::pair<uint160, std::string> > vHashes;
+    GetAddressIndexHashes(params[0], vHashes);
+
+    UniValue result(UniValue::VARR);
+    for (const std::pair<uint160, std::string>& hash : vHashes) {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+        if (!pblocktree->ReadAddressUnspentIndex(hash.first, unspentOutputs))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+        std::sort(unspentOutputs.begin(), unspentOutputs.end(), HeightSort);
+
+        for (const std::pair<CAddressUnspentKey, CAddressUnspentValue>& output : unspentOutputs) {
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("address", hash.second));
+            entry.push_back(Pair("txid", output.first.txhash.GetHex()));
+            entry.push_back(Pair("outputIndex", (int)output.first.index));
+            entry.push_back(Pair("script", HexStr(output.second.script.begin(), output.second.script.end())));
+            entry.push_back(Pair("amount", ValueFromAmount(output.second.nValue)));
+            entry.push_back(Pair("height", output.second.nHeight));
+            result.push_back(entry);
+        }
+    }
+
+    return result;
+}
+
 #ifdef ENABLE_WALLET
 UniValue getstakingstatus(const UniValue& params, bool fHelp)
 {
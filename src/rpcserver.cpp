@@ -47,6 +47,10 @@ static map<string, boost::shared_ptr<deadline_timer> > deadlineTimers;
 static ssl::context* rpc_ssl_context = NULL;
 static boost::thread_group* rpc_worker_group = NULL;
 static boost::asio::io_service::work* rpc_dummy_work = NULL;
+//! Runs the elements of JSON-RPC batches; NULL when -rpcbatchthreads=0
+static asio::io_service* rpc_batch_service = NULL;
+static boost::asio::io_service::work* rpc_batch_work = NULL;
+static boost::thread_group* rpc_batch_group = NULL;
 static std::vector<CSubNet> rpc_allow_subnets; //!< List of subnets to allow RPC connections from
 static std::vector<boost::shared_ptr<ip::tcp::acceptor> > rpc_acceptors;
 
@@ -259,6 +263,7 @@ static const CRPCCommand vRPCCommands[] =
         //  --------------------- ------------------------  -----------------------  ---------- ---------- ---------
         /* Overall control/query calls */
         {"control", "getinfo", &getinfo, true, false, false}, /* uses wallet if enabled */
+        {"control", "getmemoryinfo", &getmemoryinfo, true, true, false},
         {"control", "help", &help, true, true, false},
         {"control", "stop", &stop, true, true, false},
 
@@ -273,10 +278,10 @@ static const CRPCCommand vRPCCommands[] =
 
         /* Block chain and UTXO */
         {"blockchain", "getblockchaininfo", &getblockchaininfo, true, false, false},
-        {"blockchain", "getbestblockhash", &getbestblockhash, true, false, false},
-        {"blockchain", "getblockcount", &getblockcount, true, false, false},
-        {"blockchain", "getblock", &getblock, true, false, false},
-        {"blockchain", "getblockhash", &getblockhash, true, false, false},
+        {"blockchain", "getbestblockhash", &getbestblockhash, true, true, false},
+        {"blockchain", "getblockcount", &getblockcount, true, true, false},
+        {"blockchain", "getblock", &getblock, true, true, false},
+        {"blockchain", "getblockhash", &getblockhash, true, true, false},
         {"blockchain", "getblockheader", &getblockheader, false, false, false},
         {"blockchain", "getchaintips", &getchaintips, true, false, false},
         {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
@@ -307,7 +312,7 @@ static const CRPCCommand vRPCCommands[] =
         {"rawtransactions", "createrawtransaction", &createrawtransaction, true, false, false},
         {"rawtransactions", "decoderawtransaction", &decoderawtransaction, true, false, false},
         {"rawtransactions", "decodescript", &decodescript, true, false, false},
-        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, false, false},
+        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, true, false},
         {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, false, false},
         {"rawtransactions", "signrawtransaction", &signrawtransaction, false, false, false}, /* uses wallet if enabled */
 
@@ -318,6 +323,11 @@ static const CRPCCommand vRPCCommands[] =
         {"util", "estimatefee", &estimatefee, true, true, false},
         {"util", "estimatepriority", &estimatepriority, true, true, false},
 
+        /* Address index */
+        {"addressindex", "getaddresstxids", &getaddresstxids, false, false, false},
+        {"addressindex", "getaddressbalance", &getaddressbalance, false, false, false},
+        {"addressindex", "getaddressutxos", &getaddressutxos, false, false, false},
+
         /* Not shown in help */
         {"hidden", "invalidateblock", &invalidateblock, true, true, false},
         {"hidden", "reconsiderblock", &reconsiderblock, true, true, false},
@@ -365,9 +375,9 @@ static const CRPCCommand vRPCCommands[] =
         {"wallet", "gettransaction", &gettransaction, false, false, true},
         {"wallet", "getunconfirmedbalance", &getunconfirmedbalance, false, false, true},
         {"wallet", "getwalletinfo", &getwalletinfo, false, false, true},
-        {"wallet", "importprivkey", &importprivkey, true, false, true},
+        {"wallet", "importprivkey", &importprivkey, true, true, true}, /* locks itself, so the rescan does not block the node */
         {"wallet", "importwallet", &importwallet, true, false, true},
-        {"wallet", "importaddress", &importaddress, true, false, true},
+        {"wallet", "importaddress", &importaddress, true, true, true}, /* locks itself, so the rescan does not block the node */
         {"wallet", "keypoolrefill", &keypoolrefill, true, false, true},
         {"wallet", "listaccounts", &listaccounts, false, false, true},
         {"wallet", "listaddressgroupings", &listaddressgroupings, false, false, true},
@@ -735,6 +745,16 @@ void StartRPCThreads()
     rpc_worker_group = new boost::thread_group();
     for (int i = 0; i < GetArg("-rpcthreads", 4); i++)
         rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+
+    int nBatchThreads = std::max(0, std::min((int)GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), MAX_RPC_BATCH_THREADS));
+    if (nBatchThreads > 0) {
+        rpc_batch_service = new asio::io_service();
+        rpc_batch_work = new asio::io_service::work(*rpc_batch_service);
+        rpc_batch_group = new boost::thread_group();
+        for (int i = 0; i < nBatchThreads; i++)
+            rpc_batch_group->create_thread(boost::bind(&asio::io_service::run, rpc_batch_service));
+        LogPrintf("Using %d threads for JSON-RPC batches\n", nBatchThreads);
+    }
     fRPCRunning = true;
 }
 
@@ -778,6 +798,19 @@ void StopRPCThreads()
     cvBlockChange.notify_all();
     if (rpc_worker_group != NULL)
         rpc_worker_group->join_all();
+
+    // Only now that no connection waits on a batch anymore
+    if (rpc_batch_service != NULL) {
+        delete rpc_batch_work;
+        rpc_batch_work = NULL;
+        rpc_batch_service->stop();
+        rpc_batch_group->join_all();
+        delete rpc_batch_group;
+        rpc_batch_group = NULL;
+        delete rpc_batch_service;
+        rpc_batch_service = NULL;
+    }
+
     delete rpc_dummy_work;
     rpc_dummy_work = NULL;
     delete rpc_worker_group;
@@ -896,9 +929,32 @@ static UniValue JSONRPCExecOne(const UniValue& req)
 
 static string JSONRPCExecBatch(const UniValue& vReq)
 {
+    std::vector<UniValue> vReplies(vReq.size());
+    if (rpc_batch_service && vReq.size() > 1) {
+        // Run the requests concurrently; replies keep the order of the batch
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        size_t nPending = vReq.size();
+        for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++) {
+            rpc_batch_service->post([&, reqIdx]() {
+                UniValue reply = JSONRPCExecOne(vReq[reqIdx]);
+                boost::unique_lock<boost::mutex> lock(mutex);
+                vReplies[reqIdx] = reply;
+                if (--nPending == 0)
+                    cond.notify_one();
+            });
+        }
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (nPending > 0)
+            cond.wait(lock);
+    } else {
+        for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
+            vReplies[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+    }
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    for (UniValue& reply : vReplies)
+        ret.push_back(reply);
 
     return ret.write() + "\n";
 }
@@ -1039,7 +1095,7 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
                     }
                     while (true) {
                         TRY_LOCK(pwalletMain->cs_wallet, lockWallet);
-                        if (!lockMain) {
+                        if (!lockWallet) {
                             MilliSleep(50);
                             continue;
                         }
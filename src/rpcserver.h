@@ -21,6 +21,10 @@
 
 #include <univalue.h>
 
+//! Maximum number of threads running the requests of a JSON-RPC batch
+static const int MAX_RPC_BATCH_THREADS = 16;
+//! -rpcbatchthreads default
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
 
 class CBlockIndex;
 class CNetAddr;
@@ -267,6 +271,10 @@ extern UniValue validateaddress(const UniValue& params, bool fHelp);
 extern UniValue createmultisig(const UniValue& params, bool fHelp);
 extern UniValue verifymessage(const UniValue& params, bool fHelp);
 extern UniValue setmocktime(const UniValue& params, bool fHelp);
+extern UniValue getmemoryinfo(const UniValue& params, bool fHelp);
+extern UniValue getaddresstxids(const UniValue& params, bool fHelp);
+extern UniValue getaddressbalance(const UniValue& params, bool fHelp);
+extern UniValue getaddressutxos(const UniValue& params, bool fHelp);
 extern UniValue getstakingstatus(const UniValue& params, bool fHelp);
 
 // in rest.cpp
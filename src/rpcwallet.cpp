@@ -1924,6 +1924,11 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
             "  \"keypoololdest\": xxxxxx,    (numeric) the timestamp (seconds since GMT epoch) of the oldest pre-generated key in the key pool\n"
             "  \"keypoolsize\": xxxx,        (numeric) how many new keys are pre-generated\n"
             "  \"unlocked_until\": ttt,      (numeric) the timestamp in seconds since epoch (midnight Jan 1 1970 GMT) that the wallet is unlocked for transfers, or 0 if the wallet is locked\n"
+            "  \"scanning\":                 (json object) current rescan progress, or false if no rescan is running\n"
+            "    {\n"
+            "      \"duration\" : xxxx       (numeric) elapsed seconds since the rescan started\n"
+            "      \"progress\" : x.xxxx     (numeric) rescan progress, from 0 to 1\n"
+            "    },\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getwalletinfo", "") + HelpExampleRpc("getwalletinfo", ""));
@@ -1936,6 +1941,14 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("keypoolsize", (int)pwalletMain->GetKeyPoolSize()));
     if (pwalletMain->IsCrypted())
         obj.push_back(Pair("unlocked_until", nWalletUnlockTime));
+    if (pwalletMain->fScanningWallet) {
+        UniValue scanning(UniValue::VOBJ);
+        scanning.push_back(Pair("duration", (GetTimeMillis() - pwalletMain->nScanStartTime) / 1000));
+        scanning.push_back(Pair("progress", pwalletMain->dScanProgress.load()));
+        obj.push_back(Pair("scanning", scanning));
+    } else {
+        obj.push_back(Pair("scanning", false));
+    }
     return obj;
 }
 
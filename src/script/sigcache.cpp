@@ -11,72 +11,193 @@
 #include "util.h"
 
 #include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
 
-namespace {
+void CSignatureCache::ComputeKey(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey, Key& key) const
+{
+    unsigned char digest[CSHA256::OUTPUT_SIZE];
+    CSHA256(hasherSalted).Write(hash.begin(), 32).Write(vchSig.data(), vchSig.size()).Write(pubKey.begin(), pubKey.size()).Finalize(digest);
+    memcpy(key.words, digest, sizeof(key.words));
+    // an all zero entry marks an empty slot
+    if (IsEmpty(key))
+        key.words[0] = 1;
+}
+
+bool CSignatureCache::IsEmpty(const Key& key)
+{
+    return !(key.words[0] | key.words[1] | key.words[2] | key.words[3]);
+}
+
+void CSignatureCache::Buckets(const Key& key, uint64_t& nBucket1, uint64_t& nBucket2) const
+{
+    nBucket1 = key.words[0] & nBucketMask;
+    nBucket2 = key.words[1] & nBucketMask;
+    if (nBucket1 == nBucket2)
+        nBucket2 ^= 1 & nBucketMask;
+}
 
-/**
- * Valid signature cache, to avoid doing expensive ECDSA signature checking
- * twice for every transaction (once when accepted into memory pool, and
- * again when accepted into the block chain)
- */
-class CSignatureCache
+void CSignatureCache::Load(const Entry& entry, Key& key)
 {
-private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_sigcache;
-
-public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
+    for (int i = 0; i < 4; i++)
+        key.words[i] = entry.words[i].load(std::memory_order_relaxed);
+}
+
+void CSignatureCache::Store(Entry& entry, const Key& key)
+{
+    for (int i = 0; i < 4; i++)
+        entry.words[i].store(key.words[i], std::memory_order_relaxed);
+}
+
+bool CSignatureCache::Matches(const Entry& entry, const Key& key) const
+{
+    // a slot that is being overwritten may be read torn, which cannot
+    // match unless both the old and the new entry share words with key
+    for (int i = 0; i < 4; i++) {
+        if (entry.words[i].load(std::memory_order_relaxed) != key.words[i])
+            return false;
+    }
+    return true;
+}
+
+bool CSignatureCache::Contains(const Key& key) const
+{
+    uint64_t nBucket1, nBucket2;
+    Buckets(key, nBucket1, nBucket2);
+    for (unsigned int i = 0; i < BUCKET_SIZE; i++) {
+        if (Matches(table[nBucket1 * BUCKET_SIZE + i], key) || Matches(table[nBucket2 * BUCKET_SIZE + i], key))
             return true;
-        return false;
     }
+    return false;
+}
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
+bool CSignatureCache::StoreEmpty(uint64_t nBucket, const Key& key)
+{
+    for (unsigned int i = 0; i < BUCKET_SIZE; i++) {
+        Entry& entry = table[nBucket * BUCKET_SIZE + i];
+        Key current;
+        Load(entry, current);
+        if (IsEmpty(current)) {
+            Store(entry, key);
+            nEntries++;
+            return true;
         }
+    }
+    return false;
+}
+
+CSignatureCache::CSignatureCache(uint64_t nMaxBytes)
+{
+    static_assert(sizeof(Entry) == SIG_CACHE_ENTRY_SIZE, "SIG_CACHE_ENTRY_SIZE must match the table entries");
+    nEntries = nHits = nMisses = nInserts = nEvictions = 0;
+
+    uint256 salt = GetRandHash();
+    hasherSalted.Write(salt.begin(), 32);
+
+    // round down to a power of two number of buckets
+    uint64_t nBuckets = 0;
+    if (nMaxBytes >= sizeof(Entry) * BUCKET_SIZE) {
+        nBuckets = 1;
+        while (nBuckets * 2 * sizeof(Entry) * BUCKET_SIZE <= nMaxBytes)
+            nBuckets *= 2;
+    }
+
+    nMaxEntries = nBuckets * BUCKET_SIZE;
+    nBucketMask = nBuckets ? nBuckets - 1 : 0;
+    if (nMaxEntries) {
+        table.reset(new Entry[nMaxEntries]);
+        for (uint64_t i = 0; i < nMaxEntries; i++)
+            for (int j = 0; j < 4; j++)
+                table[i].words[j].store(0, std::memory_order_relaxed);
+    }
+
+    LogPrintf("Using %d MiB for the signature cache, able to store %d elements\n", (nMaxEntries * sizeof(Entry)) >> 20, nMaxEntries);
+}
+
+bool CSignatureCache::Get(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+{
+    if (!nMaxEntries)
+        return false;
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+    Key key;
+    ComputeKey(hash, vchSig, pubKey, key);
+    if (Contains(key)) {
+        nHits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    nMisses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void CSignatureCache::Set(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+{
+    if (!nMaxEntries)
+        return;
+
+    Key key;
+    ComputeKey(hash, vchSig, pubKey, key);
+
+    boost::unique_lock<boost::mutex> lock(cs_sigcache);
+
+    if (Contains(key))
+        return;
+    nInserts++;
+
+    uint64_t nBucket1, nBucket2;
+    Buckets(key, nBucket1, nBucket2);
+    if (StoreEmpty(nBucket1, key) || StoreEmpty(nBucket2, key))
+        return;
+
+    // Both buckets are full: displace a random entry into its alternate
+    // bucket, and so on. Random because that helps foil would-be DoS
+    // attackers who might try to pre-generate and re-use a set of valid
+    // signatures just-slightly-greater than our cache size.
+    uint64_t nBucket = (insecure_rand() & 1) ? nBucket2 : nBucket1;
+    for (unsigned int nKick = 0; nKick < MAX_KICKS; nKick++) {
+        Entry& entry = table[nBucket * BUCKET_SIZE + insecure_rand() % BUCKET_SIZE];
+        Key displaced;
+        Load(entry, displaced);
+        Store(entry, key);
+        key = displaced;
+
+        uint64_t nAlt1, nAlt2;
+        Buckets(key, nAlt1, nAlt2);
+        nBucket = (nAlt1 == nBucket) ? nAlt2 : nAlt1;
+        if (StoreEmpty(nBucket, key))
+            return;
     }
-};
 
+    // the last displaced entry has nowhere to go
+    nEvictions++;
+}
+
+void CSignatureCache::GetStats(CSignatureCacheStats& stats)
+{
+    stats.nEntries = nEntries;
+    stats.nMaxEntries = nMaxEntries;
+    stats.nBytes = nMaxEntries * sizeof(Entry);
+    stats.nHits = nHits.load(std::memory_order_relaxed);
+    stats.nMisses = nMisses.load(std::memory_order_relaxed);
+    stats.nInserts = nInserts;
+    stats.nEvictions = nEvictions;
+}
+
+namespace {
+
+CSignatureCache& GetSignatureCache()
+{
+    static CSignatureCache signatureCache(std::max((int64_t)0, std::min(GetArg("-sigcachesize", DEFAULT_SIG_CACHE_SIZE), MAX_SIG_CACHE_SIZE)) << 20);
+    return signatureCache;
+}
+
+}
+
+void GetSignatureCacheStats(CSignatureCacheStats& stats)
+{
+    GetSignatureCache().GetStats(stats);
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    CSignatureCache& signatureCache = GetSignatureCache();
 
     if (signatureCache.Get(sighash, vchSig, pubkey))
         return true;
@@ -6,12 +6,94 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include "crypto/sha256.h"
 #include "script/interpreter.h"
 
+#include <atomic>
+#include <memory>
+#include <stdint.h>
 #include <vector>
 
+#include <boost/thread/mutex.hpp>
+
+//! -sigcachesize default (MiB)
+static const int64_t DEFAULT_SIG_CACHE_SIZE = 32;
+//! -sigcachesize maximum (MiB)
+static const int64_t MAX_SIG_CACHE_SIZE = 16384;
+//! Bytes per signature cache entry, to convert the old entry count -maxsigcachesize
+static const unsigned int SIG_CACHE_ENTRY_SIZE = 32;
+
 class CPubKey;
 
+struct CSignatureCacheStats {
+    uint64_t nEntries;
+    uint64_t nMaxEntries;
+    uint64_t nBytes;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nInserts;
+    uint64_t nEvictions;
+};
+
+/**
+ * Valid signature cache, to avoid doing expensive ECDSA signature checking
+ * twice for every transaction (once when accepted into memory pool, and
+ * again when accepted into the block chain)
+ *
+ * Entries are salted SHA256 hashes of (signature hash, signature, public key)
+ * kept in a fixed size table of 4-slot buckets. Every key has two candidate
+ * buckets and inserts displace entries cuckoo-style into their alternate
+ * bucket. Lookups only read atomics and never take a lock; inserts are
+ * serialized by cs_sigcache.
+ */
+class CSignatureCache
+{
+private:
+    static const unsigned int BUCKET_SIZE = 4;
+    static const unsigned int MAX_KICKS = 8;
+
+    struct Entry {
+        std::atomic<uint64_t> words[4];
+    };
+
+    struct Key {
+        uint64_t words[4];
+    };
+
+    //! salted hasher, the salt keeps the slot layout unpredictable to peers
+    CSHA256 hasherSalted;
+    std::unique_ptr<Entry[]> table;
+    uint64_t nBucketMask;
+    uint64_t nMaxEntries;
+    boost::mutex cs_sigcache;
+
+    std::atomic<uint64_t> nEntries;
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+    std::atomic<uint64_t> nInserts;
+    std::atomic<uint64_t> nEvictions;
+
+    void ComputeKey(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey, Key& key) const;
+    static bool IsEmpty(const Key& key);
+    void Buckets(const Key& key, uint64_t& nBucket1, uint64_t& nBucket2) const;
+    static void Load(const Entry& entry, Key& key);
+    static void Store(Entry& entry, const Key& key);
+    bool Matches(const Entry& entry, const Key& key) const;
+    bool Contains(const Key& key) const;
+    //! store key in an empty slot of nBucket, requires cs_sigcache
+    bool StoreEmpty(uint64_t nBucket, const Key& key);
+
+public:
+    //! Room for as many 4-slot buckets as fit in nMaxBytes, rounded down to a power of two
+    CSignatureCache(uint64_t nMaxBytes);
+
+    bool Get(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey);
+    void Set(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey);
+    void GetStats(CSignatureCacheStats& stats);
+};
+
+void GetSignatureCacheStats(CSignatureCacheStats& stats);
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
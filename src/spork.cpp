@@ -23,7 +23,7 @@ class CSporkManager;
 CSporkManager sporkManager;
 std::map<uint256, CSporkMessage> mapSporks;
 std::map<int, CSporkMessage> mapSporksActive;
-std::map<CBitcoinAddress, int64_t> mapFilterAddress; // address, timestamp lock from
+TxFilterMap mapTxFilter; // key or script id, timestamp lock from
 bool txFilterState = false;
 int txFilterTarget = 0;
 
@@ -102,6 +102,7 @@ int64_t GetSporkValue(int nSporkID)
         if (nSporkID == SPORK_9_TX_FILTERING_ENFORCEMENT) r = SPORK_9_TX_FILTERING_ENFORCEMENT_DEFAULT;
         if (nSporkID == SPORK_10_NEW_PROTOCOL_ENFORCEMENT_2) r = SPORK_10_NEW_PROTOCOL_ENFORCEMENT_2_DEFAULT;
         if (nSporkID == SPORK_11_DEV_FEE) r = SPORK_11_DEV_FEE_DEFAULT;
+        if (nSporkID == SPORK_12_MN_LAST_PAID_INDEX) r = SPORK_12_MN_LAST_PAID_INDEX_DEFAULT;
 
         if (r == -1) LogPrintf("GetSpork::Unknown Spork %d\n", nSporkID);
     }
@@ -121,6 +122,26 @@ void ExecuteSpork(int nSporkID, int64_t nValue)
     }
 }
 
+static bool GetTxFilterKey(const CTxDestination& dest, uint160& key)
+{
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        key = *keyID;
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        key = *scriptID;
+        return true;
+    }
+    return false;
+}
+
+static void AddTxFilterAddress(const CBitcoinAddress& address, int64_t nTime)
+{
+    uint160 key;
+    if (GetTxFilterKey(address.Get(), key))
+        mapTxFilter.emplace(key, nTime);
+}
+
 // TODO: create own class for the tx filter
 void InitTxFilter()
 {
@@ -2492,21 +2513,21 @@ void InitTxFilter()
         "eFgpgXwjDkkLBDcv9oPcXuxq5G1pwHDHox",
         "e9qbu4ajGFunL9SZZxvcSTmjy92AmkE76V"
     };
-    mapFilterAddress.clear();
+    mapTxFilter.clear();
 
     if (Params().NetworkID() == CBaseChainParams::MAIN) {
-        mapFilterAddress.emplace( CBitcoinAddress("e9S3j4pxUHZbKpQfBr5S9Th6W4j4E5kt8a"), 1545731364 );
-        mapFilterAddress.emplace( CBitcoinAddress("eLHLibXzYAiEt6deDncdftQtPZexvqGRRs"), 1545731364 );
-        mapFilterAddress.emplace( CBitcoinAddress("eLfE1zix91aELLEJPAXk3kTd92dpCQzd51"), 1545731364 );
-        mapFilterAddress.emplace( CBitcoinAddress("eD8T1WM1mu4F9ePG8ErEqmpvxFvvvwoz3K"), 1545731364 );
-        mapFilterAddress.emplace( CBitcoinAddress("e7qhxWqMRz3wNL1BdsoL4CD1xAKHkvuazf"), 1553500000 ); // lost user vallet, refunded by dev
-        //mapFilterAddress.emplace( CBitcoinAddress("e3pLAavfqQ8qa6nmBZgreweX5DTqxYUDTn"), 1572345688 ); // lost user vallet, refunded by dev
-        //mapFilterAddress.emplace( CBitcoinAddress("eDQsNi1Y5Tks5c1Mp9HHam7ezW2FRxgJaE"), 1575128248 ); // stolen coins
+        AddTxFilterAddress( CBitcoinAddress("e9S3j4pxUHZbKpQfBr5S9Th6W4j4E5kt8a"), 1545731364 );
+        AddTxFilterAddress( CBitcoinAddress("eLHLibXzYAiEt6deDncdftQtPZexvqGRRs"), 1545731364 );
+        AddTxFilterAddress( CBitcoinAddress("eLfE1zix91aELLEJPAXk3kTd92dpCQzd51"), 1545731364 );
+        AddTxFilterAddress( CBitcoinAddress("eD8T1WM1mu4F9ePG8ErEqmpvxFvvvwoz3K"), 1545731364 );
+        AddTxFilterAddress( CBitcoinAddress("e7qhxWqMRz3wNL1BdsoL4CD1xAKHkvuazf"), 1553500000 ); // lost user vallet, refunded by dev
+        //AddTxFilterAddress( CBitcoinAddress("e3pLAavfqQ8qa6nmBZgreweX5DTqxYUDTn"), 1572345688 ); // lost user vallet, refunded by dev
+        //AddTxFilterAddress( CBitcoinAddress("eDQsNi1Y5Tks5c1Mp9HHam7ezW2FRxgJaE"), 1575128248 ); // stolen coins
         for (auto item : pba)
-            mapFilterAddress.emplace( CBitcoinAddress(item), 1609459200 );
+            AddTxFilterAddress( CBitcoinAddress(item), 1609459200 );
 
     } else if (Params().NetworkID() == CBaseChainParams::TESTNET) {
-        mapFilterAddress.emplace( CBitcoinAddress("xQpcdxugd9qdMGq93vvC5CpKF3pUo8bEg1"), 1552518900 ); // testing
+        AddTxFilterAddress( CBitcoinAddress("xQpcdxugd9qdMGq93vvC5CpKF3pUo8bEg1"), 1552518900 ); // testing
     }
 }
 
@@ -2517,6 +2538,7 @@ void BuildTxFilter()
     InitTxFilter();
     CBitcoinAddress Address;
     CTxDestination Dest;
+    uint160 key;
 
     CBlock referenceBlock;
     uint64_t sporkBlockValue = (GetSporkValue(SPORK_9_TX_FILTERING_ENFORCEMENT) >> 32) & 0xffffffff; // 32-bit block number
@@ -2540,9 +2562,10 @@ void BuildTxFilter()
             if (((sporkMask >> i) & 0x1) != 0) {
                 for (unsigned int j = 0; j < referenceBlock.vtx[i].vout.size(); j++) {
                     if (referenceBlock.vtx[i].vout[j].nValue > 0) {
-                        ExtractDestination(referenceBlock.vtx[i].vout[j].scriptPubKey, Dest);
+                        if (!ExtractDestination(referenceBlock.vtx[i].vout[j].scriptPubKey, Dest) || !GetTxFilterKey(Dest, key))
+                            continue;
                         Address.Set(Dest);
-                        auto it  = mapFilterAddress.emplace(Address, referenceBlock.GetBlockTime());
+                        auto it  = mapTxFilter.emplace(key, referenceBlock.GetBlockTime());
                         nAddressCount++;
                         if (fDebug && it.second)
                             LogPrintf("BuildTxFilter(): Add Tx filter address %d in reference block %ld, %s\n",
@@ -2557,6 +2580,26 @@ void BuildTxFilter()
     }
 }
 
+bool IsTxFilterScript(const CScript& scriptPubKey, const int64_t nBlockTime, CBitcoinAddress& addressRet)
+{
+    txnouttype txType;
+    vector<CTxDestination> vDest;
+    int nRequiredRet;
+    uint160 key;
+    if (!ExtractDestinations(scriptPubKey, txType, vDest, nRequiredRet))
+        return false;
+    for (const CTxDestination& txDest : vDest) {
+        if (!GetTxFilterKey(txDest, key))
+            continue;
+        TxFilterMap::const_iterator it = mapTxFilter.find(key);
+        if (it != mapTxFilter.end() && (nBlockTime == 0 || nBlockTime > it->second)) {
+            addressRet.Set(txDest);
+            return true;
+        }
+    }
+    return false;
+}
+
 void ReprocessBlocks(int nBlocks)
 {
     std::map<uint256, int64_t>::iterator it = mapRejectedBlocks.begin();
@@ -2680,6 +2723,7 @@ int CSporkManager::GetSporkIDByName(std::string strName)
     if (strName == "SPORK_9_TX_FILTERING_ENFORCEMENT") return SPORK_9_TX_FILTERING_ENFORCEMENT;
     if (strName == "SPORK_10_NEW_PROTOCOL_ENFORCEMENT_2") return SPORK_10_NEW_PROTOCOL_ENFORCEMENT_2;
     if (strName == "SPORK_11_DEV_FEE") return SPORK_11_DEV_FEE;
+    if (strName == "SPORK_12_MN_LAST_PAID_INDEX") return SPORK_12_MN_LAST_PAID_INDEX;
 
     return -1;
 }
@@ -2697,6 +2741,7 @@ std::string CSporkManager::GetSporkNameByID(int id)
     if (id == SPORK_9_TX_FILTERING_ENFORCEMENT) return "SPORK_9_TX_FILTERING_ENFORCEMENT";
     if (id == SPORK_10_NEW_PROTOCOL_ENFORCEMENT_2) return "SPORK_10_NEW_PROTOCOL_ENFORCEMENT_2";
     if (id == SPORK_11_DEV_FEE) return "SPORK_11_DEV_FEE";
+    if (id == SPORK_12_MN_LAST_PAID_INDEX) return "SPORK_12_MN_LAST_PAID_INDEX";
 
     return "Unknown";
 }
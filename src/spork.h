@@ -27,7 +27,7 @@ using namespace boost;
     - This would result in old clients getting confused about which spork is for what
 */
 #define SPORK_START 10001
-#define SPORK_END 10011
+#define SPORK_END 10012
 
 #define SPORK_1_SWIFTTX 10001
 #define SPORK_2_SWIFTTX_BLOCK_FILTERING 10002
@@ -40,6 +40,7 @@ using namespace boost;
 #define SPORK_9_TX_FILTERING_ENFORCEMENT 10009
 #define SPORK_10_NEW_PROTOCOL_ENFORCEMENT_2 10010
 #define SPORK_11_DEV_FEE 10011
+#define SPORK_12_MN_LAST_PAID_INDEX 10012
 
 #define SPORK_1_SWIFTTX_DEFAULT 978307200                         //2001-1-1
 #define SPORK_2_SWIFTTX_BLOCK_FILTERING_DEFAULT 1424217600        //2015-2-18
@@ -55,6 +56,7 @@ using namespace boost;
                                                   //1552426200
 #define SPORK_10_NEW_PROTOCOL_ENFORCEMENT_2_DEFAULT 1554746400    // Monday, 08-Apr-19 18:00:00 UTC
 #define SPORK_11_DEV_FEE_DEFAULT 0                                // off
+#define SPORK_12_MN_LAST_PAID_INDEX_DEFAULT 4102444800            // off
 
 class CSporkMessage;
 class CSporkManager;
@@ -63,7 +65,13 @@ extern CSporkManager sporkManager;
 extern std::map<uint256, CSporkMessage> mapSporks;
 extern std::map<int, CSporkMessage> mapSporksActive;
 //extern std::set<CBitcoinAddress> setFilterAddress;
-extern std::map<CBitcoinAddress, int64_t> mapFilterAddress;
+
+struct TxFilterHasher {
+    size_t operator()(const uint160& hash) const { return hash.GetLow64(); }
+};
+/** Filtered key or script ids, and the timestamp their lock starts from */
+typedef boost::unordered_map<uint160, int64_t, TxFilterHasher> TxFilterMap;
+extern TxFilterMap mapTxFilter;
 extern bool txFilterState;
 extern int txFilterTarget;
 
@@ -74,6 +82,7 @@ void ExecuteSpork(int nSporkID, int64_t nValue);
 void ReprocessBlocks(int nBlocks);
 void InitTxFilter();
 void BuildTxFilter();
+bool IsTxFilterScript(const CScript& scriptPubKey, const int64_t nBlockTime, CBitcoinAddress& addressRet);
 
 //
 // Spork Class
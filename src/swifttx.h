@@ -75,6 +75,7 @@ public:
 
     uint256 GetHash() const;
 
+    std::string GetStrMessage() const;
     bool SignatureValid();
     bool Sign();
 
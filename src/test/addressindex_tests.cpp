@@ -0,0 +1,225 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "base58.h"
+#include "key.h"
+#include "main.h"
+#include "rpcserver.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "undo.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+extern UniValue CallRPC(std::string args);
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+static uint160 IndexHash(const CKey& key)
+{
+    uint160 hashBytes;
+    GetAddressIndexHash(GetScriptForDestination(key.GetPubKey().GetID()), hashBytes);
+    return hashBytes;
+}
+
+static std::vector<std::pair<CAddressIndexKey, CAmount> > ReadAddress(const CKey& key)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vect;
+    BOOST_CHECK(pblocktree->ReadAddressIndex(IndexHash(key), vect));
+    return vect;
+}
+
+static std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > ReadUnspent(const CKey& key)
+{
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vect;
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(IndexHash(key), vect));
+    return vect;
+}
+
+static std::string AddressesArg(const CKey& key)
+{
+    return "{\"addresses\":[\"" + CBitcoinAddress(key.GetPubKey().GetID()).ToString() + "\"]}";
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_connect_disconnect)
+{
+    bool fAddressIndexOld = fAddressIndex;
+    fAddressIndex = true;
+
+    CKey keyA, keyB;
+    keyA.MakeNewKey(true);
+    keyB.MakeNewKey(true);
+
+    // Funding transaction to A, confirmed at height 5
+    CMutableTransaction txPrev;
+    txPrev.vin.resize(1);
+    txPrev.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txPrev.vout.resize(1);
+    txPrev.vout[0].nValue = 50 * COIN;
+    txPrev.vout[0].scriptPubKey = GetScriptForDestination(keyA.GetPubKey().GetID());
+
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    view.ModifyCoins(txPrev.GetHash())->FromTx(txPrev, 5);
+    CAddressIndexUpdate updatePrev;
+    updatePrev.ConnectOutputs(txPrev, 5);
+    BOOST_CHECK(updatePrev.Write(*pblocktree, true));
+
+    // Block at height 10 with a coinbase and a spend from A to B
+    CMutableTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].prevout.SetNull();
+    txCoinBase.vin[0].scriptSig = CScript() << 10 << OP_0;
+    txCoinBase.vout.resize(1);
+    txCoinBase.vout[0].SetEmpty();
+
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(txPrev.GetHash(), 0);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = 40 * COIN;
+    txSpend.vout[0].scriptPubKey = GetScriptForDestination(keyB.GetPubKey().GetID());
+
+    CBlock block;
+    block.vtx.push_back(txCoinBase);
+    block.vtx.push_back(txSpend);
+
+    // What ConnectBlock does for the indexes and the coins
+    CAddressIndexUpdate update;
+    CBlockUndo blockundo;
+    CValidationState state;
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        if (!tx.IsCoinBase())
+            update.ConnectInputs(tx, view, 10);
+        update.ConnectOutputs(tx, 10);
+        CTxUndo undoDummy;
+        if (i > 0)
+            blockundo.vtxundo.push_back(CTxUndo());
+        UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), 10);
+    }
+    BOOST_CHECK(update.Write(*pblocktree, true));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressA = ReadAddress(keyA);
+    BOOST_REQUIRE_EQUAL(vAddressA.size(), 2U);
+    BOOST_CHECK(vAddressA[0].first.nHeight == 5 && !vAddressA[0].first.fSpending && vAddressA[0].second == 50 * COIN);
+    BOOST_CHECK(vAddressA[1].first.nHeight == 10 && vAddressA[1].first.fSpending && vAddressA[1].second == -50 * COIN);
+    BOOST_CHECK(vAddressA[1].first.txhash == txSpend.GetHash());
+    BOOST_CHECK(ReadUnspent(keyA).empty());
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspentB = ReadUnspent(keyB);
+    BOOST_REQUIRE_EQUAL(vUnspentB.size(), 1U);
+    BOOST_CHECK(vUnspentB[0].first.txhash == txSpend.GetHash() && vUnspentB[0].second.nValue == 40 * COIN && vUnspentB[0].second.nHeight == 10);
+    CSpentIndexValue spent;
+    BOOST_CHECK(pblocktree->ReadSpentIndex(txSpend.vin[0].prevout, spent));
+    BOOST_CHECK(spent.txid == txSpend.GetHash() && spent.inputIndex == 0 && spent.nHeight == 10);
+
+    // Result shapes of the address RPCs
+    UniValue r = CallRPC("getaddresstxids " + AddressesArg(keyA));
+    BOOST_REQUIRE_EQUAL(r.size(), 2U);
+    BOOST_CHECK_EQUAL(r[0].get_str(), txPrev.GetHash().GetHex());
+    BOOST_CHECK_EQUAL(r[1].get_str(), txSpend.GetHash().GetHex());
+    r = CallRPC("getaddressbalance " + AddressesArg(keyA));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "balance").get_real(), 0.0);
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "received").get_real(), 50.0);
+    r = CallRPC("getaddressutxos " + AddressesArg(keyB));
+    BOOST_REQUIRE_EQUAL(r.size(), 1U);
+    BOOST_CHECK_EQUAL(find_value(r[0].get_obj(), "address").get_str(), CBitcoinAddress(keyB.GetPubKey().GetID()).ToString());
+    BOOST_CHECK_EQUAL(find_value(r[0].get_obj(), "txid").get_str(), txSpend.GetHash().GetHex());
+    BOOST_CHECK_EQUAL(find_value(r[0].get_obj(), "outputIndex").get_int(), 0);
+    BOOST_CHECK_EQUAL(find_value(r[0].get_obj(), "amount").get_real(), 40.0);
+    BOOST_CHECK_EQUAL(find_value(r[0].get_obj(), "height").get_int(), 10);
+    BOOST_CHECK_THROW(CallRPC("getaddressbalance {\"addresses\":[\"notanaddress\"]}"), std::runtime_error);
+
+    // Undo data and index entries for DisconnectBlock
+    uint256 hashPrev = GetRandHash();
+    uint256 hashBlock = block.GetHash();
+    CBlockIndex indexPrev;
+    indexPrev.phashBlock = &hashPrev;
+    indexPrev.nHeight = 9;
+    CBlockIndex index;
+    index.phashBlock = &hashBlock;
+    index.pprev = &indexPrev;
+    index.nHeight = 10;
+    CDiskBlockPos posUndo(999, 0);
+    BOOST_REQUIRE(blockundo.WriteToDisk(posUndo, hashPrev));
+    index.nFile = posUndo.nFile;
+    index.nUndoPos = posUndo.nPos;
+    index.nStatus |= BLOCK_HAVE_UNDO;
+    view.SetBestBlock(hashBlock);
+
+    // VerifyDB style disconnect into a throwaway view leaves the indexes alone
+    {
+        CCoinsViewCache viewTmp(&view);
+        bool fClean = false;
+        BOOST_CHECK(DisconnectBlock(block, state, &index, viewTmp, &fClean));
+        BOOST_CHECK(fClean);
+        BOOST_CHECK_EQUAL(ReadAddress(keyA).size(), 2U);
+        BOOST_CHECK_EQUAL(ReadUnspent(keyB).size(), 1U);
+        BOOST_CHECK(pblocktree->ReadSpentIndex(txSpend.vin[0].prevout, spent));
+    }
+
+    // A real disconnect reverts them
+    BOOST_CHECK(DisconnectBlock(block, state, &index, view));
+    vAddressA = ReadAddress(keyA);
+    BOOST_REQUIRE_EQUAL(vAddressA.size(), 1U);
+    BOOST_CHECK(vAddressA[0].first.nHeight == 5 && vAddressA[0].second == 50 * COIN);
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspentA = ReadUnspent(keyA);
+    BOOST_REQUIRE_EQUAL(vUnspentA.size(), 1U);
+    BOOST_CHECK(vUnspentA[0].first.txhash == txPrev.GetHash() && vUnspentA[0].second.nValue == 50 * COIN && vUnspentA[0].second.nHeight == 5);
+    BOOST_CHECK(ReadAddress(keyB).empty());
+    BOOST_CHECK(ReadUnspent(keyB).empty());
+    BOOST_CHECK(!pblocktree->ReadSpentIndex(txSpend.vin[0].prevout, spent));
+    r = CallRPC("getaddressbalance " + AddressesArg(keyA));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "balance").get_real(), 50.0);
+
+    fAddressIndex = fAddressIndexOld;
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_same_block_spend)
+{
+    // An output created and spent in the same block never shows as unspent,
+    // and disconnecting the block leaves nothing behind
+    CKey key;
+    key.MakeNewKey(true);
+
+    CMutableTransaction txA;
+    txA.vin.resize(1);
+    txA.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txA.vout.resize(1);
+    txA.vout[0].nValue = 10 * COIN;
+    txA.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    CMutableTransaction txB;
+    txB.vin.resize(1);
+    txB.vin[0].prevout = COutPoint(txA.GetHash(), 0);
+    txB.vout.resize(1);
+    txB.vout[0].nValue = 9 * COIN;
+    txB.vout[0].scriptPubKey = CScript() << OP_RETURN;
+
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    view.ModifyCoins(txA.GetHash())->FromTx(txA, 20);
+
+    CAddressIndexUpdate connect;
+    connect.ConnectOutputs(txA, 20);
+    connect.ConnectInputs(txB, view, 20);
+    connect.ConnectOutputs(txB, 20);
+    BOOST_CHECK(connect.Write(*pblocktree, true));
+    BOOST_CHECK_EQUAL(ReadAddress(key).size(), 2U);
+    BOOST_CHECK(ReadUnspent(key).empty());
+
+    // DisconnectBlock order: transactions last to first, outputs before inputs
+    CAddressIndexUpdate disconnect;
+    disconnect.DisconnectOutputs(txB, 20);
+    disconnect.DisconnectInput(txB, 0, txA.vout[0], 20, 20);
+    disconnect.DisconnectOutputs(txA, 20);
+    BOOST_CHECK(disconnect.Write(*pblocktree, false));
+    BOOST_CHECK(ReadAddress(key).empty());
+    BOOST_CHECK(ReadUnspent(key).empty());
+    CSpentIndexValue spent;
+    BOOST_CHECK(!pblocktree->ReadSpentIndex(txB.vin[0].prevout, spent));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
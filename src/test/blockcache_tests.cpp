@@ -0,0 +1,84 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockcache_tests)
+
+static CRawDataRef MakeData(size_t nSize)
+{
+    std::shared_ptr<CRawData> data(new CRawData(uint256(1)));
+    data->vch.assign(nSize, 0x55);
+    return data;
+}
+
+BOOST_AUTO_TEST_CASE(rawdatacache_evicts_by_bytes)
+{
+    // One shard, so every entry competes for the same budget
+    CRawDataCache cache(1);
+    CRawDataRef data;
+    cache.Insert(uint256(1), MakeData(1000));
+    BOOST_CHECK(!cache.Get(uint256(1), data)); // disabled until it has a budget
+
+    cache.SetMaxBytes(4000);
+    cache.Insert(uint256(1), MakeData(1000));
+    cache.Insert(uint256(2), MakeData(1000));
+    cache.Insert(uint256(3), MakeData(1000));
+    BOOST_CHECK(cache.Get(uint256(1), data)); // 2 is now the least recently used
+    BOOST_CHECK_EQUAL(data->vch.size(), 1000U);
+    cache.Insert(uint256(4), MakeData(1000));
+    BOOST_CHECK(!cache.Get(uint256(2), data));
+    BOOST_CHECK(cache.Get(uint256(3), data));
+    BOOST_CHECK(cache.Get(uint256(4), data));
+
+    // Handed out entries outlive their eviction
+    cache.Erase(uint256(4));
+    BOOST_CHECK(!cache.Get(uint256(4), data) && data->vch.size() == 1000U);
+
+    // Too large to ever fit
+    cache.Insert(uint256(5), MakeData(4000));
+    BOOST_CHECK(!cache.Get(uint256(5), data));
+
+    CRawDataCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 2U);
+    BOOST_CHECK(stats.nBytes <= stats.nMaxBytes);
+    BOOST_CHECK_EQUAL(stats.nHits, 3U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 4U);
+
+    cache.SetMaxBytes(0);
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 0U);
+    cache.Insert(uint256(6), MakeData(10));
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.GetStats().nBytes, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(rawdatacache_generation)
+{
+    CRawDataCache cache(1);
+    cache.SetMaxBytes(4000);
+    CRawDataRef data;
+
+    // An insert of data read before an Erase() of the same shard is dropped
+    uint64_t nGeneration = cache.GetGeneration(uint256(1));
+    cache.Erase(uint256(1));
+    cache.Insert(uint256(1), MakeData(100), nGeneration);
+    BOOST_CHECK(!cache.Get(uint256(1), data));
+
+    nGeneration = cache.GetGeneration(uint256(1));
+    cache.Insert(uint256(1), MakeData(100), nGeneration);
+    BOOST_CHECK(cache.Get(uint256(1), data));
+    // inserts, replacements and evictions leave the generation alone
+    cache.Insert(uint256(2), MakeData(100));
+    cache.Insert(uint256(1), MakeData(200), nGeneration);
+    BOOST_CHECK(cache.Get(uint256(1), data) && data->vch.size() == 200U);
+    BOOST_CHECK_EQUAL(cache.GetGeneration(uint256(1)), nGeneration);
+
+    cache.Clear();
+    cache.Insert(uint256(1), MakeData(100), nGeneration);
+    BOOST_CHECK(!cache.Get(uint256(1), data));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
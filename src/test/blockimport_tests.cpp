@@ -0,0 +1,101 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "streams.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockimport_tests)
+
+static CBlock CreateBlock(uint32_t nNonce)
+{
+    CBlock block = Params().GenesisBlock();
+    block.nNonce = nNonce;
+    return block;
+}
+
+// magic, size and the serialized block, as WriteBlockToDisk lays them out
+static void AppendRecord(CDataStream& ss, const CBlock& block)
+{
+    ss << FLATDATA(Params().MessageStart()) << (unsigned int)::GetSerializeSize(block, SER_DISK, CLIENT_VERSION) << block;
+}
+
+static std::vector<std::pair<uint256, unsigned int> > ImportAll(const CDataStream& ss, int nWorkers)
+{
+    FILE* file = tmpfile();
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(&ss[0], 1, ss.size(), file), ss.size());
+    rewind(file);
+
+    std::vector<std::pair<uint256, unsigned int> > vBlocks;
+    CDiskBlockPos pos(0, 0);
+    CBlockImportPipeline pipeline(file, &pos, nWorkers);
+    boost::shared_ptr<CImportBlock> job;
+    while (pipeline.Next(job)) {
+        BOOST_CHECK(job->hash == job->block.GetHash());
+        BOOST_CHECK(job->fPreChecked);
+        vBlocks.push_back(std::make_pair(job->hash, job->pos.nPos));
+    }
+    return vBlocks;
+}
+
+BOOST_AUTO_TEST_CASE(blockimport_corrupted_record)
+{
+    CBlock blockA = CreateBlock(1);
+    CBlock blockB = CreateBlock(2);
+    CBlock blockC = CreateBlock(3);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    AppendRecord(ss, blockA);
+
+    // A record that does not deserialize (its transaction count is out of range) and whose
+    // size swallows the next record, so that only a rescan from its magic finds block B
+    CDataStream ssB(SER_DISK, CLIENT_VERSION);
+    AppendRecord(ssB, blockB);
+    std::vector<char> vCorrupt(80, 0);
+    vCorrupt.insert(vCorrupt.end(), 9, (char)0xff);
+    ss << FLATDATA(Params().MessageStart()) << (unsigned int)(vCorrupt.size() + ssB.size());
+    ss.write(&vCorrupt[0], vCorrupt.size());
+    unsigned int nPosB = ss.size() + MESSAGE_START_SIZE + sizeof(unsigned int);
+    ss.write(&ssB[0], ssB.size());
+
+    AppendRecord(ss, blockC);
+
+    // A record truncated by the end of the file
+    ss << FLATDATA(Params().MessageStart()) << (unsigned int)1000;
+    ss.write(&vCorrupt[0], 10);
+
+    for (int nWorkers = 1; nWorkers <= 4; nWorkers += 3) {
+        std::vector<std::pair<uint256, unsigned int> > vBlocks = ImportAll(ss, nWorkers);
+        BOOST_REQUIRE_EQUAL(vBlocks.size(), 3U);
+        BOOST_CHECK(vBlocks[0].first == blockA.GetHash());
+        BOOST_CHECK_EQUAL(vBlocks[0].second, MESSAGE_START_SIZE + sizeof(unsigned int));
+        BOOST_CHECK(vBlocks[1].first == blockB.GetHash());
+        BOOST_CHECK_EQUAL(vBlocks[1].second, nPosB);
+        BOOST_CHECK(vBlocks[2].first == blockC.GetHash());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockimport_truncated_file)
+{
+    // A file cut off in the middle of its last record yields the records before it
+    std::vector<CBlock> vBlocks;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    for (uint32_t i = 0; i < 20; i++) {
+        vBlocks.push_back(CreateBlock(i));
+        AppendRecord(ss, vBlocks.back());
+    }
+    ss.resize(ss.size() - 10);
+
+    std::vector<std::pair<uint256, unsigned int> > vImported = ImportAll(ss, 4);
+    BOOST_REQUIRE_EQUAL(vImported.size(), vBlocks.size() - 1);
+    for (unsigned int i = 0; i < vImported.size(); i++)
+        BOOST_CHECK(vImported[i].first == vBlocks[i].GetHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include "coins.h"
 #include "random.h"
+#include "txdb.h"
 #include "uint256.h"
 
 #include <vector>
@@ -58,6 +59,38 @@ public:
 
     bool GetStats(CCoinsStats& stats) const { return false; }
 };
+
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest() : CCoinsViewDB(1 << 20, true, true) {}
+
+    CLevelDBWrapper& GetDB() { return db; }
+
+    //! Number of per-output records in the database
+    unsigned int CountOutputRecords()
+    {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+        unsigned int nCount = 0;
+        for (pcursor->Seek(leveldb::Slice("C", 1)); pcursor->Valid() && pcursor->key()[0] == 'C'; pcursor->Next())
+            nCount++;
+        return nCount;
+    }
+};
+
+CCoins RandomCoins(unsigned int nOutputs)
+{
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = 1000 + insecure_rand() % 1000;
+    coins.fCoinStake = true;
+    coins.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        coins.vout[i].nValue = 1 + insecure_rand() % 100000;
+        coins.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, (unsigned char)i) << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+    return coins;
+}
 }
 
 BOOST_AUTO_TEST_SUITE(coins_tests)
@@ -175,4 +208,90 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+BOOST_AUTO_TEST_CASE(coins_db_per_output)
+{
+    CCoinsViewDBTest db;
+    uint256 txid = GetRandHash();
+    CCoins coins = RandomCoins(20);
+
+    {
+        CCoinsViewCache cache(&db);
+        *cache.ModifyCoins(txid) = coins;
+        BOOST_CHECK(cache.DynamicMemoryUsage() > memusage::DynamicUsage(coins.vout));
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    }
+    BOOST_CHECK_EQUAL(db.CountOutputRecords(), 20U);
+    CCoins read;
+    BOOST_CHECK(db.GetCoins(txid, read));
+    BOOST_CHECK(read == coins);
+    BOOST_CHECK(db.HaveCoins(txid));
+    BOOST_CHECK(!db.HaveCoins(GetRandHash()));
+
+    // Spending outputs only removes their records
+    {
+        CCoinsViewCache cache(&db);
+        size_t nUsage = cache.DynamicMemoryUsage();
+        {
+            CCoinsModifier entry = cache.ModifyCoins(txid);
+            BOOST_CHECK(entry->Spend(3));
+            BOOST_CHECK(entry->Spend(19));
+        }
+        BOOST_CHECK(cache.DynamicMemoryUsage() > nUsage);
+        BOOST_CHECK(cache.Flush());
+    }
+    coins.Spend(3);
+    coins.Spend(19);
+    BOOST_CHECK_EQUAL(db.CountOutputRecords(), 18U);
+    BOOST_CHECK(db.GetCoins(txid, read));
+    BOOST_CHECK(read == coins);
+
+    // Spending the rest removes the transaction
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier entry = cache.ModifyCoins(txid);
+            for (unsigned int i = 0; i < 20; i++)
+                entry->Spend(i);
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK_EQUAL(db.CountOutputRecords(), 0U);
+    BOOST_CHECK(!db.HaveCoins(txid));
+    BOOST_CHECK(!db.GetCoins(txid, read));
+}
+
+BOOST_AUTO_TEST_CASE(coins_db_upgrade)
+{
+    CCoinsViewDBTest db;
+    std::map<uint256, CCoins> legacy;
+    unsigned int nOutputs = 0;
+    for (unsigned int i = 0; i < 50; i++) {
+        CCoins coins = RandomCoins(1 + insecure_rand() % 30);
+        coins.fCoinStake = false;
+        coins.fCoinBase = i % 2;
+        coins.vout[insecure_rand() % coins.vout.size()].SetNull();
+        coins.Cleanup();
+        if (coins.IsPruned())
+            continue;
+        uint256 txid = GetRandHash();
+        BOOST_CHECK(db.GetDB().Write(std::make_pair('c', txid), coins));
+        for (unsigned int j = 0; j < coins.vout.size(); j++)
+            nOutputs += coins.IsAvailable(j);
+        legacy[txid] = coins;
+    }
+
+    BOOST_CHECK(db.Upgrade());
+    BOOST_CHECK_EQUAL(db.CountOutputRecords(), nOutputs);
+    for (std::map<uint256, CCoins>::iterator it = legacy.begin(); it != legacy.end(); it++) {
+        CCoins read;
+        BOOST_CHECK(!db.GetDB().Exists(std::make_pair('c', it->first)));
+        BOOST_CHECK(db.GetCoins(it->first, read));
+        BOOST_CHECK(read == it->second);
+    }
+    // A second run finds nothing left to convert
+    BOOST_CHECK(db.Upgrade());
+    BOOST_CHECK_EQUAL(db.CountOutputRecords(), nOutputs);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -9,6 +9,7 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "hash.h"
 #include "random.h"
 #include "utilstrencodings.h"
 
@@ -131,6 +132,43 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64) {
+    // the bytes 0x00 .. 0x3f
+    unsigned char in[64 * 32];
+    for (int j = 0; j < 64; ++j)
+        in[j] = j;
+    unsigned char out[32];
+    SHA256D64(out, in, 1);
+    BOOST_CHECK(std::vector<unsigned char>(out, out + 32) == ParseHex("01c9f464780a1b6af4eb400fe2f2896cfb2169f5a65701439e4c2c4e213903ef"));
+
+    // batches of every size up to and past the 8-way width, against the streaming hasher
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j)
+            in[j] = insecure_rand() & 0xff;
+        for (int j = 0; j < i; ++j)
+            CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256d1block) {
+    // messages of every length that fits a single block, in batches up to and past the 8-way width
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32], out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < i; ++j) {
+            size_t len = (j * 7 + i) % 56;
+            for (size_t k = 0; k < len; ++k)
+                in[64 * j + k] = insecure_rand() & 0xff;
+            CHash256().Write(in + 64 * j, len).Finalize(out1 + 32 * j);
+            SHA256Pad1Block(in + 64 * j, len);
+        }
+        SHA256D1Block(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -0,0 +1,200 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "kernel.h"
+#include "keystore.h"
+#include "random.h"
+#include "script/sign.h"
+#include "script/standard.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#define KERNEL_CHAIN_LENGTH 2000
+
+BOOST_AUTO_TEST_SUITE(kernel_tests)
+
+// The forward chain walk GetKernelStakeModifier() did before the index existed
+static const CBlockIndex* WalkModifierBlock(const CChain& chain, const CBlockIndex* pindexFrom, int64_t nInterval)
+{
+    int64_t nStakeModifierTime = pindexFrom->GetBlockTime();
+    const CBlockIndex* pindex = pindexFrom;
+    const CBlockIndex* pindexNext = chain[pindexFrom->nHeight + 1];
+    while (nStakeModifierTime < pindexFrom->GetBlockTime() + nInterval) {
+        if (!pindexNext)
+            return NULL;
+        pindex = pindexNext;
+        pindexNext = chain[pindexNext->nHeight + 1];
+        if (pindex->GeneratedStakeModifier())
+            nStakeModifierTime = pindex->GetBlockTime();
+    }
+    return pindex;
+}
+
+// Blocks 60 seconds apart with up to 5 minutes of timestamp jitter; about a third generate a modifier
+static void BuildChain(std::vector<CBlockIndex>& vIndex, CBlockIndex* pindexFork, unsigned int nTime)
+{
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        CBlockIndex* pprev = i ? &vIndex[i - 1] : pindexFork;
+        vIndex[i].nHeight = pprev ? pprev->nHeight + 1 : 0;
+        vIndex[i].pprev = pprev;
+        vIndex[i].nTime = nTime + vIndex[i].nHeight * 60 + insecure_rand() % 600 - 300;
+        vIndex[i].BuildSkip();
+        vIndex[i].SetStakeModifier(insecure_rand(), insecure_rand() % 3 == 0);
+    }
+}
+
+static void CheckIndex(const CStakeModifierIndex& index, const CChain& chain)
+{
+    const int64_t vInterval[] = {1, 60, 20 * 60, 3 * 60 * 60};
+    for (int nHeight = 0; nHeight <= chain.Height(); nHeight++) {
+        const CBlockIndex* pindexFrom = chain[nHeight];
+        for (unsigned int i = 0; i < sizeof(vInterval) / sizeof(vInterval[0]); i++) {
+            BOOST_CHECK(index.Find(nHeight, pindexFrom->GetBlockTime() + vInterval[i]) == WalkModifierBlock(chain, pindexFrom, vInterval[i]));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_modifier_index_matches_walk)
+{
+    std::vector<CBlockIndex> vMain(KERNEL_CHAIN_LENGTH);
+    BuildChain(vMain, NULL, 1500000000);
+
+    CChain chain;
+    CStakeModifierIndex index;
+    chain.SetTip(&vMain.back());
+    index.SetTip(&vMain.back());
+    CheckIndex(index, chain);
+
+    // connect one block at a time
+    chain.SetTip(NULL);
+    index.SetTip(NULL);
+    BOOST_CHECK_EQUAL(index.size(), 0U);
+    for (unsigned int i = 0; i < vMain.size(); i += 7) {
+        chain.SetTip(&vMain[i]);
+        index.SetTip(&vMain[i]);
+    }
+    chain.SetTip(&vMain.back());
+    index.SetTip(&vMain.back());
+    CheckIndex(index, chain);
+
+    // reorganize onto a longer fork and back
+    std::vector<CBlockIndex> vFork(KERNEL_CHAIN_LENGTH / 2);
+    BuildChain(vFork, &vMain[KERNEL_CHAIN_LENGTH * 3 / 4], 1500000000);
+    chain.SetTip(&vFork.back());
+    index.SetTip(&vFork.back());
+    CheckIndex(index, chain);
+
+    chain.SetTip(&vMain[KERNEL_CHAIN_LENGTH / 2]);
+    index.SetTip(&vMain[KERNEL_CHAIN_LENGTH / 2]);
+    CheckIndex(index, chain);
+
+    chain.SetTip(&vMain.back());
+    index.SetTip(&vMain.back());
+    CheckIndex(index, chain);
+}
+
+BOOST_AUTO_TEST_CASE(stake_kernel_hasher_matches_stake_hash)
+{
+    const unsigned int nHashDrift = 45;
+    int nHits = 0;
+    for (int i = 0; i < 200; i++) {
+        uint64_t nStakeModifier = ((uint64_t)insecure_rand() << 32) | insecure_rand();
+        unsigned int nTimeBlockFrom = 1500000000 + insecure_rand() % 1000000;
+        unsigned int nTimeTx = nTimeBlockFrom + insecure_rand() % 1000000;
+        COutPoint prevout(GetRandHash(), insecure_rand() % 10);
+        CAmount nValueIn = (1 + insecure_rand() % 10000) * COIN;
+        // targets from hitting on most timestamps to hitting on hardly any
+        uint256 bnTargetPerCoinDay = ~uint256(0) >> (28 + i % 16);
+
+        bool fExpected = false;
+        unsigned int nExpectedTime = 0;
+        uint256 hashExpected;
+        CDataStream ss(SER_GETHASH, 0);
+        ss << nStakeModifier;
+        for (unsigned int j = 0; j < nHashDrift; j++) {
+            unsigned int nTryTime = nTimeTx + nHashDrift - j;
+            uint256 hash = stakeHash(nTryTime, ss, prevout.n, prevout.hash, nTimeBlockFrom);
+            if (stakeTargetHit(hash, nValueIn, bnTargetPerCoinDay)) {
+                fExpected = true;
+                nExpectedTime = nTryTime;
+                hashExpected = hash;
+                break;
+            }
+        }
+
+        CStakeKernelHasher hasher(nStakeModifier, nTimeBlockFrom, prevout, nValueIn, bnTargetPerCoinDay);
+        unsigned int nTime = 0;
+        uint256 hash;
+        BOOST_CHECK_EQUAL(hasher.Search(nTimeTx, nHashDrift, nTime, hash), fExpected);
+        if (fExpected) {
+            BOOST_CHECK_EQUAL(nTime, nExpectedTime);
+            BOOST_CHECK(hash == hashExpected);
+            nHits++;
+        }
+    }
+    // both outcomes were exercised
+    BOOST_CHECK(nHits > 0 && nHits < 200);
+}
+
+// Block on the genesis block whose coinstake spends txFrom, signed with the keys in keystore
+static CBlock CreateStakeBlock(const CTransaction& txFrom, const CKeyStore& keystore)
+{
+    CMutableTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].prevout.SetNull();
+    txCoinBase.vout.resize(1);
+    txCoinBase.vout[0].SetEmpty();
+
+    CMutableTransaction txCoinStake;
+    txCoinStake.vin.resize(1);
+    txCoinStake.vin[0].prevout = COutPoint(txFrom.GetHash(), 0);
+    txCoinStake.vout.resize(2);
+    txCoinStake.vout[0].SetEmpty();
+    txCoinStake.vout[1] = txFrom.vout[0];
+    SignSignature(keystore, txFrom, txCoinStake, 0);
+
+    CBlock block;
+    block.hashPrevBlock = Params().HashGenesisBlock();
+    // the one block CheckProofOfStake accepts without a kernel hash, so the signature decides
+    block.nTime = 1554746413;
+    block.vtx.push_back(txCoinBase);
+    block.vtx.push_back(txCoinStake);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(proof_of_stake_checks_signature)
+{
+    CBasicKeyStore keystore, keystoreOther;
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    keystore.AddKey(key);
+    keystoreOther.AddKey(keyOther);
+
+    CMutableTransaction txFrom;
+    txFrom.vin.resize(1);
+    txFrom.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txFrom.vout.resize(1);
+    txFrom.vout[0].nValue = 100000 * COIN;
+    txFrom.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    LOCK(cs_main);
+    pcoinsTip->ModifyCoins(txFrom.GetHash())->FromTx(txFrom, 0);
+
+    uint256 hashProofOfStake;
+    CBlock blockSigned = CreateStakeBlock(txFrom, keystore);
+    BOOST_CHECK(CheckProofOfStake(blockSigned, blockSigned.GetHash(), hashProofOfStake));
+    CBlock blockOther = CreateStakeBlock(txFrom, keystoreOther);
+    BOOST_CHECK(!CheckProofOfStake(blockOther, blockOther.GetHash(), hashProofOfStake));
+    CBlock blockUnsigned = CreateStakeBlock(txFrom, CBasicKeyStore());
+    BOOST_CHECK(blockUnsigned.vtx[1].vin[0].scriptSig.empty());
+    BOOST_CHECK(!CheckProofOfStake(blockUnsigned, blockUnsigned.GetHash(), hashProofOfStake));
+
+    pcoinsTip->ModifyCoins(txFrom.GetHash())->Clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,79 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "lrumap.h"
+
+#include "random.h"
+
+#include <algorithm>
+#include <deque>
+
+#include <boost/test/unit_test.hpp>
+
+#define MAX_SIZE 20
+
+BOOST_AUTO_TEST_SUITE(lrumap_tests)
+
+BOOST_AUTO_TEST_CASE(lrumap_evicts_least_recently_used)
+{
+    lrumap<int, int> map(3);
+    map.insert(1, 10);
+    map.insert(2, 20);
+    map.insert(3, 30);
+    int v = 0;
+    BOOST_CHECK(map.get(1, v) && v == 10); // 2 is now the least recently used
+    map.insert(4, 40);
+    BOOST_CHECK_EQUAL(map.size(), 3U);
+    BOOST_CHECK(!map.count(2));
+    map.insert(3, 31); // replacing an element uses it
+    map.insert(5, 50);
+    BOOST_CHECK(!map.count(1));
+    BOOST_CHECK(map.get(3, v) && v == 31);
+    map.erase(3);
+    BOOST_CHECK(!map.get(3, v));
+    BOOST_CHECK_EQUAL(map.size(), 2U);
+    map.insert(6, 60);
+    BOOST_CHECK_EQUAL(map.back().first, 4);
+    map.pop_back();
+    BOOST_CHECK_EQUAL(map.size(), 2U);
+    BOOST_CHECK(!map.count(4));
+    map.max_size(1);
+    BOOST_CHECK_EQUAL(map.size(), 1U);
+    BOOST_CHECK(map.count(6));
+}
+
+// Compare against a deque kept in use order
+BOOST_AUTO_TEST_CASE(lrumap_random)
+{
+    lrumap<int, int> map(MAX_SIZE);
+    std::deque<std::pair<int, int> > model;
+    for (int i = 0; i < 10000; i++) {
+        int k = insecure_rand() % (MAX_SIZE * 2);
+        std::deque<std::pair<int, int> >::iterator it = model.begin();
+        while (it != model.end() && it->first != k)
+            ++it;
+        int v;
+        if (insecure_rand() % 2) {
+            bool fFound = map.get(k, v);
+            BOOST_CHECK_EQUAL(fFound, it != model.end());
+            if (it != model.end()) {
+                BOOST_CHECK_EQUAL(v, it->second);
+                std::pair<int, int> e = *it;
+                model.erase(it);
+                model.push_front(e);
+            }
+        } else {
+            v = insecure_rand();
+            map.insert(k, v);
+            if (it != model.end())
+                model.erase(it);
+            model.push_front(std::make_pair(k, v));
+            if (model.size() > MAX_SIZE)
+                model.pop_back();
+        }
+        BOOST_CHECK_EQUAL(map.size(), model.size());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,163 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "base58.h"
+#include "key.h"
+#include "main.h"
+#include "masternode-payments.h"
+#include "script/standard.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(masternode_payments_tests)
+
+static CScript RandomScript()
+{
+    CKey key;
+    key.MakeNewKey(true);
+    return GetScriptForDestination(key.GetPubKey().GetID());
+}
+
+// Proof of stake block whose coinstake pays the staker, the dev fee and the given masternodes,
+// with the staker's output split in two as CreateCoinStake does for large stakes
+static CBlock CreateBlock(const CScript& scriptStaker, const std::vector<CScript>& vPayees)
+{
+    CMutableTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].prevout.SetNull();
+    txCoinBase.vout.resize(1);
+    txCoinBase.vout[0].SetEmpty();
+
+    CMutableTransaction txCoinStake;
+    txCoinStake.vin.resize(1);
+    txCoinStake.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txCoinStake.vout.emplace_back(0, CScript());
+    txCoinStake.vout.emplace_back(100 * COIN, scriptStaker);
+    txCoinStake.vout.emplace_back(1 * COIN, GetScriptForDestination(CBitcoinAddress(Params().DevFeeAddress(true)).Get()));
+    for (const CScript& payee : vPayees)
+        txCoinStake.vout.emplace_back(5 * COIN, payee);
+    txCoinStake.vout.emplace_back(100 * COIN, scriptStaker);
+
+    CBlock block;
+    block.nTime = GetTime();
+    block.vtx.push_back(txCoinBase);
+    block.vtx.push_back(txCoinStake);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(last_paid_connect_disconnect)
+{
+    CMasternodePayments payments;
+    CScript scriptStaker = RandomScript();
+    CScript scriptMn1 = RandomScript();
+    CScript scriptMn2 = RandomScript();
+    CScript scriptDevFee = GetScriptForDestination(CBitcoinAddress(Params().DevFeeAddress(true)).Get());
+    int nHeight = Params().LAST_POW_BLOCK() + 10;
+
+    CBlockIndex index1;
+    index1.nHeight = nHeight;
+    index1.nTime = 1000;
+    CBlockIndex index2;
+    index2.pprev = &index1;
+    index2.nHeight = nHeight + 1;
+    index2.nTime = 2000;
+
+    CBlock block1 = CreateBlock(scriptStaker, {scriptMn1, scriptMn2});
+    CBlock block2 = CreateBlock(scriptStaker, {scriptMn1});
+
+    int64_t nTime;
+    BOOST_CHECK_EQUAL(payments.GetLastPaidIndexStart(), -1);
+    payments.ConnectBlockPayees(block1, &index1);
+    payments.ConnectBlockPayees(block2, &index2);
+    BOOST_CHECK_EQUAL(payments.GetLastPaidIndexStart(), nHeight);
+
+    // only the masternode outputs count as paid, not the staker or the dev fee
+    BOOST_CHECK(payments.GetLastPaidBlock(scriptMn1, 0, nHeight + 1, nTime) && nTime == 2000);
+    BOOST_CHECK(payments.GetLastPaidBlock(scriptMn1, 0, nHeight, nTime) && nTime == 1000);
+    BOOST_CHECK(!payments.GetLastPaidBlock(scriptMn1, nHeight + 2, nHeight + 5, nTime));
+    BOOST_CHECK(payments.GetLastPaidBlock(scriptMn2, 0, nHeight + 1, nTime) && nTime == 1000);
+    BOOST_CHECK(!payments.GetLastPaidBlock(scriptMn2, nHeight + 1, nHeight + 1, nTime));
+    BOOST_CHECK(!payments.GetLastPaidBlock(scriptStaker, 0, nHeight + 1, nTime));
+    BOOST_CHECK(!payments.GetLastPaidBlock(scriptDevFee, 0, nHeight + 1, nTime));
+
+    // reconnecting an indexed block (VerifyDB) does not add it twice
+    payments.ConnectBlockPayees(block2, &index2);
+    payments.DisconnectBlockPayees(block2, &index2);
+    BOOST_CHECK(payments.GetLastPaidBlock(scriptMn1, 0, nHeight + 1, nTime) && nTime == 1000);
+    BOOST_CHECK(payments.GetLastPaidBlock(scriptMn2, 0, nHeight + 1, nTime) && nTime == 1000);
+
+    payments.DisconnectBlockPayees(block1, &index1);
+    BOOST_CHECK(!payments.GetLastPaidBlock(scriptMn1, 0, nHeight + 1, nTime));
+    BOOST_CHECK(!payments.GetLastPaidBlock(scriptMn2, 0, nHeight + 1, nTime));
+    BOOST_CHECK_EQUAL(payments.GetLastPaidIndexStart(), nHeight);
+}
+
+BOOST_AUTO_TEST_CASE(last_paid_history_limit)
+{
+    CMasternodePayments payments;
+    CScript scriptStaker = RandomScript();
+    CScript scriptMn = RandomScript();
+    CBlock block = CreateBlock(scriptStaker, {scriptMn});
+
+    std::vector<CBlockIndex> vIndex(MNPAYMENTS_LAST_PAID_HISTORY + 2);
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        vIndex[i].nHeight = Params().LAST_POW_BLOCK() + 1 + i;
+        vIndex[i].nTime = 1000 + i;
+        payments.ConnectBlockPayees(block, &vIndex[i]);
+    }
+
+    // only the most recent payments are kept
+    int64_t nTime;
+    int nTip = vIndex.back().nHeight;
+    BOOST_CHECK(payments.GetLastPaidBlock(scriptMn, 0, nTip, nTime) && nTime == vIndex.back().nTime);
+    BOOST_CHECK(payments.GetLastPaidBlock(scriptMn, 0, nTip - MNPAYMENTS_LAST_PAID_HISTORY + 1, nTime));
+    BOOST_CHECK(!payments.GetLastPaidBlock(scriptMn, 0, nTip - MNPAYMENTS_LAST_PAID_HISTORY, nTime));
+}
+
+BOOST_AUTO_TEST_CASE(last_paid_load_index)
+{
+    CMasternodePayments payments;
+    CScript scriptStaker = RandomScript();
+    std::vector<CScript> vPayees;
+    std::vector<CBlock> vBlocks;
+    for (int i = 0; i < 4; i++) {
+        vPayees.push_back(RandomScript());
+        vBlocks.push_back(CreateBlock(scriptStaker, {vPayees.back()}));
+    }
+
+    // Chain of four blocks on disk, each paying its own masternode
+    std::vector<uint256> vHashes(vBlocks.size());
+    std::vector<CBlockIndex> vIndex(vBlocks.size());
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        CDiskBlockPos pos(990 + i, 0);
+        BOOST_REQUIRE(WriteBlockToDisk(vBlocks[i], pos));
+        vHashes[i] = vBlocks[i].GetHash();
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].pprev = i > 0 ? &vIndex[i - 1] : NULL;
+        vIndex[i].nHeight = Params().LAST_POW_BLOCK() + 1 + i;
+        vIndex[i].nTime = vBlocks[i].nTime;
+        vIndex[i].nFile = pos.nFile;
+        vIndex[i].nDataPos = pos.nPos;
+        vIndex[i].nStatus |= BLOCK_HAVE_DATA;
+    }
+    const CBlockIndex* pindexTip = &vIndex.back();
+
+    // Seeding from the last two blocks covers just those
+    payments.LoadLastPaidIndex(pindexTip, 2);
+    BOOST_CHECK_EQUAL(payments.GetLastPaidIndexStart(), pindexTip->nHeight - 1);
+    int64_t nTime;
+    BOOST_CHECK(!payments.GetLastPaidBlock(vPayees[0], 0, pindexTip->nHeight, nTime));
+    BOOST_CHECK(!payments.GetLastPaidBlock(vPayees[1], 0, pindexTip->nHeight, nTime));
+    BOOST_CHECK(payments.GetLastPaidBlock(vPayees[2], 0, pindexTip->nHeight, nTime) && nTime == vIndex[2].nTime);
+    BOOST_CHECK(payments.GetLastPaidBlock(vPayees[3], 0, pindexTip->nHeight, nTime) && nTime == vIndex[3].nTime);
+
+    // Reloading from the whole chain replaces the index
+    payments.LoadLastPaidIndex(pindexTip, vIndex.size());
+    BOOST_CHECK_EQUAL(payments.GetLastPaidIndexStart(), vIndex[0].nHeight);
+    for (unsigned int i = 0; i < vPayees.size(); i++)
+        BOOST_CHECK(payments.GetLastPaidBlock(vPayees[i], 0, pindexTip->nHeight, nTime) && nTime == vIndex[i].nTime);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,151 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-sigcheck.h"
+
+#include "clientversion.h"
+#include "key.h"
+#include "masternode.h"
+#include "obfuscation.h"
+#include "random.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(masternode_sigcheck_tests)
+
+struct SignedMessage {
+    std::string strMessage;
+    std::vector<unsigned char> vchSig;
+};
+
+static std::vector<SignedMessage> SignMessages(const CKey& key, size_t nCount)
+{
+    std::vector<SignedMessage> vMessages(nCount);
+    for (SignedMessage& message : vMessages) {
+        message.strMessage = GetRandHash().ToString();
+        std::string strError;
+        BOOST_REQUIRE(obfuScationSigner.SignMessage(message.strMessage, strError, message.vchSig, key));
+    }
+    return vMessages;
+}
+
+static CKey RandomKey()
+{
+    CKey key;
+    key.MakeNewKey(false);
+    return key;
+}
+
+BOOST_AUTO_TEST_CASE(recovered_key_cache)
+{
+    obfuScationSigner.ClearRecoveredKeys();
+    CKey key = RandomKey();
+    CPubKey pubKeyOther = RandomKey().GetPubKey();
+    std::vector<SignedMessage> vMessages = SignMessages(key, 2);
+    SignedMessage& message = vMessages[0];
+    std::string strError;
+
+    BOOST_CHECK(!obfuScationSigner.HasRecoveredKey(message.vchSig, message.strMessage));
+    BOOST_CHECK(obfuScationSigner.VerifyMessage(key.GetPubKey(), message.vchSig, message.strMessage, strError));
+    BOOST_CHECK(obfuScationSigner.HasRecoveredKey(message.vchSig, message.strMessage));
+
+    // a remembered signer still has to match the expected key
+    BOOST_CHECK(obfuScationSigner.VerifyMessage(key.GetPubKey(), message.vchSig, message.strMessage, strError));
+    BOOST_CHECK(!obfuScationSigner.VerifyMessage(pubKeyOther, message.vchSig, message.strMessage, strError));
+
+    // entries are keyed on both the message and the signature
+    BOOST_CHECK(!obfuScationSigner.HasRecoveredKey(message.vchSig, vMessages[1].strMessage));
+    BOOST_CHECK(!obfuScationSigner.HasRecoveredKey(vMessages[1].vchSig, message.strMessage));
+    BOOST_CHECK(!obfuScationSigner.VerifyMessage(key.GetPubKey(), message.vchSig, vMessages[1].strMessage, strError));
+    std::vector<unsigned char> vchSigBad = message.vchSig;
+    vchSigBad[10] ^= 1;
+    BOOST_CHECK(!obfuScationSigner.VerifyMessage(key.GetPubKey(), vchSigBad, message.strMessage, strError));
+
+    obfuScationSigner.ClearRecoveredKeys();
+    BOOST_CHECK(!obfuScationSigner.HasRecoveredKey(message.vchSig, message.strMessage));
+}
+
+// Verify() must not return before every signature of the batch went through the cache,
+// and a bad signature must neither fail the batch nor be accepted afterwards
+static void CheckBatch(const CKey& key, size_t nCount)
+{
+    obfuScationSigner.ClearRecoveredKeys();
+    std::vector<SignedMessage> vMessages = SignMessages(key, nCount);
+    SignedMessage bad = vMessages[nCount / 2];
+    bad.vchSig[5] ^= 1;
+
+    CMasternodeSigBatch batch;
+    for (const SignedMessage& message : vMessages)
+        batch.Add(message.vchSig, message.strMessage);
+    batch.Add(bad.vchSig, bad.strMessage);
+    BOOST_CHECK_EQUAL(batch.size(), nCount + 1);
+    batch.Verify();
+    BOOST_CHECK_EQUAL(batch.size(), 0U);
+
+    for (SignedMessage& message : vMessages) {
+        BOOST_CHECK(obfuScationSigner.HasRecoveredKey(message.vchSig, message.strMessage));
+        std::string strError;
+        BOOST_CHECK(obfuScationSigner.VerifyMessage(key.GetPubKey(), message.vchSig, message.strMessage, strError));
+    }
+    std::string strError;
+    BOOST_CHECK(!obfuScationSigner.VerifyMessage(key.GetPubKey(), bad.vchSig, bad.strMessage, strError));
+}
+
+BOOST_AUTO_TEST_CASE(sigbatch_serial)
+{
+    BOOST_REQUIRE_EQUAL(nMnSigCheckThreads, 0);
+    CheckBatch(RandomKey(), 50);
+}
+
+BOOST_AUTO_TEST_CASE(sigbatch_check_queue)
+{
+    boost::thread_group threads;
+    nMnSigCheckThreads = 4;
+    for (int i = 0; i < nMnSigCheckThreads - 1; i++)
+        threads.create_thread(&ThreadMasternodeSigCheck);
+
+    CKey key = RandomKey();
+    for (int i = 0; i < 5; i++)
+        CheckBatch(key, 300);
+
+    threads.interrupt_all();
+    threads.join_all();
+    nMnSigCheckThreads = 0;
+    obfuScationSigner.ClearRecoveredKeys();
+}
+
+BOOST_AUTO_TEST_CASE(sigbatch_add_message)
+{
+    BOOST_CHECK(CMasternodeSigBatch::IsCheckedCommand("mnp"));
+    BOOST_CHECK(!CMasternodeSigBatch::IsCheckedCommand("tx"));
+
+    CKey key = RandomKey();
+    CPubKey pubKey = key.GetPubKey();
+    CMasternodePing mnp;
+    mnp.vin = CTxIn(COutPoint(GetRandHash(), 0));
+    mnp.blockHash = GetRandHash();
+    BOOST_REQUIRE(mnp.Sign(key, pubKey));
+    obfuScationSigner.ClearRecoveredKeys();
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << mnp;
+    CMasternodeSigBatch batch;
+    BOOST_CHECK(!batch.AddMessage("tx", ss));
+    BOOST_CHECK(batch.AddMessage("mnp", ss));
+    BOOST_CHECK_EQUAL(batch.size(), 1U);
+    // the message itself is left for its handler to read
+    BOOST_CHECK_EQUAL(ss.size(), ::GetSerializeSize(mnp, SER_NETWORK, PROTOCOL_VERSION));
+
+    // a truncated message adds nothing
+    CDataStream ssShort(ss.begin(), ss.begin() + 10, SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK(!batch.AddMessage("mnp", ssShort));
+    BOOST_CHECK_EQUAL(batch.size(), 1U);
+
+    batch.Verify();
+    BOOST_CHECK(obfuScationSigner.HasRecoveredKey(mnp.vchSig, mnp.GetStrMessage()));
+    obfuScationSigner.ClearRecoveredKeys();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,72 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode.h"
+
+#include "chain.h"
+#include "random.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(masternode_tests)
+
+static void BuildChain(std::vector<CBlockIndex>& vIndex, std::vector<uint256>& vHash, CBlockIndex* pindexFork)
+{
+    vHash.resize(vIndex.size());
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        CBlockIndex* pprev = i ? &vIndex[i - 1] : pindexFork;
+        vHash[i] = GetRandHash();
+        vIndex[i].phashBlock = &vHash[i];
+        vIndex[i].nHeight = pprev ? pprev->nHeight + 1 : 0;
+        vIndex[i].pprev = pprev;
+        vIndex[i].BuildSkip();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(block_hash_cache_reorg)
+{
+    InvalidateBlockHashCache(-1);
+
+    std::vector<CBlockIndex> vMain(20), vFork(10);
+    std::vector<uint256> vMainHash, vForkHash;
+    BuildChain(vMain, vMainHash, NULL);
+    BuildChain(vFork, vForkHash, &vMain[14]);
+    CChain chain;
+    chain.SetTip(&vMain.back());
+    CChainSnapshot snapshotMain(CChainSnapshot(), chain);
+    chain.SetTip(&vFork.back());
+    CChainSnapshot snapshotFork(snapshotMain, chain);
+
+    uint256 hash;
+    BOOST_CHECK(GetBlockHash(hash, 17, snapshotMain, GetBlockHashCacheGeneration()));
+    BOOST_CHECK(hash == vMainHash[17]);
+    BOOST_CHECK(!GetBlockHash(hash, 30, snapshotMain, GetBlockHashCacheGeneration()));
+
+    // a reorg lands between taking the snapshot and storing its hash: the stale hash is returned
+    // to this caller, which asked about the old chain, but must not be cached
+    uint64_t nGeneration = GetBlockHashCacheGeneration();
+    InvalidateBlockHashCache(14);
+    BOOST_CHECK(GetBlockHash(hash, 18, snapshotMain, nGeneration));
+    BOOST_CHECK(hash == vMainHash[18]);
+    BOOST_CHECK(GetBlockHash(hash, 18, snapshotFork, GetBlockHashCacheGeneration()));
+    BOOST_CHECK(hash == vForkHash[3]);
+    BOOST_CHECK(GetBlockHash(hash, 17, snapshotFork, GetBlockHashCacheGeneration()));
+    BOOST_CHECK(hash == vForkHash[2]);
+
+    // and a lookup that started before the reorg does not get the new chain's cache either
+    BOOST_CHECK(GetBlockHash(hash, 18, snapshotMain, nGeneration));
+    BOOST_CHECK(hash == vMainHash[18]);
+
+    // below the fork point both chains agree
+    BOOST_CHECK(GetBlockHash(hash, 0, snapshotFork, GetBlockHashCacheGeneration()));
+    BOOST_CHECK(hash == vForkHash.back());
+    BOOST_CHECK(GetBlockHash(hash, 10, snapshotFork, GetBlockHashCacheGeneration()));
+    BOOST_CHECK(hash == vMainHash[10]);
+
+    InvalidateBlockHashCache(-1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
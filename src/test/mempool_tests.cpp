@@ -99,4 +99,109 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+static CMutableTransaction SpendTx(const uint256& hashPrev, uint32_t n, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vin[0].prevout.hash = hashPrev;
+    tx.vin[0].prevout.n = n;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = nValue;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAncestorStateTest)
+{
+    // Chain A <- B <- C, plus D spending an unrelated output
+    CMutableTransaction txA = SpendTx(uint256(1), 0, 10000LL);
+    CMutableTransaction txB = SpendTx(txA.GetHash(), 0, 9000LL);
+    CMutableTransaction txC = SpendTx(txB.GetHash(), 0, 8000LL);
+    CMutableTransaction txD = SpendTx(uint256(2), 0, 10000LL);
+
+    CTxMemPool testPool(CFeeRate(0));
+    CTxMemPoolEntry entryA(txA, 1000, 0, 0.0, 1);
+    CTxMemPoolEntry entryB(txB, 2000, 0, 0.0, 1);
+    CTxMemPoolEntry entryC(txC, 3000, 0, 0.0, 1);
+    testPool.addUnchecked(txA.GetHash(), entryA);
+    testPool.addUnchecked(txB.GetHash(), entryB);
+    testPool.addUnchecked(txC.GetHash(), entryC);
+    testPool.addUnchecked(txD.GetHash(), CTxMemPoolEntry(txD, 500, 0, 0.0, 1));
+
+    const CTxMemPoolEntry& a = testPool.mapTx[txA.GetHash()];
+    const CTxMemPoolEntry& c = testPool.mapTx[txC.GetHash()];
+    BOOST_CHECK_EQUAL(a.GetCountWithDescendants(), 3);
+    BOOST_CHECK_EQUAL(a.GetModFeesWithDescendants(), 6000);
+    BOOST_CHECK_EQUAL(a.GetSizeWithDescendants(), entryA.GetTxSize() + entryB.GetTxSize() + entryC.GetTxSize());
+    BOOST_CHECK_EQUAL(c.GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(c.GetModFeesWithAncestors(), 6000);
+
+    std::set<uint256> setAncestors;
+    testPool.CalculateAncestors(txC.GetHash(), setAncestors);
+    BOOST_CHECK_EQUAL(setAncestors.size(), 2);
+
+    // The best package by ancestor fee rate is A+B+C
+    BOOST_CHECK(testPool.GetAncestorScoreIndex().begin()->hash == txC.GetHash());
+
+    // Prioritising the parent lifts the whole chain
+    testPool.PrioritiseTransaction(txA.GetHash(), txA.GetHash().ToString(), 0, 4000);
+    BOOST_CHECK_EQUAL(c.GetModFeesWithAncestors(), 10000);
+    BOOST_CHECK_EQUAL(a.GetModFeesWithDescendants(), 10000);
+
+    // Taking B out of the middle leaves A and C unrelated
+    std::list<CTransaction> removed;
+    testPool.remove(txB, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK_EQUAL(a.GetCountWithDescendants(), 1);
+    BOOST_CHECK_EQUAL(a.GetModFeesWithDescendants(), 5000);
+    BOOST_CHECK_EQUAL(c.GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(c.GetModFeesWithAncestors(), 3000);
+
+    // Adding B back, as after a reorg, links it up again
+    testPool.addUnchecked(txB.GetHash(), entryB);
+    BOOST_CHECK_EQUAL(a.GetCountWithDescendants(), 3);
+    BOOST_CHECK_EQUAL(c.GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(c.GetModFeesWithAncestors(), 10000);
+    testPool.ClearPrioritisation(txA.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolTrimTest)
+{
+    CTxMemPool testPool(CFeeRate(1000));
+
+    // A cheap parent with a well paying child, and two mid fee rate transactions
+    CMutableTransaction txParent = SpendTx(uint256(1), 0, 10000LL);
+    CMutableTransaction txChild = SpendTx(txParent.GetHash(), 0, 9000LL);
+    CMutableTransaction txMid1 = SpendTx(uint256(2), 0, 10000LL);
+    CMutableTransaction txMid2 = SpendTx(uint256(3), 0, 10000LL);
+    CTxMemPoolEntry entryParent(txParent, 0, 0, 0.0, 1);
+    testPool.addUnchecked(txParent.GetHash(), entryParent);
+    testPool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 100000, 0, 0.0, 1));
+    testPool.addUnchecked(txMid1.GetHash(), CTxMemPoolEntry(txMid1, 20000, 0, 0.0, 1));
+    testPool.addUnchecked(txMid2.GetHash(), CTxMemPoolEntry(txMid2, 10000, 0, 0.0, 1));
+    BOOST_CHECK(testPool.GetMinFee() == CFeeRate(0));
+
+    // Nothing to do below the limit
+    std::list<CTransaction> removed;
+    testPool.TrimToSize(testPool.GetTotalTxSize(), removed);
+    BOOST_CHECK_EQUAL(removed.size(), 0);
+
+    // The parent is carried by its child, so the lowest paying package goes first
+    testPool.TrimToSize(testPool.GetTotalTxSize() - 1, removed);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK(removed.front().GetHash() == txMid2.GetHash());
+    BOOST_CHECK(testPool.exists(txParent.GetHash()));
+    BOOST_CHECK(testPool.GetMinFee().GetFeePerK() > 1000);
+
+    // Trimming down to one transaction evicts the next package with everything above it
+    removed.clear();
+    testPool.TrimToSize(entryParent.GetTxSize() * 2 + 1, removed);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK(removed.front().GetHash() == txMid1.GetHash());
+    testPool.TrimToSize(0, removed);
+    BOOST_CHECK_EQUAL(testPool.size(), 0);
+    BOOST_CHECK_EQUAL(testPool.GetTotalTxSize(), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
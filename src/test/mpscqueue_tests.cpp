@@ -0,0 +1,73 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mpscqueue.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(mpscqueue_tests)
+
+BOOST_AUTO_TEST_CASE(mpscqueue_fifo_and_full)
+{
+    CMPSCQueue<int> queue(3);
+    BOOST_CHECK_EQUAL(queue.capacity(), 4U);
+
+    int v = 0;
+    BOOST_CHECK(!queue.TryPop(v));
+    for (int i = 1; i <= 4; i++) {
+        v = i;
+        BOOST_CHECK(queue.TryPush(v));
+    }
+    v = 5;
+    BOOST_CHECK(!queue.TryPush(v));
+    BOOST_CHECK_EQUAL(v, 5);
+
+    // Wraps around the ring in order
+    for (int i = 1; i <= 10; i++) {
+        BOOST_CHECK(queue.TryPop(v));
+        BOOST_CHECK_EQUAL(v, i);
+        v = i + 4;
+        BOOST_CHECK(queue.TryPush(v));
+    }
+}
+
+static void PushAll(CMPSCQueue<int>* queue, int nProducer, int nCount)
+{
+    for (int i = 0; i < nCount; i++) {
+        int v = nProducer * nCount + i;
+        while (!queue->TryPush(v))
+            boost::this_thread::yield();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mpscqueue_many_producers)
+{
+    const int nProducers = 4;
+    const int nCount = 10000;
+    CMPSCQueue<int> queue(64);
+    boost::thread_group threads;
+    for (int i = 0; i < nProducers; i++)
+        threads.create_thread(boost::bind(&PushAll, &queue, i, nCount));
+
+    // Every element arrives once, and each producer's in the order it pushed them
+    std::vector<int> vNext(nProducers, 0);
+    int nReceived = 0;
+    while (nReceived < nProducers * nCount) {
+        int v;
+        if (!queue.TryPop(v)) {
+            boost::this_thread::yield();
+            continue;
+        }
+        BOOST_REQUIRE_EQUAL(v % nCount, vNext[v / nCount]);
+        vNext[v / nCount]++;
+        nReceived++;
+    }
+    threads.join_all();
+
+    int v;
+    BOOST_CHECK(!queue.TryPop(v));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -180,6 +180,18 @@ BOOST_AUTO_TEST_CASE(json_parse_errors)
     BOOST_CHECK_THROW(ParseNonRFCJSONValue("3J98t1WpEZ73CNmQviecrnyiWrnqRhWNL"), std::runtime_error);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_convert_address_params)
+{
+    // address index calls take a bare address or an object listing addresses
+    std::vector<std::string> vArgs(1, "175tWpb8K1S7NmH4Zx6rewF9WQrcZv245W");
+    BOOST_CHECK_EQUAL(RPCConvertValues("getaddressbalance", vArgs)[0].get_str(), vArgs[0]);
+    vArgs[0] = "{\"addresses\": [\"175tWpb8K1S7NmH4Zx6rewF9WQrcZv245W\"]}";
+    BOOST_CHECK(RPCConvertValues("getaddresstxids", vArgs)[0].isObject());
+    BOOST_CHECK(RPCConvertValues("getaddressutxos", vArgs)[0].isObject());
+    vArgs[0] = "{\"addresses\": ";
+    BOOST_CHECK_THROW(RPCConvertValues("getaddressutxos", vArgs), std::runtime_error);
+}
+
 BOOST_AUTO_TEST_CASE(rpc_boostasiotocnetaddr)
 {
     // Check IPv4 addresses
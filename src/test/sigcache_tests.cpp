@@ -0,0 +1,143 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "script/sigcache.h"
+
+#include "key.h"
+#include "random.h"
+
+#include <atomic>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(sigcache_tests)
+
+struct SigCacheEntry {
+    uint256 hash;
+    std::vector<unsigned char> vchSig;
+};
+
+static std::vector<SigCacheEntry> RandomEntries(size_t nCount)
+{
+    std::vector<SigCacheEntry> vEntries(nCount);
+    for (SigCacheEntry& entry : vEntries) {
+        entry.hash = GetRandHash();
+        entry.vchSig.resize(72);
+        GetRandBytes(&entry.vchSig[0], entry.vchSig.size());
+    }
+    return vEntries;
+}
+
+static CPubKey RandomPubKey()
+{
+    CKey key;
+    key.MakeNewKey(true);
+    return key.GetPubKey();
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_insert_lookup)
+{
+    CSignatureCache cache(1 << 20);
+    CPubKey pubKey = RandomPubKey();
+    CPubKey pubKeyOther = RandomPubKey();
+    std::vector<SigCacheEntry> vEntries = RandomEntries(100);
+
+    CSignatureCacheStats stats;
+    cache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nMaxEntries, (1 << 20) / SIG_CACHE_ENTRY_SIZE);
+    BOOST_CHECK_EQUAL(stats.nBytes, 1 << 20);
+
+    for (const SigCacheEntry& entry : vEntries) {
+        BOOST_CHECK(!cache.Get(entry.hash, entry.vchSig, pubKey));
+        cache.Set(entry.hash, entry.vchSig, pubKey);
+        BOOST_CHECK(cache.Get(entry.hash, entry.vchSig, pubKey));
+    }
+    // inserting again is a no-op
+    cache.Set(vEntries[0].hash, vEntries[0].vchSig, pubKey);
+
+    // every part of the (sighash, signature, pubkey) tuple is part of the key
+    std::vector<unsigned char> vchSigOther = vEntries[0].vchSig;
+    vchSigOther[0] ^= 1;
+    BOOST_CHECK(!cache.Get(vEntries[0].hash, vchSigOther, pubKey));
+    BOOST_CHECK(!cache.Get(vEntries[1].hash, vEntries[0].vchSig, pubKey));
+    BOOST_CHECK(!cache.Get(vEntries[0].hash, vEntries[0].vchSig, pubKeyOther));
+
+    cache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nEntries, 100U);
+    BOOST_CHECK_EQUAL(stats.nInserts, 100U);
+    BOOST_CHECK_EQUAL(stats.nEvictions, 0U);
+    BOOST_CHECK_EQUAL(stats.nHits, 100U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 103U);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_eviction)
+{
+    // 32 buckets of 4 entries
+    CSignatureCache cache(4096);
+    CPubKey pubKey = RandomPubKey();
+    std::vector<SigCacheEntry> vEntries = RandomEntries(1000);
+    for (const SigCacheEntry& entry : vEntries)
+        cache.Set(entry.hash, entry.vchSig, pubKey);
+
+    CSignatureCacheStats stats;
+    cache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nMaxEntries, 128U);
+    BOOST_CHECK_EQUAL(stats.nInserts, 1000U);
+    BOOST_CHECK(stats.nEvictions > 0);
+    BOOST_CHECK(stats.nEntries <= stats.nMaxEntries);
+    // every eviction drops exactly one entry, everything else is still found
+    BOOST_CHECK_EQUAL(stats.nEntries + stats.nEvictions, stats.nInserts);
+    uint64_t nFound = 0;
+    for (const SigCacheEntry& entry : vEntries)
+        nFound += cache.Get(entry.hash, entry.vchSig, pubKey);
+    BOOST_CHECK_EQUAL(nFound, stats.nEntries);
+
+    // a cache smaller than a bucket stores nothing
+    CSignatureCache cacheEmpty(0);
+    cacheEmpty.Set(vEntries[0].hash, vEntries[0].vchSig, pubKey);
+    BOOST_CHECK(!cacheEmpty.Get(vEntries[0].hash, vEntries[0].vchSig, pubKey));
+    cacheEmpty.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nMaxEntries, 0U);
+}
+
+static void SigCacheReader(CSignatureCache& cache, const CPubKey& pubKey, const std::vector<SigCacheEntry>& vAbsent, std::atomic<int>& nFalseHits, std::atomic<bool>& fStop)
+{
+    while (!fStop) {
+        for (const SigCacheEntry& entry : vAbsent) {
+            if (cache.Get(entry.hash, entry.vchSig, pubKey))
+                nFalseHits++;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_concurrent_readers)
+{
+    CSignatureCache cache(1 << 20);
+    CPubKey pubKey = RandomPubKey();
+    std::vector<SigCacheEntry> vEntries = RandomEntries(4000);
+    std::vector<SigCacheEntry> vAbsent = RandomEntries(100);
+
+    // Lookups take no lock: readers run while entries are inserted and must never see an entry that was not inserted
+    std::atomic<int> nFalseHits(0);
+    std::atomic<bool> fStop(false);
+    boost::thread_group threads;
+    for (int i = 0; i < 4; i++)
+        threads.create_thread(boost::bind(&SigCacheReader, boost::ref(cache), boost::cref(pubKey), boost::cref(vAbsent), boost::ref(nFalseHits), boost::ref(fStop)));
+    for (const SigCacheEntry& entry : vEntries)
+        cache.Set(entry.hash, entry.vchSig, pubKey);
+    fStop = true;
+    threads.join_all();
+    BOOST_CHECK_EQUAL(nFalseHits, 0);
+
+    CSignatureCacheStats stats;
+    cache.GetStats(stats);
+    uint64_t nFound = 0;
+    for (const SigCacheEntry& entry : vEntries)
+        nFound += cache.Get(entry.hash, entry.vchSig, pubKey);
+    BOOST_CHECK_EQUAL(nFound, stats.nEntries);
+    BOOST_CHECK_EQUAL(stats.nEntries + stats.nEvictions, vEntries.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
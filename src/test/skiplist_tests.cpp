@@ -99,4 +99,52 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(chainsnapshot_test)
+{
+    // A main chain 5000 blocks long and a branch off block 2999 that overtakes it
+    std::vector<CBlockIndex> vBlocksMain(5000);
+    for (unsigned int i=0; i<vBlocksMain.size(); i++) {
+        vBlocksMain[i].nHeight = i;
+        vBlocksMain[i].pprev = i ? &vBlocksMain[i - 1] : NULL;
+        vBlocksMain[i].BuildSkip();
+    }
+    std::vector<CBlockIndex> vBlocksSide(3000);
+    for (unsigned int i=0; i<vBlocksSide.size(); i++) {
+        vBlocksSide[i].nHeight = i + 3000;
+        vBlocksSide[i].pprev = i ? &vBlocksSide[i - 1] : &vBlocksMain[2999];
+        vBlocksSide[i].BuildSkip();
+    }
+
+    CChain chain;
+    CChainSnapshot empty;
+    BOOST_CHECK_EQUAL(empty.Height(), -1);
+    BOOST_CHECK(empty.Tip() == NULL);
+
+    chain.SetTip(&vBlocksMain.back());
+    CChainSnapshot snapMain(empty, chain);
+    BOOST_CHECK_EQUAL(snapMain.Height(), chain.Height());
+    for (int i=0; i<=chain.Height(); i++)
+        BOOST_CHECK(snapMain[i] == chain[i]);
+    BOOST_CHECK(snapMain[chain.Height() + 1] == NULL);
+
+    // Reorganize to the branch; the older snapshot keeps its view
+    chain.SetTip(&vBlocksSide.back());
+    CChainSnapshot snapSide(snapMain, chain);
+    BOOST_CHECK_EQUAL(snapSide.Height(), 5999);
+    for (int i=0; i<=chain.Height(); i++)
+        BOOST_CHECK(snapSide[i] == chain[i]);
+    BOOST_CHECK(snapSide.Contains(&vBlocksMain[2999]));
+    BOOST_CHECK(!snapSide.Contains(&vBlocksMain[3000]));
+    BOOST_CHECK(snapSide.Next(&vBlocksMain[2999]) == &vBlocksSide[0]);
+    BOOST_CHECK(snapMain.Tip() == &vBlocksMain.back());
+    BOOST_CHECK(snapMain.Next(&vBlocksMain[2999]) == &vBlocksMain[3000]);
+
+    // And back to a shorter tip of the main chain
+    chain.SetTip(&vBlocksMain[1024]);
+    CChainSnapshot snapShort(snapSide, chain);
+    BOOST_CHECK(snapShort.Tip() == &vBlocksMain[1024]);
+    BOOST_CHECK(snapShort[1025] == NULL);
+    BOOST_CHECK(snapShort.Next(&vBlocksMain[1024]) == NULL);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,109 @@
+// Copyright (c) 2018-2019 The esbcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+#include "key.h"
+#include "main.h"
+#include "script/standard.h"
+#include "spork.h"
+#include "streams.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(txfilter_tests)
+
+static CMutableTransaction CreateFunding(const CKey& key)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 10 * COIN;
+    tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    return tx;
+}
+
+static CMutableTransaction CreateSpend(const CTransaction& txPrev)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txPrev.GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 9 * COIN;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(txfilter_tip_prevout)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    TxFilterMap mapTxFilterOld = mapTxFilter;
+    mapTxFilter.clear();
+    mapTxFilter.emplace(key.GetPubKey().GetID(), 1);
+
+    // The funding output is unspent at the tip
+    CMutableTransaction txPrev = CreateFunding(key);
+    CMutableTransaction txSpend = CreateSpend(txPrev);
+    int64_t nBlockTime = GetAdjustedTime();
+    BOOST_CHECK(CheckTxFilter(txSpend, nBlockTime));
+    {
+        LOCK(cs_main);
+        pcoinsTip->ModifyCoins(txPrev.GetHash())->FromTx(txPrev, 100);
+    }
+
+    BOOST_CHECK(!CheckTxFilter(txSpend, nBlockTime));
+    BOOST_CHECK(!CheckTxFilter(txSpend, 0));
+    // filtering starts at the recorded time and only applies to recent blocks
+    mapTxFilter[key.GetPubKey().GetID()] = nBlockTime;
+    BOOST_CHECK(CheckTxFilter(txSpend, nBlockTime));
+    mapTxFilter[key.GetPubKey().GetID()] = 1;
+    BOOST_CHECK(CheckTxFilter(txSpend, nBlockTime - 2 * 24 * 60 * 60));
+
+    {
+        LOCK(cs_main);
+        pcoinsTip->ModifyCoins(txPrev.GetHash())->Spend(0);
+    }
+    mapTxFilter = mapTxFilterOld;
+}
+
+BOOST_AUTO_TEST_CASE(txfilter_spent_prevout)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    TxFilterMap mapTxFilterOld = mapTxFilter;
+    mapTxFilter.clear();
+    mapTxFilter.emplace(key.GetPubKey().GetID(), 1);
+
+    bool fTxIndexOld = fTxIndex;
+    uint64_t nMaxBytesOld = rawTxCache.GetStats().nMaxBytes;
+    fTxIndex = true;
+    rawTxCache.SetMaxBytes(1 << 20);
+
+    // The funding output is already spent at the tip, so only the tx index still knows its script
+    CMutableTransaction txPrev = CreateFunding(key);
+    CMutableTransaction txSpend = CreateSpend(txPrev);
+    {
+        LOCK(cs_main);
+        CCoinsModifier coins = pcoinsTip->ModifyCoins(txPrev.GetHash());
+        coins->FromTx(txPrev, 100);
+        coins->Spend(0);
+    }
+    BOOST_CHECK(CheckTxFilter(txSpend, 0));
+
+    std::shared_ptr<CRawData> pdata(new CRawData(GetRandHash()));
+    CDataStream ssTx(SER_DISK, CLIENT_VERSION);
+    ssTx << CTransaction(txPrev);
+    pdata->vch.assign(ssTx.begin(), ssTx.end());
+    rawTxCache.Insert(txPrev.GetHash(), pdata);
+    BOOST_CHECK(!CheckTxFilter(txSpend, 0));
+    BOOST_CHECK(!CheckTxFilter(txSpend, GetAdjustedTime()));
+
+    rawTxCache.Clear();
+    rawTxCache.SetMaxBytes(nMaxBytesOld);
+    fTxIndex = fTxIndexOld;
+    mapTxFilter = mapTxFilterOld;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -305,4 +305,261 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(scan_filter_matches_ismine)
+{
+    CWallet keywallet;
+    LOCK(keywallet.cs_wallet);
+
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    CPubKey pubkeyOther = keyOther.GetPubKey();
+    BOOST_CHECK(keywallet.AddKeyPubKey(key, pubkey));
+
+    CScript scriptMultisig = GetScriptForMultisig(1, std::vector<CPubKey>(1, pubkey));
+    BOOST_CHECK(keywallet.AddCScript(scriptMultisig));
+    CScript scriptWatch = GetScriptForDestination(pubkeyOther.GetID()) << OP_NOP;
+    BOOST_CHECK(keywallet.AddWatchOnly(scriptWatch));
+
+    std::vector<CPubKey> vMixed;
+    vMixed.push_back(pubkey);
+    vMixed.push_back(pubkeyOther);
+
+    std::vector<CScript> vScripts;
+    vScripts.push_back(GetScriptForDestination(pubkey.GetID()));
+    vScripts.push_back(CScript() << ToByteVector(pubkey) << OP_CHECKSIG);
+    vScripts.push_back(GetScriptForDestination(CScriptID(scriptMultisig)));
+    vScripts.push_back(scriptMultisig);
+    vScripts.push_back(scriptWatch);
+    vScripts.push_back(GetScriptForMultisig(2, vMixed));
+    vScripts.push_back(GetScriptForDestination(pubkeyOther.GetID()));
+    vScripts.push_back(CScript() << OP_RETURN);
+
+    CWalletScanFilter filter;
+    keywallet.GetScanFilter(filter);
+    for (const CScript& script : vScripts) {
+        CTxOut txout(1, script);
+        // the filter may let through more than IsMine(), never less
+        if (IsMine(keywallet, script) != ISMINE_NO)
+            BOOST_CHECK(filter.IsRelevant(txout));
+    }
+    BOOST_CHECK(filter.IsRelevant(CTxOut(1, GetScriptForMultisig(2, vMixed))));
+    BOOST_CHECK(!filter.IsRelevant(CTxOut(1, GetScriptForDestination(pubkeyOther.GetID()))));
+    BOOST_CHECK(!filter.IsRelevant(CTxOut(1, CScript() << OP_RETURN)));
+}
+
+// Balances and AvailableCoins() computed the uncached way, by a scan of all of mapWallet
+static void CheckAgainstFullScan(const CWallet& w)
+{
+    LOCK2(cs_main, w.cs_wallet);
+    CAmount nBalance = 0, nUnconfirmed = 0, nImmature = 0;
+    set<COutPoint> setAvailable, setAvailableConfirmed;
+    for (const PAIRTYPE(const uint256, CWalletTx) & item : w.mapWallet) {
+        const CWalletTx& wtx = item.second;
+        bool fTrusted = wtx.IsTrusted();
+        if (fTrusted)
+            nBalance += wtx.GetAvailableCredit(false);
+        if (!IsFinalTx(wtx) || (!fTrusted && wtx.GetDepthInMainChain() == 0))
+            nUnconfirmed += wtx.GetAvailableCredit(false);
+        nImmature += wtx.GetImmatureCredit(false);
+
+        if ((wtx.IsCoinBase() || wtx.IsCoinStake()) && wtx.GetBlocksToMaturity() > 0)
+            continue;
+        if (wtx.GetDepthInMainChain(false) == 0 && !wtx.InMempool())
+            continue;
+        for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+            if (w.IsMine(wtx.vout[i]) == ISMINE_SPENDABLE && !w.IsSpent(item.first, i) && wtx.vout[i].nValue > 0) {
+                setAvailable.insert(COutPoint(item.first, i));
+                if (fTrusted)
+                    setAvailableConfirmed.insert(COutPoint(item.first, i));
+            }
+        }
+    }
+
+    // twice, so that both a recomputed and a cached answer are checked
+    for (int i = 0; i < 2; i++) {
+        BOOST_CHECK_EQUAL(w.GetBalance(), nBalance);
+        BOOST_CHECK_EQUAL(w.GetUnconfirmedBalance(), nUnconfirmed);
+        BOOST_CHECK_EQUAL(w.GetImmatureBalance(), nImmature);
+
+        vector<COutput> vAvailable;
+        set<COutPoint> setCoins, setCoinsConfirmed;
+        w.AvailableCoins(vAvailable, false);
+        for (const COutput& out : vAvailable)
+            setCoins.insert(COutPoint(out.tx->GetHash(), out.i));
+        w.AvailableCoins(vAvailable, true);
+        for (const COutput& out : vAvailable)
+            setCoinsConfirmed.insert(COutPoint(out.tx->GetHash(), out.i));
+        BOOST_CHECK(setCoins == setAvailable);
+        BOOST_CHECK(setCoinsConfirmed == setAvailableConfirmed);
+    }
+}
+
+static CMutableTransaction CreateSpend(const COutPoint& prevout, const CScript& scriptPubKey, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(prevout));
+    tx.vout.push_back(CTxOut(nValue, scriptPubKey));
+    return tx;
+}
+
+// What ConnectTip() does to a wallet: the block becomes the tip and its transactions leave the mempool
+static CBlockIndex* ConnectFakeBlock(CWallet& w, const vector<CTransaction>& vtx)
+{
+    static uint32_t nNonce = 0;
+    CBlock block;
+    block.vtx = vtx;
+    block.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+    block.nTime = chainActive.Tip()->nTime + 60;
+    block.nNonce = ++nNonce;
+    block.hashMerkleRoot = block.BuildMerkleTree();
+
+    CBlockIndex* pindex = new CBlockIndex(block);
+    BlockMap::iterator mi = mapBlockIndex.insert(make_pair(block.GetHash(), pindex)).first;
+    pindex->phashBlock = &((*mi).first);
+    pindex->pprev = chainActive.Tip();
+    pindex->nHeight = pindex->pprev->nHeight + 1;
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(pindex);
+    }
+
+    for (const CTransaction& tx : vtx) {
+        list<CTransaction> removed;
+        mempool.remove(tx, removed);
+        w.SyncTransaction(tx, &block);
+    }
+    return pindex;
+}
+
+// What DisconnectTip() does: everything but coinbase and coinstake goes back to the mempool
+static void DisconnectFakeBlock(CWallet& w, const vector<CTransaction>& vtx)
+{
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(chainActive.Tip()->pprev);
+    }
+    for (const CTransaction& tx : vtx) {
+        if (!tx.IsCoinBase() && !tx.IsCoinStake())
+            mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 0, GetTime(), 0, chainActive.Height()));
+        w.SyncTransaction(tx, NULL);
+    }
+}
+
+static void AddToMempool(CWallet& w, const CTransaction& tx)
+{
+    mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 0, GetTime(), 0, chainActive.Height()));
+    w.SyncTransaction(tx, NULL);
+}
+
+BOOST_AUTO_TEST_CASE(balance_cache_matches_full_scan)
+{
+    CBlockIndex* pindexGenesis = chainActive.Tip();
+    vector<CBlockIndex*> vFakeIndex;
+    {
+        CWallet w("wallet_balance_tests.dat");
+        CKey key;
+        key.MakeNewKey(true);
+        BOOST_CHECK(w.AddKeyPubKey(key, key.GetPubKey()));
+        CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+        CKey keyOther;
+        keyOther.MakeNewKey(true);
+        CScript scriptOther = GetScriptForDestination(keyOther.GetPubKey().GetID());
+        CheckAgainstFullScan(w);
+
+        // add: a payment to us, first unconfirmed, then in a block
+        CTransaction txReceive = CreateSpend(COutPoint(GetRandHash(), 0), scriptMine, 10 * COIN);
+        AddToMempool(w, txReceive);
+        CheckAgainstFullScan(w);
+        BOOST_CHECK_EQUAL(w.GetUnconfirmedBalance(), 10 * COIN);
+        vFakeIndex.push_back(ConnectFakeBlock(w, vector<CTransaction>(1, txReceive)));
+        CheckAgainstFullScan(w);
+        BOOST_CHECK_EQUAL(w.GetBalance(), 10 * COIN);
+
+        // an immature coinbase
+        CMutableTransaction txCoinBase;
+        txCoinBase.vin.resize(1);
+        txCoinBase.vin[0].prevout.SetNull();
+        txCoinBase.vin[0].scriptSig = CScript() << 2 << OP_0;
+        txCoinBase.vout.push_back(CTxOut(50 * COIN, scriptMine));
+        vector<CTransaction> vtxCoinBase(1, txCoinBase);
+        vFakeIndex.push_back(ConnectFakeBlock(w, vtxCoinBase));
+        CheckAgainstFullScan(w);
+        BOOST_CHECK_EQUAL(w.GetImmatureBalance(), 50 * COIN);
+
+        // spend: the paid-to transaction becomes fully spent and the change is trusted
+        CMutableTransaction txSpend = CreateSpend(COutPoint(txReceive.GetHash(), 0), scriptMine, 4 * COIN);
+        txSpend.vout.push_back(CTxOut(5 * COIN, scriptOther));
+        AddToMempool(w, txSpend);
+        CheckAgainstFullScan(w);
+        BOOST_CHECK_EQUAL(w.GetBalance(), 4 * COIN);
+
+        // conflict: the spend drops out of the mempool, so its input is spendable again
+        list<CTransaction> removed;
+        mempool.remove(txSpend, removed);
+        w.SyncTransaction(txSpend, NULL);
+        CheckAgainstFullScan(w);
+        BOOST_CHECK_EQUAL(w.GetBalance(), 10 * COIN);
+
+        // erase: a spend removed from the wallet no longer counts either
+        CTransaction txSpend2 = CreateSpend(COutPoint(txReceive.GetHash(), 0), scriptOther, 9 * COIN);
+        AddToMempool(w, txSpend2);
+        CheckAgainstFullScan(w);
+        BOOST_CHECK_EQUAL(w.GetBalance(), 0);
+        w.EraseFromWallet(txSpend2.GetHash());
+        mempool.remove(txSpend2, removed);
+        CheckAgainstFullScan(w);
+        BOOST_CHECK_EQUAL(w.GetBalance(), 10 * COIN);
+
+        // reorg: a confirmed spend and a matured coinbase are disconnected again
+        vector<CTransaction> vtxSpend(1, CreateSpend(COutPoint(txReceive.GetHash(), 0), scriptMine, 9 * COIN));
+        vFakeIndex.push_back(ConnectFakeBlock(w, vtxSpend));
+        for (int i = 0; i < Params().COINBASE_MATURITY(); i++)
+            vFakeIndex.push_back(ConnectFakeBlock(w, vector<CTransaction>()));
+        CheckAgainstFullScan(w);
+        BOOST_CHECK_EQUAL(w.GetBalance(), 59 * COIN);
+        BOOST_CHECK_EQUAL(w.GetImmatureBalance(), 0);
+        while (chainActive.Tip() != vFakeIndex[2])
+            DisconnectFakeBlock(w, vector<CTransaction>());
+        CheckAgainstFullScan(w);
+        BOOST_CHECK_EQUAL(w.GetImmatureBalance(), 50 * COIN);
+        DisconnectFakeBlock(w, vtxSpend);
+        DisconnectFakeBlock(w, vtxCoinBase);
+        CheckAgainstFullScan(w);
+        BOOST_CHECK_EQUAL(w.GetImmatureBalance(), 0);
+        BOOST_CHECK_EQUAL(w.GetBalance(), 9 * COIN);
+        vFakeIndex.push_back(ConnectFakeBlock(w, vtxSpend));
+        CheckAgainstFullScan(w);
+        BOOST_CHECK_EQUAL(w.GetBalance(), 9 * COIN);
+
+        // orphaned stake: the coinstake is not put back in the mempool, so the coin it staked is available again
+        CMutableTransaction txCoinStake = CreateSpend(COutPoint(vtxSpend[0].GetHash(), 0), CScript(), 0);
+        txCoinStake.vout[0].SetEmpty();
+        txCoinStake.vout.push_back(CTxOut(12 * COIN, scriptMine));
+        vector<CTransaction> vtxCoinStake(1, txCoinStake);
+        BOOST_CHECK(vtxCoinStake[0].IsCoinStake());
+        vFakeIndex.push_back(ConnectFakeBlock(w, vtxCoinStake));
+        CheckAgainstFullScan(w);
+        BOOST_CHECK_EQUAL(w.GetImmatureBalance(), 12 * COIN);
+        vector<COutput> vAvailable;
+        w.AvailableCoins(vAvailable, true);
+        BOOST_CHECK(vAvailable.empty());
+        DisconnectFakeBlock(w, vtxCoinStake);
+        CheckAgainstFullScan(w);
+        BOOST_CHECK_EQUAL(w.GetBalance(), 9 * COIN);
+        BOOST_CHECK_EQUAL(w.GetImmatureBalance(), 0);
+        w.AvailableCoins(vAvailable, true);
+        BOOST_CHECK_EQUAL(vAvailable.size(), 1U);
+    }
+
+    LOCK(cs_main);
+    chainActive.SetTip(pindexGenesis);
+    for (CBlockIndex* pindex : vFakeIndex) {
+        mapBlockIndex.erase(pindex->GetBlockHash());
+        delete pindex;
+    }
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,7 +8,9 @@
 #include "txdb.h"
 
 #include "main.h"
+#include "init.h"
 #include "pow.h"
+#include "ui_interface.h"
 #include "uint256.h"
 #include "base58.h"
 
@@ -19,12 +21,103 @@
 
 using namespace std;
 
-void static BatchWriteCoins(CLevelDBBatch& batch, const uint256& hash, const CCoins& coins)
+/** Key of a per-output coins record: 'C' + txid + VARINT(n) */
+struct CCoinsOutputKey {
+    uint256 txid;
+    unsigned int n;
+
+    CCoinsOutputKey() : txid(0), n(0) {}
+    CCoinsOutputKey(const uint256& txidIn, unsigned int nIn) : txid(txidIn), n(nIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        char chType = 'C';
+        READWRITE(chType);
+        READWRITE(txid);
+        READWRITE(VARINT(n));
+    }
+};
+
+/**
+ * Value of a per-output coins record: the transaction metadata followed by
+ * the output itself.
+ *
+ * Serialized format:
+ * - VARINT(nVersion)
+ * - VARINT(nHeight * 4 + fCoinStake * 2 + fCoinBase)
+ * - the CTxOut (via CTxOutCompressor)
+ */
+struct CCoinsOutputValue {
+    int nTxVersion;
+    int nHeight;
+    bool fCoinBase;
+    bool fCoinStake;
+    CTxOut txout;
+
+    CCoinsOutputValue() : nTxVersion(0), nHeight(0), fCoinBase(false), fCoinStake(false) {}
+    CCoinsOutputValue(const CCoins& coins, unsigned int n) : nTxVersion(coins.nVersion), nHeight(coins.nHeight), fCoinBase(coins.fCoinBase), fCoinStake(coins.fCoinStake), txout(coins.vout[n]) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        unsigned int nCode = nHeight * 4 + (fCoinStake ? 2 : 0) + (fCoinBase ? 1 : 0);
+        READWRITE(VARINT(nTxVersion));
+        READWRITE(VARINT(nCode));
+        if (ser_action.ForRead()) {
+            nHeight = nCode / 4;
+            fCoinStake = (nCode & 2) != 0;
+            fCoinBase = (nCode & 1) != 0;
+        }
+        READWRITE(REF(CTxOutCompressor(txout)));
+    }
+};
+
+/** Add the output stored in a per-output record to coins. Throws on malformed records. */
+void static ReadCoinsOutput(const leveldb::Slice& slKey, const leveldb::Slice& slValue, uint256& txid, CCoins& coins)
 {
-    if (coins.IsPruned())
-        batch.Erase(make_pair('c', hash));
-    else
-        batch.Write(make_pair('c', hash), coins);
+    CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+    CCoinsOutputKey key;
+    ssKey >> key;
+    CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+    CCoinsOutputValue value;
+    ssValue >> value;
+
+    txid = key.txid;
+    coins.nVersion = value.nTxVersion;
+    coins.nHeight = value.nHeight;
+    coins.fCoinBase = value.fCoinBase;
+    coins.fCoinStake = value.fCoinStake;
+    if (key.n >= coins.vout.size())
+        coins.vout.resize(key.n + 1);
+    coins.vout[key.n] = value.txout;
+}
+
+/** Write the outputs of a cache entry that differ from what the database holds for it. */
+void static BatchWriteCoins(CLevelDBBatch& batch, const uint256& hash, const CCoinsCacheEntry& entry, size_t& nOutputs)
+{
+    const CCoins& coins = entry.coins;
+    // Output contents are fixed by the txid, but a transaction that got
+    // reconnected at another height needs its stored outputs rewritten.
+    bool fRewrite = coins.nHeight != entry.nBaseHeight;
+    unsigned int nSize = std::max(coins.vout.size(), entry.vBaseUnspent.size());
+    for (unsigned int i = 0; i < nSize; i++) {
+        bool fWasUnspent = i < entry.vBaseUnspent.size() && entry.vBaseUnspent[i];
+        if (coins.IsAvailable(i)) {
+            if (fWasUnspent && !fRewrite)
+                continue;
+            batch.Write(CCoinsOutputKey(hash, i), CCoinsOutputValue(coins, i));
+        } else if (fWasUnspent) {
+            batch.Erase(CCoinsOutputKey(hash, i));
+        } else {
+            continue;
+        }
+        nOutputs++;
+    }
 }
 
 void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
@@ -36,14 +129,52 @@ CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(Get
 {
 }
 
+leveldb::Iterator* CCoinsViewDB::GetCursor() const
+{
+    AssertLockHeld(cs_cursor);
+    if (!pcursorCoins)
+        pcursorCoins.reset(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+    return pcursorCoins.get();
+}
+
 bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
 {
-    return db.Read(make_pair('c', txid), coins);
+    CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+    ssPrefix << make_pair('C', txid);
+
+    LOCK(cs_cursor);
+    leveldb::Iterator* pcursor = GetCursor();
+    coins.Clear();
+    bool fFound = false;
+    for (pcursor->Seek(leveldb::Slice(&ssPrefix[0], ssPrefix.size())); pcursor->Valid(); pcursor->Next()) {
+        leveldb::Slice slKey = pcursor->key();
+        if (slKey.size() <= ssPrefix.size() || memcmp(slKey.data(), &ssPrefix[0], ssPrefix.size()) != 0)
+            break;
+        try {
+            uint256 hash;
+            ReadCoinsOutput(slKey, pcursor->value(), hash, coins);
+        } catch (const std::exception&) {
+            return false;
+        }
+        fFound = true;
+    }
+    HandleError(pcursor->status());
+    return fFound;
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256& txid) const
 {
-    return db.Exists(make_pair('c', txid));
+    CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+    ssPrefix << make_pair('C', txid);
+
+    LOCK(cs_cursor);
+    leveldb::Iterator* pcursor = GetCursor();
+    pcursor->Seek(leveldb::Slice(&ssPrefix[0], ssPrefix.size()));
+    HandleError(pcursor->status());
+    if (!pcursor->Valid())
+        return false;
+    leveldb::Slice slKey = pcursor->key();
+    return slKey.size() > ssPrefix.size() && memcmp(slKey.data(), &ssPrefix[0], ssPrefix.size()) == 0;
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const
@@ -59,9 +190,10 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
+    size_t outputs = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            BatchWriteCoins(batch, it->first, it->second.coins);
+            BatchWriteCoins(batch, it->first, it->second, outputs);
             changed++;
         }
         count++;
@@ -71,8 +203,83 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
     if (hashBlock != uint256(0))
         BatchWriteHashBestChain(batch, hashBlock);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    LogPrint("coindb", "Committing %u changed transactions (out of %u), %u outputs, to coin database...\n", (unsigned int)changed, (unsigned int)count, (unsigned int)outputs);
+    bool ret = db.WriteBatch(batch);
+    LOCK(cs_cursor);
+    pcursorCoins.reset();
+    return ret;
+}
+
+bool CCoinsViewDB::Upgrade()
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    pcursor->Seek(leveldb::Slice("c", 1));
+    if (!pcursor->Valid() || pcursor->key()[0] != 'c')
+        return true;
+
+    LogPrintf("Upgrading coin database to per-output records. Older versions cannot read the upgraded database.\n");
+    uiInterface.InitMessage(_("Upgrading coin database..."));
+    int64_t nStart = GetTimeMillis();
+    CLevelDBBatch batch;
+    size_t nBatchSize = 0;
+    uint64_t nTransactions = 0;
+    uint64_t nOutputs = 0;
+    int nLastPercent = -1;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        leveldb::Slice slKey = pcursor->key();
+        if (slKey.size() == 0 || slKey[0] != 'c')
+            break;
+        uint256 txid;
+        CCoins coins;
+        try {
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType >> txid;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> coins;
+        } catch (const std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+        for (unsigned int i = 0; i < coins.vout.size(); i++) {
+            if (coins.IsAvailable(i)) {
+                batch.Write(CCoinsOutputKey(txid, i), CCoinsOutputValue(coins, i));
+                nOutputs++;
+            }
+        }
+        batch.Erase(make_pair('c', txid));
+        nTransactions++;
+
+        // Each batch moves complete transactions, so the database stays
+        // consistent if we stop between batches and resume later.
+        if (++nBatchSize >= 10000) {
+            if (!db.WriteBatch(batch))
+                return error("%s : failed to write to coin database", __func__);
+            batch.Clear();
+            nBatchSize = 0;
+            // keys are ordered by txid, so its first byte tells how far we got
+            int nPercent = *txid.begin() * 100 / 256;
+            if (nPercent / 10 != nLastPercent / 10) {
+                LogPrintf("Upgrading coin database... %d%%\n", nPercent);
+                nLastPercent = nPercent;
+            }
+            if (ShutdownRequested()) {
+                LogPrintf("Upgrading coin database interrupted, it continues at the next start\n");
+                LOCK(cs_cursor);
+                pcursorCoins.reset();
+                return true;
+            }
+        }
+    }
+    HandleError(pcursor->status());
+    if (!db.WriteBatch(batch))
+        return error("%s : failed to write to coin database", __func__);
+    {
+        LOCK(cs_cursor);
+        pcursorCoins.reset();
+    }
+    LogPrintf("Upgraded %u transactions (%u outputs) in the coin database in %dms\n", nTransactions, nOutputs, GetTimeMillis() - nStart);
+    return true;
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
@@ -114,7 +321,7 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
        only need read operations on it, use a const-cast to get around
        that restriction.  */
     boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    pcursor->SeekToFirst();
+    pcursor->Seek(leveldb::Slice("C", 1));
 
     std::ofstream utxo;
     utxo.open ("utxo.txt");
@@ -123,53 +330,61 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
     CAmount nTotalAmount = 0;
+
+    // The outputs of one transaction are adjacent; gather them and hash
+    // the transaction as a whole.
+    uint256 txhash;
+    CCoins coins;
+    auto hashCoins = [&]() {
+        ss << txhash;
+        ss << VARINT(coins.nVersion);
+        ss << (coins.fCoinBase ? 'c' : 'n');
+        ss << VARINT(coins.nHeight);
+        stats.nTransactions++;
+        for (unsigned int i = 0; i < coins.vout.size(); i++) {
+            const CTxOut& out = coins.vout[i];
+            if (!out.IsNull()) {
+                stats.nTransactionOutputs++;
+                ss << VARINT(i + 1);
+                ss << out;
+                nTotalAmount += out.nValue;
+
+                //print UTXO
+                CKeyID keyId;
+                if(out.GetKeyIDFromUTXO(keyId)) {
+                    CBitcoinAddress addr;
+                    CBitcoinAddress Jaddr;
+                    addr.Set(keyId);
+                    Jaddr.Set(keyId, CChainParams::JACKPOT_PUBKEY_ADDRESS);
+
+                    utxo << "utxo;" << keyId.GetHex() << ";" << addr.ToString() << ";" << Jaddr.ToString() << ";" << out.nValue << std::endl;
+                }
+            }
+        }
+        ss << VARINT(0);
+    };
+
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
             leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'c') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i = 0; i < coins.vout.size(); i++) {
-                    const CTxOut& out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i + 1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-
-                        //print UTXO
-                        CKeyID keyId;
-                        if(out.GetKeyIDFromUTXO(keyId)) {
-                            CBitcoinAddress addr;
-                            CBitcoinAddress Jaddr;
-                            addr.Set(keyId);
-                            Jaddr.Set(keyId, CChainParams::JACKPOT_PUBKEY_ADDRESS);
-
-                            utxo << "utxo;" << keyId.GetHex() << ";" << addr.ToString() << ";" << Jaddr.ToString() << ";" << out.nValue << std::endl;
-                        }
-                    }
-                }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
+            if (slKey.size() == 0 || slKey[0] != 'C')
+                break;
+            // the key starts with 'C' and the txid
+            if (!coins.vout.empty() && (slKey.size() < 33 || memcmp(slKey.data() + 1, txhash.begin(), 32) != 0)) {
+                hashCoins();
+                coins.Clear();
             }
+            leveldb::Slice slValue = pcursor->value();
+            ReadCoinsOutput(slKey, slValue, txhash, coins);
+            stats.nSerializedSize += slKey.size() + slValue.size();
             pcursor->Next();
         } catch (std::exception& e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
+    if (!coins.vout.empty())
+        hashCoins();
     stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
     stats.hashSerialized = ss.GetHash();
     stats.nTotalAmount = nTotalAmount;
@@ -205,6 +420,209 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool GetAddressIndexHash(const CScript& scriptPubKey, uint160& hashBytes)
+{
+    if (scriptPubKey.empty())
+        return false;
+
+    CTxDestination dest;
+    if (ExtractDestination(scriptPubKey, dest))
+        hashBytes = CScriptID(GetScriptForDestination(dest));
+    else
+        hashBytes = CScriptID(scriptPubKey);
+    return true;
+}
+
+void CAddressIndexUpdate::ConnectInputs(const CTransaction& tx, const CCoinsViewCache& view, int nHeight)
+{
+    const uint256 txhash = tx.GetHash();
+    for (unsigned int j = 0; j < tx.vin.size(); j++) {
+        const COutPoint& prevout = tx.vin[j].prevout;
+        const CTxOut& out = view.AccessCoins(prevout.hash)->vout[prevout.n];
+        vSpent.push_back(std::make_pair(prevout, CSpentIndexValue(txhash, j, nHeight)));
+
+        uint160 hashBytes;
+        if (!GetAddressIndexHash(out.scriptPubKey, hashBytes))
+            continue;
+
+        // record spending activity and remove the spent output
+        vAddress.push_back(std::make_pair(CAddressIndexKey(hashBytes, nHeight, txhash, j, true), -out.nValue));
+        vUnspent.push_back(std::make_pair(CAddressUnspentKey(hashBytes, prevout.hash, prevout.n), CAddressUnspentValue()));
+    }
+}
+
+void CAddressIndexUpdate::ConnectOutputs(const CTransaction& tx, int nHeight)
+{
+    const uint256 txhash = tx.GetHash();
+    for (unsigned int k = 0; k < tx.vout.size(); k++) {
+        const CTxOut& out = tx.vout[k];
+        uint160 hashBytes;
+        if (!GetAddressIndexHash(out.scriptPubKey, hashBytes))
+            continue;
+
+        // record receiving activity and the new unspent output
+        vAddress.push_back(std::make_pair(CAddressIndexKey(hashBytes, nHeight, txhash, k, false), out.nValue));
+        vUnspent.push_back(std::make_pair(CAddressUnspentKey(hashBytes, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+    }
+}
+
+void CAddressIndexUpdate::DisconnectOutputs(const CTransaction& tx, int nHeight)
+{
+    const uint256 txhash = tx.GetHash();
+    for (unsigned int k = 0; k < tx.vout.size(); k++) {
+        const CTxOut& out = tx.vout[k];
+        uint160 hashBytes;
+        if (!GetAddressIndexHash(out.scriptPubKey, hashBytes))
+            continue;
+
+        // undo receiving activity and remove the unspent output
+        vAddress.push_back(std::make_pair(CAddressIndexKey(hashBytes, nHeight, txhash, k, false), out.nValue));
+        vUnspent.push_back(std::make_pair(CAddressUnspentKey(hashBytes, txhash, k), CAddressUnspentValue()));
+    }
+}
+
+void CAddressIndexUpdate::DisconnectInput(const CTransaction& tx, unsigned int nIn, const CTxOut& txoutPrev, int nPrevHeight, int nHeight)
+{
+    const COutPoint& prevout = tx.vin[nIn].prevout;
+    vSpent.push_back(std::make_pair(prevout, CSpentIndexValue()));
+
+    uint160 hashBytes;
+    if (!GetAddressIndexHash(txoutPrev.scriptPubKey, hashBytes))
+        return;
+
+    // undo spending activity and restore the unspent output
+    vAddress.push_back(std::make_pair(CAddressIndexKey(hashBytes, nHeight, tx.GetHash(), nIn, true), -txoutPrev.nValue));
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(hashBytes, prevout.hash, prevout.n), CAddressUnspentValue(txoutPrev.nValue, txoutPrev.scriptPubKey, nPrevHeight)));
+}
+
+bool CAddressIndexUpdate::Write(CBlockTreeDB& db, bool fConnect) const
+{
+    if (fConnect ? !db.WriteAddressIndex(vAddress) : !db.EraseAddressIndex(vAddress))
+        return error("%s : failed to %s address index", __func__, fConnect ? "write" : "erase");
+    if (!db.UpdateAddressUnspentIndex(vUnspent))
+        return error("%s : failed to write address unspent index", __func__);
+    if (!db.UpdateSpentIndex(vSpent))
+        return error("%s : failed to write spent index", __func__);
+    return true;
+}
+
+bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        batch.Write(make_pair('a', it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        batch.Erase(make_pair('a', it->first));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(const uint160& hashBytes, std::vector<std::pair<CAddressIndexKey, CAmount> >& vect, int nStart, int nEnd)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('a', CAddressIndexKey(hashBytes, nStart, uint256(0), 0, false));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressIndexKey indexKey;
+            ssKey >> chType;
+            if (chType != 'a')
+                break;
+            ssKey >> indexKey;
+            if (indexKey.hashBytes != hashBytes || (nEnd > 0 && indexKey.nHeight > nEnd))
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAmount nValue;
+            ssValue >> nValue;
+            vect.push_back(make_pair(indexKey, nValue));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('u', it->first));
+        else
+            batch.Write(make_pair('u', it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(const uint160& hashBytes, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('u', CAddressUnspentKey(hashBytes, uint256(0), 0));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressUnspentKey indexKey;
+            ssKey >> chType;
+            if (chType != 'u')
+                break;
+            ssKey >> indexKey;
+            if (indexKey.hashBytes != hashBytes)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue value;
+            ssValue >> value;
+            vect.push_back(make_pair(indexKey, value));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<COutPoint, CSpentIndexValue> >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<COutPoint, CSpentIndexValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('s', it->first));
+        else
+            batch.Write(make_pair('s', it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadSpentIndex(const COutPoint& outpoint, CSpentIndexValue& value)
+{
+    return Read(make_pair('s', outpoint), value);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair('F', name), fValue ? '1' : '0');
@@ -268,13 +686,11 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
                 pindexNew->nTx = diskindex.nTx;
 
                 //Proof Of Stake
-                pindexNew->nMint = diskindex.nMint;
                 pindexNew->nMoneySupply = diskindex.nMoneySupply;
                 pindexNew->nFlags = diskindex.nFlags;
                 pindexNew->nStakeModifier = diskindex.nStakeModifier;
                 pindexNew->prevoutStake = diskindex.prevoutStake;
                 pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
 
                 if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
                     if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
@@ -16,6 +16,9 @@
 #include <utility>
 #include <vector>
 
+#include <boost/scoped_ptr.hpp>
+
+class CBlockTreeDB;
 class CCoins;
 class uint256;
 
@@ -26,12 +29,214 @@ static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
 
-/** CCoinsView backed by the LevelDB coin database (chainstate/) */
+/**
+ * Key of an address index entry: one credit (fSpending == false) or debit
+ * (fSpending == true) of a script, identified by the hash of its canonical
+ * scriptPubKey. The height is serialized big-endian so that LevelDB keeps
+ * the entries of one script sorted by height.
+ */
+struct CAddressIndexKey {
+    uint160 hashBytes;
+    int nHeight;
+    uint256 txhash;
+    unsigned int index;
+    bool fSpending;
+
+    CAddressIndexKey(const uint160& hashBytesIn, int nHeightIn, const uint256& txhashIn, unsigned int indexIn, bool fSpendingIn) : hashBytes(hashBytesIn), nHeight(nHeightIn), txhash(txhashIn), index(indexIn), fSpending(fSpendingIn) {}
+
+    CAddressIndexKey()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        hashBytes.SetNull();
+        nHeight = 0;
+        txhash.SetNull();
+        index = 0;
+        fSpending = false;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 20 + 4 + 32 + 4 + 1;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        hashBytes.Serialize(s, nType, nVersion);
+        unsigned char heightBE[4] = {(unsigned char)(nHeight >> 24), (unsigned char)(nHeight >> 16), (unsigned char)(nHeight >> 8), (unsigned char)nHeight};
+        s.write((const char*)heightBE, sizeof(heightBE));
+        txhash.Serialize(s, nType, nVersion);
+        ::Serialize(s, index, nType, nVersion);
+        ::Serialize(s, fSpending, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        hashBytes.Unserialize(s, nType, nVersion);
+        unsigned char heightBE[4];
+        s.read((char*)heightBE, sizeof(heightBE));
+        nHeight = (heightBE[0] << 24) | (heightBE[1] << 16) | (heightBE[2] << 8) | heightBE[3];
+        txhash.Unserialize(s, nType, nVersion);
+        ::Unserialize(s, index, nType, nVersion);
+        ::Unserialize(s, fSpending, nType, nVersion);
+    }
+};
+
+/** Key of an unspent output in the address index */
+struct CAddressUnspentKey {
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int index;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hashBytes);
+        READWRITE(txhash);
+        READWRITE(index);
+    }
+
+    CAddressUnspentKey(const uint160& hashBytesIn, const uint256& txhashIn, unsigned int indexIn) : hashBytes(hashBytesIn), txhash(txhashIn), index(indexIn) {}
+
+    CAddressUnspentKey()
+    {
+        hashBytes.SetNull();
+        txhash.SetNull();
+        index = 0;
+    }
+};
+
+/** Unspent output of an address; a null value erases the entry */
+struct CAddressUnspentValue {
+    CAmount nValue;
+    CScript script;
+    int nHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nValue);
+        READWRITE(script);
+        READWRITE(nHeight);
+    }
+
+    CAddressUnspentValue(CAmount nValueIn, const CScript& scriptIn, int nHeightIn) : nValue(nValueIn), script(scriptIn), nHeight(nHeightIn) {}
+
+    CAddressUnspentValue()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nValue = -1;
+        script.clear();
+        nHeight = 0;
+    }
+
+    bool IsNull() const
+    {
+        return nValue == -1;
+    }
+};
+
+/** Input that spends an outpoint; a null value erases the entry */
+struct CSpentIndexValue {
+    uint256 txid;
+    unsigned int inputIndex;
+    int nHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(inputIndex);
+        READWRITE(nHeight);
+    }
+
+    CSpentIndexValue(const uint256& txidIn, unsigned int inputIndexIn, int nHeightIn) : txid(txidIn), inputIndex(inputIndexIn), nHeight(nHeightIn) {}
+
+    CSpentIndexValue()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        txid.SetNull();
+        inputIndex = 0;
+        nHeight = 0;
+    }
+
+    bool IsNull() const
+    {
+        return txid.IsNull();
+    }
+};
+
+/**
+ * Hash under which outputs paying to scriptPubKey are kept in the address index.
+ * Pay-to-pubkey and pay-to-pubkey-hash outputs of one key share the hash of the
+ * canonical pay-to-pubkey-hash script. Returns false for empty scripts.
+ */
+bool GetAddressIndexHash(const CScript& scriptPubKey, uint160& hashBytes);
+
+/**
+ * Address, unspent and spent index changes made by connecting or
+ * disconnecting one block, collected per transaction and written at once.
+ */
+class CAddressIndexUpdate
+{
+public:
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddress;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    std::vector<std::pair<COutPoint, CSpentIndexValue> > vSpent;
+
+    //! tx spends its inputs, whose outputs must still be in view
+    void ConnectInputs(const CTransaction& tx, const CCoinsViewCache& view, int nHeight);
+    //! tx pays to its outputs
+    void ConnectOutputs(const CTransaction& tx, int nHeight);
+    //! Undo ConnectOutputs
+    void DisconnectOutputs(const CTransaction& tx, int nHeight);
+    //! Undo the spending of input nIn of tx, which spent txoutPrev created at nPrevHeight
+    void DisconnectInput(const CTransaction& tx, unsigned int nIn, const CTxOut& txoutPrev, int nPrevHeight, int nHeight);
+
+    //! Write what connecting (fConnect) or disconnecting the block changed
+    bool Write(CBlockTreeDB& db, bool fConnect) const;
+};
+
+/**
+ * CCoinsView backed by the LevelDB coin database (chainstate/)
+ *
+ * Every unspent output is its own record, keyed by 'C' + txid + VARINT(n),
+ * so spending one output of a large transaction only touches that record.
+ * Databases written by older versions keep one 'c' record per transaction;
+ * Upgrade() converts those in place. The conversion is one-way: older
+ * versions cannot read the upgraded database and have to -reindex.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CLevelDBWrapper db;
 
+    //! Iterator shared by the lookups, so each one is a single seek. An iterator only sees the
+    //! database as of its creation, so it is dropped after every write.
+    mutable CCriticalSection cs_cursor;
+    mutable boost::scoped_ptr<leveldb::Iterator> pcursorCoins;
+
+    leveldb::Iterator* GetCursor() const;
+
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -40,6 +245,13 @@ public:
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+
+    /**
+     * Convert whole-transaction records to per-output records. Returns false on a read or write
+     * error. A shutdown request stops it between batches with the database consistent; the rest
+     * is converted at the next start.
+     */
+    bool Upgrade();
 };
 
 /** Access to the block database (blocks/index/) */
@@ -61,6 +273,13 @@ public:
     bool ReadReindexing(bool& fReindex);
     bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
+    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect);
+    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect);
+    bool ReadAddressIndex(const uint160& hashBytes, std::vector<std::pair<CAddressIndexKey, CAmount> >& vect, int nStart = 0, int nEnd = 0);
+    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect);
+    bool ReadAddressUnspentIndex(const uint160& hashBytes, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect);
+    bool UpdateSpentIndex(const std::vector<std::pair<COutPoint, CSpentIndexValue> >& vect);
+    bool ReadSpentIndex(const COutPoint& outpoint, CSpentIndexValue& value);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
@@ -14,20 +14,29 @@
 #include "utilmoneystr.h"
 #include "version.h"
 
+#include <cmath>
+
 #include <boost/circular_buffer.hpp>
 
 using namespace std;
 
-CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0)
+CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0), nModFee(0)
 {
     nHeight = MEMPOOL_HEIGHT;
+    nCountWithAncestors = nCountWithDescendants = 1;
+    nSizeWithAncestors = nSizeWithDescendants = 0;
+    nModFeesWithAncestors = nModFeesWithDescendants = 0;
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight)
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight), nModFee(_nFee)
 {
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
 
     nModSize = tx.CalculateModifiedSize(nTxSize);
+
+    nCountWithAncestors = nCountWithDescendants = 1;
+    nSizeWithAncestors = nSizeWithDescendants = nTxSize;
+    nModFeesWithAncestors = nModFeesWithDescendants = nModFee;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -357,7 +366,10 @@ public:
 
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) : nTransactionsUpdated(0),
-                                                       minRelayFee(_minRelayFee)
+                                                       minRelayFee(_minRelayFee),
+                                                       totalTxSize(0),
+                                                       rollingMinimumFeeRate(0),
+                                                       nLastRollingFeeUpdate(0)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
@@ -403,6 +415,98 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 }
 
 
+void CTxMemPool::IndexEntry(const uint256& hash, const CTxMemPoolEntry& entry)
+{
+    setAncestorScore.insert(CMempoolScore(entry.nModFeesWithAncestors, entry.nSizeWithAncestors, hash));
+    setDescendantScore.insert(CMempoolScore(entry.nModFeesWithDescendants, entry.nSizeWithDescendants, hash));
+}
+
+void CTxMemPool::UnindexEntry(const uint256& hash, const CTxMemPoolEntry& entry)
+{
+    setAncestorScore.erase(CMempoolScore(entry.nModFeesWithAncestors, entry.nSizeWithAncestors, hash));
+    setDescendantScore.erase(CMempoolScore(entry.nModFeesWithDescendants, entry.nSizeWithDescendants, hash));
+}
+
+void CTxMemPool::UpdateAncestorState(const uint256& hash, int64_t nCountDelta, int64_t nSizeDelta, CAmount nFeeDelta)
+{
+    CTxMemPoolEntry& entry = mapTx[hash];
+    UnindexEntry(hash, entry);
+    entry.nCountWithAncestors += nCountDelta;
+    entry.nSizeWithAncestors += nSizeDelta;
+    entry.nModFeesWithAncestors += nFeeDelta;
+    IndexEntry(hash, entry);
+}
+
+void CTxMemPool::UpdateDescendantState(const uint256& hash, int64_t nCountDelta, int64_t nSizeDelta, CAmount nFeeDelta)
+{
+    CTxMemPoolEntry& entry = mapTx[hash];
+    UnindexEntry(hash, entry);
+    entry.nCountWithDescendants += nCountDelta;
+    entry.nSizeWithDescendants += nSizeDelta;
+    entry.nModFeesWithDescendants += nFeeDelta;
+    IndexEntry(hash, entry);
+}
+
+void CTxMemPool::RecalculateState(const uint256& hash)
+{
+    CTxMemPoolEntry& entry = mapTx[hash];
+    UnindexEntry(hash, entry);
+
+    std::set<uint256> setAncestors, setDescendants;
+    CalculateAncestors(hash, setAncestors);
+    CalculateDescendants(hash, setDescendants);
+
+    entry.nCountWithAncestors = entry.nCountWithDescendants = 1;
+    entry.nSizeWithAncestors = entry.nSizeWithDescendants = entry.GetTxSize();
+    entry.nModFeesWithAncestors = entry.nModFeesWithDescendants = entry.GetModifiedFee();
+    for (const uint256& hashAncestor : setAncestors) {
+        const CTxMemPoolEntry& ancestor = mapTx[hashAncestor];
+        entry.nCountWithAncestors++;
+        entry.nSizeWithAncestors += ancestor.GetTxSize();
+        entry.nModFeesWithAncestors += ancestor.GetModifiedFee();
+    }
+    for (const uint256& hashDescendant : setDescendants) {
+        const CTxMemPoolEntry& descendant = mapTx[hashDescendant];
+        entry.nCountWithDescendants++;
+        entry.nSizeWithDescendants += descendant.GetTxSize();
+        entry.nModFeesWithDescendants += descendant.GetModifiedFee();
+    }
+
+    IndexEntry(hash, entry);
+}
+
+void CTxMemPool::CalculateAncestors(const uint256& hash, std::set<uint256>& setAncestors) const
+{
+    LOCK(cs);
+    std::vector<uint256> vToVisit(1, hash);
+    while (!vToVisit.empty()) {
+        std::map<uint256, TxLinks>::const_iterator it = mapLinks.find(vToVisit.back());
+        vToVisit.pop_back();
+        if (it == mapLinks.end())
+            continue;
+        for (const uint256& hashParent : it->second.setParents) {
+            if (setAncestors.insert(hashParent).second)
+                vToVisit.push_back(hashParent);
+        }
+    }
+}
+
+void CTxMemPool::CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const
+{
+    LOCK(cs);
+    std::vector<uint256> vToVisit(1, hash);
+    while (!vToVisit.empty()) {
+        std::map<uint256, TxLinks>::const_iterator it = mapLinks.find(vToVisit.back());
+        vToVisit.pop_back();
+        if (it == mapLinks.end())
+            continue;
+        for (const uint256& hashChild : it->second.setChildren) {
+            if (setDescendants.insert(hashChild).second)
+                vToVisit.push_back(hashChild);
+        }
+    }
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
 {
     // Add to memory pool without checking anything.
@@ -410,16 +514,109 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
     // all the appropriate checks.
     LOCK(cs);
     {
-        mapTx[hash] = entry;
-        const CTransaction& tx = mapTx[hash].GetTx();
-        for (unsigned int i = 0; i < tx.vin.size(); i++)
+        if (mapTx.count(hash))
+            return false;
+        CTxMemPoolEntry& newEntry = mapTx[hash] = entry;
+
+        double dPriorityDelta = 0;
+        CAmount nFeeDelta = 0;
+        ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
+        newEntry.nModFee = newEntry.GetFee() + nFeeDelta;
+        newEntry.nCountWithAncestors = newEntry.nCountWithDescendants = 1;
+        newEntry.nSizeWithAncestors = newEntry.nSizeWithDescendants = newEntry.GetTxSize();
+        newEntry.nModFeesWithAncestors = newEntry.nModFeesWithDescendants = newEntry.nModFee;
+
+        const CTransaction& tx = newEntry.GetTx();
+        TxLinks& links = mapLinks[hash];
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
             mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+            if (mapTx.count(tx.vin[i].prevout.hash)) {
+                links.setParents.insert(tx.vin[i].prevout.hash);
+                mapLinks[tx.vin[i].prevout.hash].setChildren.insert(hash);
+            }
+        }
+        // Spenders can already be here when a reorg returns a transaction to the pool
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
+            if (it == mapNextTx.end())
+                continue;
+            uint256 hashChild = it->second.ptx->GetHash();
+            links.setChildren.insert(hashChild);
+            mapLinks[hashChild].setParents.insert(hash);
+        }
+
+        std::set<uint256> setAncestors;
+        CalculateAncestors(hash, setAncestors);
+        if (links.setChildren.empty()) {
+            // A new leaf: it only adds itself to its ancestors' descendants
+            for (const uint256& hashAncestor : setAncestors) {
+                const CTxMemPoolEntry& ancestor = mapTx[hashAncestor];
+                newEntry.nCountWithAncestors++;
+                newEntry.nSizeWithAncestors += ancestor.GetTxSize();
+                newEntry.nModFeesWithAncestors += ancestor.GetModifiedFee();
+                UpdateDescendantState(hashAncestor, 1, newEntry.GetTxSize(), newEntry.nModFee);
+            }
+            IndexEntry(hash, newEntry);
+        } else {
+            std::set<uint256> setAffected;
+            CalculateDescendants(hash, setAffected);
+            for (const uint256& hashDescendant : std::set<uint256>(setAffected)) {
+                std::set<uint256> setDescendantAncestors;
+                CalculateAncestors(hashDescendant, setDescendantAncestors);
+                setAffected.insert(setDescendantAncestors.begin(), setDescendantAncestors.end());
+            }
+            setAffected.insert(setAncestors.begin(), setAncestors.end());
+            IndexEntry(hash, newEntry);
+            for (const uint256& hashAffected : setAffected)
+                RecalculateState(hashAffected);
+        }
+
         nTransactionsUpdated++;
         totalTxSize += entry.GetTxSize();
     }
     return true;
 }
 
+void CTxMemPool::removeUnchecked(const uint256& hash)
+{
+    std::map<uint256, CTxMemPoolEntry>::iterator it = mapTx.find(hash);
+    const CTxMemPoolEntry& entry = it->second;
+    const CTransaction& tx = entry.GetTx();
+
+    std::set<uint256> setAncestors, setDescendants;
+    CalculateAncestors(hash, setAncestors);
+    CalculateDescendants(hash, setDescendants);
+
+    std::map<uint256, TxLinks>::iterator itLinks = mapLinks.find(hash);
+    for (const uint256& hashParent : itLinks->second.setParents)
+        mapLinks[hashParent].setChildren.erase(hash);
+    for (const uint256& hashChild : itLinks->second.setChildren)
+        mapLinks[hashChild].setParents.erase(hash);
+    mapLinks.erase(itLinks);
+
+    if (setAncestors.empty() || setDescendants.empty()) {
+        for (const uint256& hashAncestor : setAncestors)
+            UpdateDescendantState(hashAncestor, -1, -(int64_t)entry.GetTxSize(), -entry.GetModifiedFee());
+        for (const uint256& hashDescendant : setDescendants)
+            UpdateAncestorState(hashDescendant, -1, -(int64_t)entry.GetTxSize(), -entry.GetModifiedFee());
+    }
+
+    for (const CTxIn& txin : tx.vin)
+        mapNextTx.erase(txin.prevout);
+
+    UnindexEntry(hash, entry);
+    totalTxSize -= entry.GetTxSize();
+    mapTx.erase(it);
+    nTransactionsUpdated++;
+
+    if (!setAncestors.empty() && !setDescendants.empty()) {
+        // Taken out of the middle: its descendants may no longer descend from its ancestors
+        for (const uint256& hashAncestor : setAncestors)
+            RecalculateState(hashAncestor);
+        for (const uint256& hashDescendant : setDescendants)
+            RecalculateState(hashDescendant);
+    }
+}
 
 void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& removed, bool fRecursive)
 {
@@ -454,13 +651,9 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
                     txToRemove.push_back(it->second.ptx->GetHash());
                 }
             }
-            for (const CTxIn& txin : tx.vin)
-                mapNextTx.erase(txin.prevout);
 
             removed.push_back(tx);
-            totalTxSize -= mapTx[hash].GetTxSize();
-            mapTx.erase(hash);
-            nTransactionsUpdated++;
+            removeUnchecked(hash);
         }
     }
 }
@@ -533,6 +726,9 @@ void CTxMemPool::clear()
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    mapLinks.clear();
+    setAncestorScore.clear();
+    setDescendantScore.clear();
     totalTxSize = 0;
     ++nTransactionsUpdated;
 }
@@ -608,9 +804,81 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
         assert(it->first == it->second.ptx->vin[it->second.n].prevout);
     }
 
+    // Check the cached package state against the link graph
+    for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
+        const CTxMemPoolEntry& entry = it->second;
+        std::set<uint256> setAncestors, setDescendants;
+        CalculateAncestors(it->first, setAncestors);
+        CalculateDescendants(it->first, setDescendants);
+        uint64_t nSizeCheck = entry.GetTxSize();
+        CAmount nFeesCheck = entry.GetModifiedFee();
+        for (const uint256& hashAncestor : setAncestors) {
+            nSizeCheck += mapTx.find(hashAncestor)->second.GetTxSize();
+            nFeesCheck += mapTx.find(hashAncestor)->second.GetModifiedFee();
+        }
+        assert(entry.GetCountWithAncestors() == setAncestors.size() + 1);
+        assert(entry.GetSizeWithAncestors() == nSizeCheck);
+        assert(entry.GetModFeesWithAncestors() == nFeesCheck);
+        nSizeCheck = entry.GetTxSize();
+        nFeesCheck = entry.GetModifiedFee();
+        for (const uint256& hashDescendant : setDescendants) {
+            nSizeCheck += mapTx.find(hashDescendant)->second.GetTxSize();
+            nFeesCheck += mapTx.find(hashDescendant)->second.GetModifiedFee();
+        }
+        assert(entry.GetCountWithDescendants() == setDescendants.size() + 1);
+        assert(entry.GetSizeWithDescendants() == nSizeCheck);
+        assert(entry.GetModFeesWithDescendants() == nFeesCheck);
+        assert(setAncestorScore.count(CMempoolScore(entry.GetModFeesWithAncestors(), entry.GetSizeWithAncestors(), it->first)));
+        assert(setDescendantScore.count(CMempoolScore(entry.GetModFeesWithDescendants(), entry.GetSizeWithDescendants(), it->first)));
+    }
+    assert(setAncestorScore.size() == mapTx.size());
+    assert(setDescendantScore.size() == mapTx.size());
+    assert(mapLinks.size() == mapTx.size());
+
     assert(totalTxSize == checkTotal);
 }
 
+void CTxMemPool::TrimToSize(size_t nSizeLimit, std::list<CTransaction>& removed)
+{
+    LOCK(cs);
+    unsigned int nEvicted = 0;
+    while (totalTxSize > nSizeLimit && !setDescendantScore.empty()) {
+        // The package with the lowest fee rate goes first; new transactions
+        // must beat it by at least the relay fee to get back in
+        const CMempoolScore worst = *setDescendantScore.rbegin();
+        double dFeeRate = worst.GetFeeRate().GetFeePerK() + minRelayFee.GetFeePerK();
+        if (dFeeRate > rollingMinimumFeeRate) {
+            rollingMinimumFeeRate = dFeeRate;
+            nLastRollingFeeUpdate = GetTime();
+        }
+
+        std::list<CTransaction> evicted;
+        remove(mapTx[worst.hash].GetTx(), evicted, true);
+        nEvicted += evicted.size();
+        removed.splice(removed.end(), evicted);
+    }
+    if (nEvicted)
+        LogPrint("mempool", "Evicted %u transactions to keep the mempool below %u bytes, minimum fee rate now %s\n", nEvicted, nSizeLimit, CFeeRate((CAmount)rollingMinimumFeeRate).ToString());
+}
+
+CFeeRate CTxMemPool::GetMinFee() const
+{
+    LOCK(cs);
+    if (rollingMinimumFeeRate == 0)
+        return CFeeRate(0);
+
+    int64_t nTime = GetTime();
+    if (nTime > nLastRollingFeeUpdate + 10) {
+        rollingMinimumFeeRate /= pow(2.0, (nTime - nLastRollingFeeUpdate) / (double)ROLLING_FEE_HALFLIFE);
+        nLastRollingFeeUpdate = nTime;
+        if (rollingMinimumFeeRate < minRelayFee.GetFeePerK() / 2) {
+            rollingMinimumFeeRate = 0;
+            return CFeeRate(0);
+        }
+    }
+    return CFeeRate((CAmount)rollingMinimumFeeRate);
+}
+
 void CTxMemPool::queryHashes(vector<uint256>& vtxid)
 {
     vtxid.clear();
@@ -679,6 +947,25 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string strHash,
         std::pair<double, CAmount>& deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+
+        std::map<uint256, CTxMemPoolEntry>::iterator it = mapTx.find(hash);
+        if (it != mapTx.end() && nFeeDelta != 0) {
+            // The whole package's fee rate moves with it
+            CTxMemPoolEntry& entry = it->second;
+            UnindexEntry(hash, entry);
+            entry.nModFee += nFeeDelta;
+            entry.nModFeesWithAncestors += nFeeDelta;
+            entry.nModFeesWithDescendants += nFeeDelta;
+            IndexEntry(hash, entry);
+
+            std::set<uint256> setAncestors, setDescendants;
+            CalculateAncestors(hash, setAncestors);
+            CalculateDescendants(hash, setDescendants);
+            for (const uint256& hashAncestor : setAncestors)
+                UpdateDescendantState(hashAncestor, 0, 0, nFeeDelta);
+            for (const uint256& hashDescendant : setDescendants)
+                UpdateAncestorState(hashDescendant, 0, 0, nFeeDelta);
+        }
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
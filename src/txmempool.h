@@ -9,6 +9,7 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <set>
 
 #include "amount.h"
 #include "coins.h"
@@ -46,6 +47,19 @@ private:
     int64_t nTime;        //! Local time when entering the mempool
     double dPriority;     //! Priority when entering the mempool
     unsigned int nHeight; //! Chain height when entering the mempool
+    CAmount nModFee;      //! Fee including the delta set by PrioritiseTransaction
+
+    //! Totals over this transaction and all its in-mempool ancestors
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+
+    //! Totals over this transaction and all its in-mempool descendants
+    uint64_t nCountWithDescendants;
+    uint64_t nSizeWithDescendants;
+    CAmount nModFeesWithDescendants;
+
+    friend class CTxMemPool;
 
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
@@ -58,6 +72,41 @@ public:
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
+    CAmount GetModifiedFee() const { return nModFee; }
+
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
+};
+
+/**
+ * Fee rate of a mempool transaction together with its ancestors or its
+ * descendants. Sorts by fee rate, highest first, then by hash.
+ */
+class CMempoolScore
+{
+public:
+    CAmount nFees;
+    uint64_t nSize;
+    uint256 hash;
+
+    CMempoolScore(CAmount nFeesIn, uint64_t nSizeIn, const uint256& hashIn) : nFees(nFeesIn), nSize(nSizeIn), hash(hashIn) {}
+
+    CFeeRate GetFeeRate() const { return CFeeRate(nFees, nSize); }
+
+    friend bool operator<(const CMempoolScore& a, const CMempoolScore& b)
+    {
+        // a.nFees / a.nSize > b.nFees / b.nSize, without the divisions
+        double f1 = (double)a.nFees * b.nSize;
+        double f2 = (double)b.nFees * a.nSize;
+        if (f1 != f2)
+            return f1 > f2;
+        return a.hash < b.hash;
+    }
 };
 
 class CMinerPolicyEstimator;
@@ -103,7 +152,30 @@ private:
     CFeeRate minRelayFee; //! Passed to constructor to avoid dependency on main
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
 
+    //! In-mempool parents and children of each transaction
+    struct TxLinks {
+        std::set<uint256> setParents;
+        std::set<uint256> setChildren;
+    };
+    std::map<uint256, TxLinks> mapLinks;
+
+    std::set<CMempoolScore> setAncestorScore;   //! Mining order: best package fee rate first
+    std::set<CMempoolScore> setDescendantScore; //! Eviction order: worst package fee rate last
+
+    //! Fee rate a transaction needs after the pool was trimmed; decays with ROLLING_FEE_HALFLIFE
+    mutable double rollingMinimumFeeRate;
+    mutable int64_t nLastRollingFeeUpdate;
+
+    void IndexEntry(const uint256& hash, const CTxMemPoolEntry& entry);
+    void UnindexEntry(const uint256& hash, const CTxMemPoolEntry& entry);
+    void UpdateAncestorState(const uint256& hash, int64_t nCountDelta, int64_t nSizeDelta, CAmount nFeeDelta);
+    void UpdateDescendantState(const uint256& hash, int64_t nCountDelta, int64_t nSizeDelta, CAmount nFeeDelta);
+    void RecalculateState(const uint256& hash);
+    void removeUnchecked(const uint256& hash);
+
 public:
+    static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12;
+
     mutable CCriticalSection cs;
     std::map<uint256, CTxMemPoolEntry> mapTx;
     std::map<COutPoint, CInPoint> mapNextTx;
@@ -122,6 +194,22 @@ public:
     void setSanityCheck(bool _fSanityCheck) { fSanityCheck = _fSanityCheck; }
 
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry);
+
+    /** Collect the in-mempool ancestors or descendants of a transaction, not including itself */
+    void CalculateAncestors(const uint256& hash, std::set<uint256>& setAncestors) const;
+    void CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const;
+
+    /** Transactions sorted by the fee rate of their ancestor package; cs must be held */
+    const std::set<CMempoolScore>& GetAncestorScoreIndex() const { return setAncestorScore; }
+
+    /**
+     * Evict the packages with the lowest descendant fee rate until the
+     * serialized size of the pool is at most nSizeLimit, and raise the
+     * fee rate GetMinFee() asks for accordingly.
+     */
+    void TrimToSize(size_t nSizeLimit, std::list<CTransaction>& removed);
+    /** Fee rate new transactions need since the pool was last trimmed */
+    CFeeRate GetMinFee() const;
     void remove(const CTransaction& tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned int nMemPoolHeight);
     void removeConflicts(const CTransaction& tx, std::list<CTransaction>& removed);
@@ -15,13 +15,17 @@
 
 #include "allocators.h"
 #include "chainparamsbase.h"
+#include "mpscqueue.h"
 #include "random.h"
 #include "serialize.h"
 #include "sync.h"
 #include "utilstrencodings.h"
 #include "utiltime.h"
 
+#include <atomic>
+#include <chrono>
 #include <stdarg.h>
+#include <thread>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <openssl/bio.h>
@@ -219,6 +223,17 @@ static void DebugPrintInit()
     mutexDebugLog = new boost::mutex();
 }
 
+/**
+ * The -debug settings as seen by one thread. Categories are compared with
+ * strcmp so that a disabled LogPrint does not allocate.
+ */
+struct CLogCategories {
+    bool fAll;
+    std::vector<std::string> vCategories;
+
+    CLogCategories() : fAll(false) {}
+};
+
 bool LogAcceptCategory(const char* category)
 {
     if (category != NULL) {
@@ -229,30 +244,207 @@ bool LogAcceptCategory(const char* category)
         // This helps prevent issues debugging global destructors,
         // where mapMultiArgs might be deleted before another
         // global destructor calls LogPrint()
-        static boost::thread_specific_ptr<set<string> > ptrCategory;
+        static boost::thread_specific_ptr<CLogCategories> ptrCategory;
         if (ptrCategory.get() == NULL) {
             const vector<string>& categories = mapMultiArgs["-debug"];
-            ptrCategory.reset(new set<string>(categories.begin(), categories.end()));
-            // thread_specific_ptr automatically deletes the set when the thread ends.
-            // "esbcoin" is a composite category enabling all esbcoin-related debug output
-            if (ptrCategory->count(string("esbcoin"))) {
-                ptrCategory->insert(string("obfuscation"));
-                ptrCategory->insert(string("swiftx"));
-                ptrCategory->insert(string("masternode"));
-                ptrCategory->insert(string("mnpayments"));
-                ptrCategory->insert(string("tx"));
+            ptrCategory.reset(new CLogCategories());
+            // thread_specific_ptr automatically deletes the settings when the thread ends.
+            for (const string& strCategory : categories) {
+                if (strCategory.empty()) {
+                    ptrCategory->fAll = true;
+                } else if (strCategory == "esbcoin") {
+                    // "esbcoin" is a composite category enabling all esbcoin-related debug output
+                    ptrCategory->vCategories.push_back("obfuscation");
+                    ptrCategory->vCategories.push_back("swiftx");
+                    ptrCategory->vCategories.push_back("masternode");
+                    ptrCategory->vCategories.push_back("mnpayments");
+                    ptrCategory->vCategories.push_back("tx");
+                }
+                ptrCategory->vCategories.push_back(strCategory);
             }
         }
-        const set<string>& setCategories = *ptrCategory.get();
+        const CLogCategories& logCategories = *ptrCategory.get();
 
         // if not debugging everything and not debugging specific category, LogPrint does nothing.
-        if (setCategories.count(string("")) == 0 &&
-            setCategories.count(string(category)) == 0)
-            return false;
+        if (logCategories.fAll)
+            return true;
+        for (const string& strCategory : logCategories.vCategories)
+            if (strcmp(strCategory.c_str(), category) == 0)
+                return true;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Debug log writer thread. While it runs, LogPrintStr only moves messages
+ * into logQueue and this thread timestamps them and writes them out in
+ * batches, so that threads that log heavily do not wait on the disk.
+ */
+struct CLogMessage {
+    int64_t nTime;
+    std::string str;
+
+    CLogMessage() : nTime(0) {}
+};
+
+static CMPSCQueue<CLogMessage>* plogQueue = NULL;
+static boost::thread* plogThread = NULL;
+static boost::mutex* mutexLogWait = NULL;
+static boost::condition_variable* condLogWait = NULL;
+//! LogPrintStr queues messages while set
+static std::atomic<bool> fLogQueueEnabled(false);
+//! LogPrintStr calls currently using the queue
+static std::atomic<int> nLogQueueUsers(0);
+static std::atomic<bool> fLogThreadIdle(false);
+static std::atomic<bool> fLogThreadStop(false);
+//! Messages dropped because the queue stayed full
+static std::atomic<uint64_t> nLogDropped(0);
+
+//! Upper bound on the bytes written per fwrite
+static const size_t MAX_LOG_BATCH_SIZE = 1 << 16;
+//! How long a message waits for room in a full queue before it is dropped
+static const int LOG_QUEUE_FULL_WAIT_MICROS = 20000;
+
+static bool fStartedNewLine = true;
+
+static void ReopenDebugLogIfRequested()
+{
+    if (fReopenDebugLog) {
+        fReopenDebugLog = false;
+        boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
+        if (freopen(pathDebug.string().c_str(), "a", fileout) != NULL)
+            setbuf(fileout, NULL); // unbuffered
     }
+}
+
+//! Append a message as it goes to debug.log; mutexDebugLog must be held
+static void FormatDebugLog(std::string& strOut, const std::string& str, int64_t nTime)
+{
+    // Debug print useful for profiling
+    if (fLogTimestamps && fStartedNewLine)
+        strOut += DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTime) + " ";
+    fStartedNewLine = !str.empty() && str[str.size() - 1] == '\n';
+    strOut += str;
+}
+
+static bool QueueDebugLog(const std::string& str)
+{
+    nLogQueueUsers++;
+    if (!fLogQueueEnabled) {
+        nLogQueueUsers--;
+        return false;
+    }
+
+    CLogMessage msg;
+    msg.nTime = GetTime();
+    msg.str = str;
+    bool fQueued = plogQueue->TryPush(msg);
+    // Back-pressure: a full queue holds the caller up for a while before its message is dropped
+    for (int nWaited = 0; !fQueued && nWaited < LOG_QUEUE_FULL_WAIT_MICROS; nWaited += 100) {
+        condLogWait->notify_one();
+        // not boost::this_thread::sleep, which is an interruption point
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        fQueued = plogQueue->TryPush(msg);
+    }
+    if (!fQueued)
+        nLogDropped++;
+    else if (fLogThreadIdle)
+        condLogWait->notify_one();
+
+    nLogQueueUsers--;
     return true;
 }
 
+static void ThreadDebugLog()
+{
+    RenameThread("esbcoin-log");
+
+    std::string strBatch;
+    CLogMessage msg;
+    while (true) {
+        strBatch.clear();
+        {
+            boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+            if (fLogThreadStop) {
+                // Hand back to direct writes while holding the log file, so that they
+                // wait until everything queued before them is written out
+                fLogQueueEnabled = false;
+                bool fLast = false;
+                while (!fLast) {
+                    fLast = nLogQueueUsers == 0;
+                    while (plogQueue->TryPop(msg)) {
+                        FormatDebugLog(strBatch, msg.str, msg.nTime);
+                        msg.str.clear();
+                    }
+                    if (!fLast)
+                        std::this_thread::yield();
+                }
+                uint64_t nDropped = nLogDropped.exchange(0);
+                if (nDropped)
+                    FormatDebugLog(strBatch, strprintf("ThreadDebugLog : log buffer full, %u messages dropped\n", nDropped), GetTime());
+                ReopenDebugLogIfRequested();
+                fwrite(strBatch.data(), 1, strBatch.size(), fileout);
+                return;
+            }
+
+            while (strBatch.size() < MAX_LOG_BATCH_SIZE && plogQueue->TryPop(msg)) {
+                FormatDebugLog(strBatch, msg.str, msg.nTime);
+                msg.str.clear();
+            }
+            uint64_t nDropped = nLogDropped.exchange(0);
+            if (nDropped)
+                FormatDebugLog(strBatch, strprintf("ThreadDebugLog : log buffer full, %u messages dropped\n", nDropped), GetTime());
+
+            if (!strBatch.empty()) {
+                ReopenDebugLogIfRequested();
+                fwrite(strBatch.data(), 1, strBatch.size(), fileout);
+                continue;
+            }
+        }
+
+        // Producers only signal an idle thread, a missed signal costs at most the timeout
+        fLogThreadIdle = true;
+        {
+            boost::unique_lock<boost::mutex> lock(*mutexLogWait);
+            condLogWait->timed_wait(lock, boost::posix_time::milliseconds(100));
+        }
+        fLogThreadIdle = false;
+    }
+}
+
+void StartDebugLogThread(size_t nQueueSize)
+{
+    if (nQueueSize == 0 || fPrintToConsole || !fPrintToDebugLog || plogThread)
+        return;
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+    if (fileout == NULL)
+        return;
+
+    // Never freed: late global destructors may still log through LogPrintStr
+    if (!plogQueue) {
+        plogQueue = new CMPSCQueue<CLogMessage>(nQueueSize);
+        mutexLogWait = new boost::mutex();
+        condLogWait = new boost::condition_variable();
+    }
+    fLogThreadStop = false;
+    plogThread = new boost::thread(&ThreadDebugLog);
+    fLogQueueEnabled = true;
+}
+
+void StopDebugLogThread()
+{
+    if (!plogThread)
+        return;
+
+    // Messages keep going through the queue until the thread has written it out
+    fLogThreadStop = true;
+    condLogWait->notify_one();
+    plogThread->join();
+    delete plogThread;
+    plogThread = NULL;
+}
+
 int LogPrintStr(const std::string& str)
 {
     int ret = 0; // Returns total number of characters written
@@ -261,31 +453,22 @@ int LogPrintStr(const std::string& str)
         ret = fwrite(str.data(), 1, str.size(), stdout);
         fflush(stdout);
     } else if (fPrintToDebugLog && AreBaseParamsConfigured()) {
-        static bool fStartedNewLine = true;
         boost::call_once(&DebugPrintInit, debugPrintInitFlag);
 
         if (fileout == NULL)
             return ret;
 
+        if (QueueDebugLog(str))
+            return str.size();
+
         boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
 
         // reopen the log file, if requested
-        if (fReopenDebugLog) {
-            fReopenDebugLog = false;
-            boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
-            if (freopen(pathDebug.string().c_str(), "a", fileout) != NULL)
-                setbuf(fileout, NULL); // unbuffered
-        }
-
-        // Debug print useful for profiling
-        if (fLogTimestamps && fStartedNewLine)
-            ret += fprintf(fileout, "%s ", DateTimeStrFormat("%Y-%m-%d %H:%M:%S", GetTime()).c_str());
-        if (!str.empty() && str[str.size() - 1] == '\n')
-            fStartedNewLine = true;
-        else
-            fStartedNewLine = false;
+        ReopenDebugLogIfRequested();
 
-        ret = fwrite(str.data(), 1, str.size(), fileout);
+        std::string strOut;
+        FormatDebugLog(strOut, str, GetTime());
+        ret = fwrite(strOut.data(), 1, strOut.size(), fileout);
     }
 
     return ret;
@@ -59,23 +59,39 @@ extern volatile bool fReopenDebugLog;
 
 void SetupEnvironment();
 
+//! -logqueuesize default, 0 writes debug.log directly from the threads that log
+static const unsigned int DEFAULT_LOG_QUEUE_SIZE = 8192;
+
 /** Return true if log accepts specified category */
 bool LogAcceptCategory(const char* category);
 /** Send a string to the log output */
 int LogPrintStr(const std::string& str);
+/** Hand debug.log writes to a background thread that takes them from a queue of nQueueSize messages */
+void StartDebugLogThread(size_t nQueueSize);
+/** Write out what is queued and go back to writing debug.log directly */
+void StopDebugLogThread();
+
+#define LogPrintf(...) LogPrintFormatted(__VA_ARGS__)
 
-#define LogPrintf(...) LogPrint(NULL, __VA_ARGS__)
+/**
+ * Print to debug.log if -debug=category switch is given OR category is NULL.
+ * The format arguments are neither evaluated nor formatted when the category is off.
+ */
+#define LogPrint(category, ...)                   \
+    do {                                          \
+        if (LogAcceptCategory(category))          \
+            LogPrintFormatted(__VA_ARGS__);       \
+    } while (0)
 
 /**
  * When we switch to C++11, this can be switched to variadic templates instead
  * of this macro-based construction (see tinyformat.h).
  */
 #define MAKE_ERROR_AND_LOG_FUNC(n)                                                              \
-    /**   Print to debug.log if -debug=category switch is given OR category is NULL. */         \
+    /**   Format and print to debug.log unconditionally, see LogPrint. */                      \
     template <TINYFORMAT_ARGTYPES(n)>                                                           \
-    static inline int LogPrint(const char* category, const char* format, TINYFORMAT_VARARGS(n)) \
+    static inline int LogPrintFormatted(const char* format, TINYFORMAT_VARARGS(n))              \
     {                                                                                           \
-        if (!LogAcceptCategory(category)) return 0;                                             \
         return LogPrintStr(tfm::format(format, TINYFORMAT_PASSARGS(n)));                        \
     }                                                                                           \
     /**   Log error and return false */                                                         \
@@ -92,9 +108,8 @@ TINYFORMAT_FOREACH_ARGNUM(MAKE_ERROR_AND_LOG_FUNC)
  * Zero-arg versions of logging and error, these are not covered by
  * TINYFORMAT_FOREACH_ARGNUM
  */
-static inline int LogPrint(const char* category, const char* format)
+static inline int LogPrintFormatted(const char* format)
 {
-    if (!LogAcceptCategory(category)) return 0;
     return LogPrintStr(format);
 }
 static inline bool error(const char* format)
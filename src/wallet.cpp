@@ -36,6 +36,7 @@ CFeeRate payTxFee(DEFAULT_TRANSACTION_FEE);
 CAmount maxTxFee = DEFAULT_TRANSACTION_MAXFEE;
 unsigned int nTxConfirmTarget = 1;
 bool bSpendZeroConfChange = true;
+int nRescanThreads = 1;
 bool fSendFreeTransactions = false;
 bool fPayAtLeastCustomFee = true;
 
@@ -627,9 +628,44 @@ void CWallet::MarkDirty()
 {
     {
         LOCK(cs_wallet);
-        for (PAIRTYPE(const uint256, CWalletTx) & item : mapWallet)
+        for (PAIRTYPE(const uint256, CWalletTx) & item : mapWallet) {
             item.second.MarkDirty();
+            setUnspentCandidates.insert(item.first);
+        }
+        nBalanceGeneration++;
+    }
+}
+
+void CWallet::AddUnspentCandidate(const uint256& hash)
+{
+    AssertLockHeld(cs_wallet);
+    setUnspentCandidates.insert(hash);
+    nBalanceGeneration++;
+}
+
+void CWallet::AddUnspentCandidates(const CTransaction& tx)
+{
+    AssertLockHeld(cs_wallet);
+    // Spending (or un-spending) an output changes the balance of the
+    // transaction that created it, so that one has to be looked at again too
+    AddUnspentCandidate(tx.GetHash());
+    for (const CTxIn& txin : tx.vin) {
+        if (mapWallet.count(txin.prevout.hash))
+            setUnspentCandidates.insert(txin.prevout.hash);
+    }
+}
+
+bool CWallet::IsFullySpent(const CWalletTx& wtx) const
+{
+    if ((wtx.IsCoinBase() || wtx.IsCoinStake()) && wtx.GetBlocksToMaturity() > 0)
+        return false;
+
+    uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        if (IsMine(wtx.vout[i]) != ISMINE_NO && !IsSpent(hash, i))
+            return false;
     }
+    return true;
 }
 
 bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
@@ -640,6 +676,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         mapWallet[hash] = wtxIn;
         mapWallet[hash].BindWallet(this);
         AddToSpends(hash);
+        AddUnspentCandidates(wtxIn);
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
@@ -720,14 +757,16 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         //// debug print
         LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
+        // Break debit/credit balance caches, before the write so that they
+        // stay in step with mapWallet even if it fails:
+        wtx.MarkDirty();
+        AddUnspentCandidates(wtx);
+
         // Write to disk
         if (fInsertedNew || fUpdated)
             if (!wtx.WriteToDisk())
                 return false;
 
-        // Break debit/credit balance caches:
-        wtx.MarkDirty();
-
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
@@ -774,8 +813,10 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     // available of the outputs it spends. So force those to be
     // recomputed, also:
     for (const CTxIn& txin : tx.vin) {
-        if (mapWallet.count(txin.prevout.hash))
+        if (mapWallet.count(txin.prevout.hash)) {
             mapWallet[txin.prevout.hash].MarkDirty();
+            AddUnspentCandidate(txin.prevout.hash);
+        }
     }
 }
 
@@ -785,8 +826,18 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end()) {
+            // Whatever the erased transaction spent is spendable again
+            for (const CTxIn& txin : mi->second.vin) {
+                if (mapWallet.count(txin.prevout.hash))
+                    setUnspentCandidates.insert(txin.prevout.hash);
+            }
+            mapWallet.erase(mi);
+            setUnspentCandidates.erase(hash);
+            nBalanceGeneration++;
             CWalletDB(strWalletFile).EraseTx(hash);
+        }
     }
     return;
 }
@@ -1097,27 +1148,239 @@ bool CWalletTx::WriteToDisk()
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
  */
+bool CWalletScanFilter::IsRelevant(const CTxOut& txout) const
+{
+    if (setScripts.count(txout.scriptPubKey))
+        return true;
+
+    std::vector<std::vector<unsigned char> > vSolutions;
+    txnouttype whichType;
+    if (!Solver(txout.scriptPubKey, whichType, vSolutions))
+        return false;
+
+    switch (whichType) {
+    case TX_PUBKEY:
+        return setKeyIDs.count(CPubKey(vSolutions[0]).GetID()) > 0;
+    case TX_PUBKEYHASH:
+        return setKeyIDs.count(CKeyID(uint160(vSolutions[0]))) > 0;
+    case TX_SCRIPTHASH:
+        return setScriptIDs.count(CScriptID(uint160(vSolutions[0]))) > 0;
+    case TX_MULTISIG:
+        for (unsigned int i = 1; i + 1 < vSolutions.size(); i++) {
+            if (setKeyIDs.count(CPubKey(vSolutions[i]).GetID()))
+                return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+bool CWalletScanFilter::IsRelevant(const CTransaction& tx) const
+{
+    for (const CTxOut& txout : tx.vout) {
+        if (IsRelevant(txout))
+            return true;
+    }
+    return false;
+}
+
+void CWallet::GetScanFilter(CWalletScanFilter& filter) const
+{
+    GetKeys(filter.setKeyIDs);
+
+    LOCK(cs_KeyStore);
+    for (const PAIRTYPE(CScriptID, CScript) & item : mapScripts)
+        filter.setScriptIDs.insert(item.first);
+    filter.setScripts.insert(setWatchOnly.begin(), setWatchOnly.end());
+    filter.setScripts.insert(setMultiSig.begin(), setMultiSig.end());
+}
+
+struct CRescanBlock {
+    CBlock block;
+    bool fRead;
+    std::vector<unsigned int> vMatches; // positions in block.vtx with an output matching the filter
+
+    CRescanBlock() : fRead(false) {}
+};
+
+/**
+ * Pipelined wallet rescan: worker threads read and deserialize blocks ahead
+ * of the scan position and match their outputs against a snapshot of the
+ * wallet's scripts, without taking cs_main or cs_wallet. The caller takes the
+ * results in height order and only has to look at the matched transactions
+ * and those spending from the wallet.
+ */
+class CWalletRescanPipeline
+{
+private:
+    static const size_t BLOCKS_AHEAD_PER_THREAD = 16;
+
+    const std::vector<CDiskBlockPos>& vPos;
+    const std::vector<uint256>& vHash;
+    const CWalletScanFilter& filter;
+    size_t nWindow;
+
+    boost::mutex mutex;
+    boost::condition_variable condWorker;   // the consumer took a block
+    boost::condition_variable condConsumer; // a block was matched
+    std::vector<boost::shared_ptr<CRescanBlock> > vBlocks;
+    size_t nNextRead;
+    size_t nNextApply;
+    bool fStop;
+    boost::thread_group threads;
+
+    void ThreadWorker()
+    {
+        RenameThread("esbcoin-rescan");
+        while (true) {
+            size_t nPos;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fStop && nNextRead < vPos.size() && nNextRead >= nNextApply + nWindow)
+                    condWorker.wait(lock);
+                if (fStop || nNextRead >= vPos.size())
+                    return;
+                nPos = nNextRead++;
+            }
+
+            boost::shared_ptr<CRescanBlock> job(new CRescanBlock());
+            if (ReadBlockFromDisk(job->block, vPos[nPos]) && job->block.GetHash() == vHash[nPos]) {
+                job->fRead = true;
+                for (unsigned int i = 0; i < job->block.vtx.size(); i++) {
+                    if (filter.IsRelevant(job->block.vtx[i]))
+                        job->vMatches.push_back(i);
+                }
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            vBlocks[nPos] = job;
+            condConsumer.notify_all();
+        }
+    }
+
+public:
+    CWalletRescanPipeline(const std::vector<CDiskBlockPos>& vPosIn, const std::vector<uint256>& vHashIn, const CWalletScanFilter& filterIn, int nWorkers)
+        : vPos(vPosIn), vHash(vHashIn), filter(filterIn), vBlocks(vPosIn.size()), nNextRead(0), nNextApply(0), fStop(false)
+    {
+        nWorkers = std::max(nWorkers, 1);
+        nWindow = nWorkers * BLOCKS_AHEAD_PER_THREAD;
+        for (int i = 0; i < nWorkers; i++)
+            threads.create_thread(boost::bind(&CWalletRescanPipeline::ThreadWorker, this));
+    }
+
+    ~CWalletRescanPipeline()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+            condWorker.notify_all();
+        }
+        threads.join_all();
+    }
+
+    /** Wait for the next block in height order. Returns false after the last one. */
+    bool Next(boost::shared_ptr<CRescanBlock>& jobRet)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nNextApply >= vBlocks.size())
+            return false;
+        while (!vBlocks[nNextApply])
+            condConsumer.wait(lock);
+        jobRet.swap(vBlocks[nNextApply]);
+        vBlocks[nNextApply].reset();
+        nNextApply++;
+        condWorker.notify_all();
+        return true;
+    }
+};
+
+/**
+ * Scan the active chain from pindexStart for transactions involving the wallet.
+ * Blocks are matched in parallel by CWalletRescanPipeline; cs_main and
+ * cs_wallet are only held while the matches of one block are applied, so the
+ * node keeps running during long rescans.
+ */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
     int ret = 0;
     int64_t nNow = GetTime();
 
-    CBlockIndex* pindex = pindexStart;
+    std::vector<CBlockIndex*> vIndex;
+    std::vector<CDiskBlockPos> vPos;
+    std::vector<uint256> vHash;
+    CWalletScanFilter filter;
     {
         LOCK2(cs_main, cs_wallet);
 
         // no need to read and scan block, if block was created before
         // our wallet birthday (as adjusted for block time variability)
+        CBlockIndex* pindex = pindexStart;
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
 
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+        for (; pindex; pindex = chainActive.Next(pindex)) {
+            vIndex.push_back(pindex);
+            vPos.push_back(pindex->GetBlockPos());
+            vHash.push_back(pindex->GetBlockHash());
+        }
+        GetScanFilter(filter);
+    }
+    if (vIndex.empty())
+        return ret;
 
+    fScanningWallet = true;
+    nScanStartTime = GetTimeMillis();
+    dScanProgress = 0;
+    ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+    double dProgressStart = Checkpoints::GuessVerificationProgress(vIndex.front(), false);
+    double dProgressTip = Checkpoints::GuessVerificationProgress(vIndex.back(), false);
+    {
+        CWalletRescanPipeline pipeline(vPos, vHash, filter, nRescanThreads);
+        boost::shared_ptr<CRescanBlock> job;
+        for (size_t n = 0; pipeline.Next(job); n++) {
+            CBlockIndex* pindex = vIndex[n];
+            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
+                dScanProgress = (Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart);
+                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)(dScanProgress * 100))));
+            }
+            if (GetTime() >= nNow + 60) {
+                nNow = GetTime();
+                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+            }
+            if (!job->fRead) {
+                LogPrintf("%s : failed to read block %s\n", __func__, vHash[n].ToString());
+                continue;
+            }
+
+            LOCK2(cs_main, cs_wallet);
+            // Blocks reorganized away are picked up again from the fork point below
+            if (!chainActive.Contains(pindex))
+                continue;
+            std::vector<unsigned int>::const_iterator itMatch = job->vMatches.begin();
+            for (unsigned int i = 0; i < job->block.vtx.size(); i++) {
+                const CTransaction& tx = job->block.vtx[i];
+                bool fRelevant = itMatch != job->vMatches.end() && *itMatch == i;
+                if (fRelevant)
+                    ++itMatch;
+                else
+                    fRelevant = mapWallet.count(tx.GetHash()) > 0;
+                for (unsigned int j = 0; !fRelevant && j < tx.vin.size(); j++)
+                    fRelevant = mapWallet.count(tx.vin[j].prevout.hash) > 0;
+                if (fRelevant && AddToWalletIfInvolvingMe(tx, &job->block, fUpdate))
+                    ret++;
+            }
+        }
+    }
+
+    // Blocks connected while the pipeline ran were already offered to the
+    // wallet, but may spend outputs the scan had not reached yet: go over
+    // everything past the last scanned block (or the fork point) once more.
+    {
+        LOCK2(cs_main, cs_wallet);
+        const CBlockIndex* pindexFork = chainActive.FindFork(vIndex.back());
+        CBlockIndex* pindex = pindexFork ? chainActive.Next(pindexFork) : chainActive.Genesis();
+        while (pindex) {
             CBlock block;
             ReadBlockFromDisk(block, pindex);
             for (CTransaction& tx : block.vtx) {
@@ -1125,13 +1388,11 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
                     ret++;
             }
             pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
-            }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+    dScanProgress = 1;
+    fScanningWallet = false;
     return ret;
 }
 
@@ -1236,19 +1497,65 @@ void CWallet::ResendWalletTransactions()
  * @{
  */
 
-CAmount CWallet::GetBalance() const
+/**
+ * Recompute the balance totals if the chain tip, the mempool, the set of
+ * completed IX locks or the wallet itself changed since the last call.
+ * Candidates found to be fully spent on the way are dropped from the set.
+ */
+const CWallet::CBalanceCache& CWallet::GetBalanceCache() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    uint256 hashTip = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256(0);
+    unsigned int nMempoolUpdated = mempool.GetTransactionsUpdated();
+    CBalanceCache& cache = balanceCache;
+    if (cache.fValid && cache.hashTip == hashTip && cache.nGeneration == nBalanceGeneration &&
+        cache.nMempoolUpdated == nMempoolUpdated && cache.nTXLocks == nCompleteTXLocks)
+        return cache;
+
+    cache.nBalance = cache.nUnconfirmed = cache.nImmature = 0;
+    cache.nWatchOnly = cache.nUnconfirmedWatchOnly = cache.nImmatureWatchOnly = 0;
+
+    std::set<uint256>::iterator it = setUnspentCandidates.begin();
+    while (it != setUnspentCandidates.end()) {
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(*it);
+        if (mi == mapWallet.end()) {
+            setUnspentCandidates.erase(it++);
+            continue;
         }
+        const CWalletTx* pcoin = &(*mi).second;
+
+        bool fTrusted = pcoin->IsTrusted();
+        if (fTrusted) {
+            cache.nBalance += pcoin->GetAvailableCredit();
+            cache.nWatchOnly += pcoin->GetAvailableWatchOnlyCredit();
+        }
+        if (!IsFinalTx(*pcoin) || (!fTrusted && pcoin->GetDepthInMainChain() == 0)) {
+            cache.nUnconfirmed += pcoin->GetAvailableCredit();
+            cache.nUnconfirmedWatchOnly += pcoin->GetAvailableWatchOnlyCredit();
+        }
+        cache.nImmature += pcoin->GetImmatureCredit();
+        cache.nImmatureWatchOnly += pcoin->GetImmatureWatchOnlyCredit();
+
+        if (IsFullySpent(*pcoin))
+            setUnspentCandidates.erase(it++);
+        else
+            ++it;
     }
 
-    return nTotal;
+    cache.hashTip = hashTip;
+    cache.nGeneration = nBalanceGeneration;
+    cache.nMempoolUpdated = nMempoolUpdated;
+    cache.nTXLocks = nCompleteTXLocks;
+    cache.fValid = true;
+    return cache;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    LOCK2(cs_main, cs_wallet);
+    return GetBalanceCache().nBalance;
 }
 
 CAmount CWallet::GetAnonymizableBalance() const
@@ -1371,71 +1678,32 @@ CAmount CWallet::GetDenominatedBalance(bool unconfirmed) const
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalanceCache().nUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalanceCache().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalanceCache().nWatchOnly;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalanceCache().nUnconfirmedWatchOnly;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalanceCache().nImmatureWatchOnly;
 }
 
 /**
@@ -1447,8 +1715,10 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
+        for (const uint256& wtxid : setUnspentCandidates) {
+            map<uint256, CWalletTx>::const_iterator it = mapWallet.find(wtxid);
+            if (it == mapWallet.end())
+                continue;
             const CWalletTx* pcoin = &(*it).second;
 
             if (!CheckFinalTx(*pcoin))
@@ -1623,6 +1893,32 @@ bool CWallet::SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int
     return true;
 }
 
+// Build the kernel search table of the coins SelectStakeCoins() would stake
+bool CWallet::GetStakeKernelInputs(std::vector<CStakeKernelInput>& vInputs, unsigned int nTimeTx) const
+{
+    CAmount nBalance = GetBalance();
+    if (nBalance <= nReserveBalance)
+        return false;
+
+    std::set<std::pair<const CWalletTx*, unsigned int> > setStakeCoins;
+    if (!SelectStakeCoins(setStakeCoins, nBalance - nReserveBalance))
+        return false;
+
+    LOCK(cs_main);
+    vInputs.reserve(setStakeCoins.size());
+    for (PAIRTYPE(const CWalletTx*, unsigned int) pcoin : setStakeCoins) {
+        CStakeKernelInput input;
+        COutPoint prevout(pcoin.first->GetHash(), pcoin.second);
+        if (!GetStakeKernelInput(prevout, pcoin.first->vout[pcoin.second].nValue, pcoin.first->hashBlock, nTimeTx, input)) {
+            if (fDebug)
+                LogPrintf("GetStakeKernelInputs() : no kernel input for %s\n", prevout.ToString());
+            continue;
+        }
+        vInputs.push_back(input);
+    }
+    return true;
+}
+
 bool CWallet::MintableCoins()
 {
     //LOCK(cs_main);
@@ -2331,8 +2627,8 @@ bool CWallet::CreateTransaction(CScript scriptPubKey, const CAmount& nValue, CWa
     return CreateTransaction(vecSend, wtxNew, reservekey, nFeeRet, strFailReason, coinControl, coin_type, useIX, nFeePay);
 }
 
-// ppcoin: create coin stake transaction
-bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, CMutableTransaction& txNew, unsigned int& nTxNewTime, CAmount nFees)
+// ppcoin: create coin stake transaction spending the kernel found by FindStakeKernel()
+bool CWallet::CreateCoinStake(const CKeyStore& keystore, const CStakeKernelInput& kernel, CMutableTransaction& txNew, CAmount nFees)
 {
     // The following split & combine thresholds are important to security
     // Should not be adjusted if you don't understand the consequences
@@ -2344,7 +2640,6 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     // Mark coin stake transaction
     txNew.vout.push_back(CTxOut(0, CScript{}));
 
-    // Choose coins to use
     CAmount nBalance = GetBalance();
 
     if (mapArgs.count("-reservebalance") && !ParseMoney(mapArgs["-reservebalance"], nReserveBalance))
@@ -2353,102 +2648,55 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if (nBalance <= nReserveBalance)
         return false;
 
-    // presstab HyperStake - Initialize as static and don't update the set on every run of CreateCoinStake() in order to lighten resource use
-    static std::set<pair<const CWalletTx*, unsigned int> > setStakeCoins;
-    static int nLastStakeSetUpdate = 0;
-
-    if (GetTime() - nLastStakeSetUpdate > nStakeSetUpdateTime) {
-        setStakeCoins.clear();
-        if (!SelectStakeCoins(setStakeCoins, nBalance - nReserveBalance))
-            return false;
-
-        nLastStakeSetUpdate = GetTime();
-    }
-
-    if (setStakeCoins.empty())
+    // The kernel table may be older than the wallet: make sure the kernel is still ours to spend
+    const CWalletTx* pcoin = GetWalletTx(kernel.prevout.hash);
+    if (!pcoin || kernel.prevout.n >= pcoin->vout.size() || IsSpent(kernel.prevout.hash, kernel.prevout.n)) {
+        LogPrintf("CreateCoinStake : kernel %s is no longer available\n", kernel.prevout.ToString());
         return false;
+    }
 
     vector<const CWalletTx*> vwtxPrev;
 
     CAmount nCredit = 0;
     CScript scriptPubKeyKernel;
 
-    //prevent staking a time that won't be accepted
-    if (GetAdjustedTime() <= chainActive.Tip()->nTime)
-        MilliSleep(10000);
-
-    for(PAIRTYPE(const CWalletTx*, unsigned int) pcoin : setStakeCoins) {
-        //make sure that enough time has elapsed between
-        CBlockIndex* pindex = NULL;
-        BlockMap::iterator it = mapBlockIndex.find(pcoin.first->hashBlock);
-        if (it != mapBlockIndex.end())
-            pindex = it->second;
-        else {
-            if (fDebug)
-                LogPrintf("CreateCoinStake() failed to find block index \n");
-            continue;
-        }
-
-        // Read block header
-        CBlockHeader block = pindex->GetBlockHeader();
-
-        uint256 hashProofOfStake = 0;
-        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-        nTxNewTime = GetAdjustedTime();
+    vector<valtype> vSolutions;
+    txnouttype whichType;
+    CScript scriptPubKeyOut;
 
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (CheckStakeKernelHash(nBits, block, *pcoin.first, prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
-            //Double check that this will pass time requirements
-            if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
-                LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
-                continue;
-            }
-
-            // Found a kernel
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : kernel found\n");
-
-            vector<valtype> vSolutions;
-            txnouttype whichType;
-            CScript scriptPubKeyOut;
-
-            scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
-            if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
-                LogPrintf("CreateCoinStake : failed to parse kernel\n");
-                break;
-            }
+    scriptPubKeyKernel = pcoin->vout[kernel.prevout.n].scriptPubKey;
+    if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
+        LogPrintf("CreateCoinStake : failed to parse kernel\n");
+        return false;
+    }
+    if (fDebug && GetBoolArg("-printcoinstake", false))
+        LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
+    if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
+        return false; // only support pay to public key and pay to address
+    }
+    if (whichType == TX_PUBKEYHASH) // pay to address type
+    {
+        //convert to pay to public key type
+        CKey key;
+        if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
             if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
-            if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
-                if (fDebug && GetBoolArg("-printcoinstake", false))
-                    LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
-                break; // only support pay to public key and pay to address
-            }
-            if (whichType == TX_PUBKEYHASH) // pay to address type
-            {
-                //convert to pay to public key type
-                CKey key;
-                if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
-                    if (fDebug && GetBoolArg("-printcoinstake", false))
-                        LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                    break; // unable to find corresponding public key
-                }
-
-                scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-            } else
-                scriptPubKeyOut = scriptPubKeyKernel;
+                LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+            return false; // unable to find corresponding public key
+        }
 
-            txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-            nCredit += pcoin.first->vout[pcoin.second].nValue;
-            vwtxPrev.push_back(pcoin.first);
-            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+        scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+    } else
+        scriptPubKeyOut = scriptPubKeyKernel;
 
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
+    txNew.vin.push_back(CTxIn(kernel.prevout.hash, kernel.prevout.n));
+    nCredit += pcoin->vout[kernel.prevout.n].nValue;
+    vwtxPrev.push_back(pcoin);
+    txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
 
-            break;
-        }
-    }
+    if (fDebug && GetBoolArg("-printcoinstake", false))
+        LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
 
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
@@ -2495,13 +2743,12 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
 
     // Sign
     int nIn = 0;
-    for(const CWalletTx* pcoin : vwtxPrev) {
-        if (!SignSignature(*this, *pcoin, txNew, nIn++))
+    for(const CWalletTx* pcoinPrev : vwtxPrev) {
+        if (!SignSignature(*this, *pcoinPrev, txNew, nIn++))
             return error("CreateCoinStake : failed to sign coinstake");
     }
 
     // Successfully generated coinstake
-    nLastStakeSetUpdate = 0; //this will trigger stake set to repopulate next round
     return true;
 }
 
@@ -3156,6 +3403,7 @@ bool CWallet::UpdatedTransaction(const uint256& hashTx)
         // Only notify UI if this transaction is in this wallet
         map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hashTx);
         if (mi != mapWallet.end()) {
+            nBalanceGeneration++;
             NotifyTransactionChanged(this, hashTx, CT_UPDATED);
             return true;
         }
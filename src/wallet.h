@@ -26,6 +26,7 @@
 #include "masternode.h"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -43,6 +44,7 @@ extern unsigned int nTxConfirmTarget;
 extern bool bSpendZeroConfChange;
 extern bool fSendFreeTransactions;
 extern bool fPayAtLeastCustomFee;
+extern int nRescanThreads;
 
 //! -paytxfee default
 static const CAmount DEFAULT_TRANSACTION_FEE = 0;
@@ -54,6 +56,10 @@ static const CAmount DEFAULT_TRANSACTION_MAXFEE = 1 * COIN;
 static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWarning;
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
+//! Maximum number of block matching threads used by a wallet rescan
+static const int MAX_RESCAN_THREADS = 16;
+//! -rescanthreads default (0 = auto)
+static const int DEFAULT_RESCAN_THREADS = 0;
 
 class CAccountingEntry;
 class CCoinControl;
@@ -126,6 +132,22 @@ public:
     StringMap destdata;
 };
 
+/**
+ * Snapshot of the scripts a wallet recognises as its own, so that blocks can
+ * be matched without holding cs_wallet. Matching is a superset of IsMine():
+ * the wallet still makes the final decision on every matched transaction.
+ */
+class CWalletScanFilter
+{
+public:
+    std::set<CKeyID> setKeyIDs;
+    std::set<CScriptID> setScriptIDs;
+    std::set<CScript> setScripts;
+
+    bool IsRelevant(const CTxOut& txout) const;
+    bool IsRelevant(const CTransaction& tx) const;
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -159,9 +181,43 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Transactions that may still hold an unspent or immature output of ours.
+     * Balances and coin selection only visit these instead of all of mapWallet;
+     * a transaction is (re)added whenever it or something spending it changes,
+     * and dropped again by the next balance scan that finds it fully spent.
+     */
+    mutable std::set<uint256> setUnspentCandidates;
+
+    //! Bumped on every wallet change that can move a balance
+    unsigned int nBalanceGeneration;
+
+    /** Balance totals of setUnspentCandidates, valid for one chain tip, mempool and wallet state */
+    struct CBalanceCache {
+        bool fValid;
+        uint256 hashTip;
+        unsigned int nGeneration;
+        unsigned int nMempoolUpdated;
+        int nTXLocks;
+
+        CAmount nBalance;
+        CAmount nUnconfirmed;
+        CAmount nImmature;
+        CAmount nWatchOnly;
+        CAmount nUnconfirmedWatchOnly;
+        CAmount nImmatureWatchOnly;
+    };
+    mutable CBalanceCache balanceCache;
+
+    void AddUnspentCandidate(const uint256& hash);
+    void AddUnspentCandidates(const CTransaction& tx);
+    bool IsFullySpent(const CWalletTx& wtx) const;
+    const CBalanceCache& GetBalanceCache() const;
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const;
+    bool GetStakeKernelInputs(std::vector<CStakeKernelInput>& vInputs, unsigned int nTimeTx) const;
     bool SelectCoinsDark(CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& setCoinsRet, CAmount& nValueRet, int nObfuscationRoundsMin, int nObfuscationRoundsMax) const;
     bool SelectCoinsByDenominations(int nDenom, CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& vCoinsRet, std::vector<COutput>& vCoinsRet2, CAmount& nValueRet, int nObfuscationRoundsMin, int nObfuscationRoundsMax);
     bool SelectCoinsDarkDenominated(CAmount nTargetValue, std::vector<CTxIn>& setCoinsRet, CAmount& nValueRet) const;
@@ -211,6 +267,11 @@ public:
     CAmount nAutoCombineThreshold;
     int nAutoCombineLimit;
 
+    //! State of a running ScanForWalletTransactions, readable without cs_wallet
+    std::atomic<bool> fScanningWallet;
+    std::atomic<int64_t> nScanStartTime;
+    std::atomic<double> dScanProgress;
+
     CWallet()
     {
         SetNull();
@@ -241,6 +302,11 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fWalletUnlockAnonymizeOnly = false;
+        nBalanceGeneration = 0;
+        balanceCache.fValid = false;
+        fScanningWallet = false;
+        nScanStartTime = 0;
+        dScanProgress = 0;
 
         // Stake Settings
         nHashDrift = 45;
@@ -388,6 +454,7 @@ public:
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
+    void GetScanFilter(CWalletScanFilter& filter) const;
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
     void ReacceptWalletTransactions();
     void ResendWalletTransactions();
@@ -417,7 +484,7 @@ public:
     int GenerateObfuscationOutputs(int nTotalValue, std::vector<CTxOut>& vout);
     bool CreateCollateralTransaction(CMutableTransaction& txCollateral, std::string& strReason);
     bool ConvertList(std::vector<CTxIn> vCoins, std::vector<int64_t>& vecAmounts);
-    bool CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, CMutableTransaction& txNew, unsigned int& nTxNewTime, CAmount nFees);
+    bool CreateCoinStake(const CKeyStore& keystore, const CStakeKernelInput& kernel, CMutableTransaction& txNew, CAmount nFees);
     bool MultiSend();
     void AutoCombineDust();
 